@@ -4,16 +4,61 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/camera.cpp \
 ../src/conetree.cpp \
-../src/tinyxml2.cpp 
+../src/decompress.cpp \
+../src/fswalk.cpp \
+../src/glcore.cpp \
+../src/importers.cpp \
+../src/inputlog.cpp \
+../src/journal.cpp \
+../src/memreport.cpp \
+../src/metrics.cpp \
+../src/mmfile.cpp \
+../src/oit.cpp \
+../src/renderer.cpp \
+../src/renderer_core.cpp \
+../src/renderer_legacy.cpp \
+../src/tinyxml2.cpp \
+../src/updates.cpp 
 
 CPP_DEPS += \
+./src/camera.d \
 ./src/conetree.d \
-./src/tinyxml2.d 
+./src/decompress.d \
+./src/fswalk.d \
+./src/glcore.d \
+./src/importers.d \
+./src/inputlog.d \
+./src/journal.d \
+./src/memreport.d \
+./src/metrics.d \
+./src/mmfile.d \
+./src/oit.d \
+./src/renderer.d \
+./src/renderer_core.d \
+./src/renderer_legacy.d \
+./src/tinyxml2.d \
+./src/updates.d 
 
 OBJS += \
+./src/camera.o \
 ./src/conetree.o \
-./src/tinyxml2.o 
+./src/decompress.o \
+./src/fswalk.o \
+./src/glcore.o \
+./src/importers.o \
+./src/inputlog.o \
+./src/journal.o \
+./src/memreport.o \
+./src/metrics.o \
+./src/mmfile.o \
+./src/oit.o \
+./src/renderer.o \
+./src/renderer_core.o \
+./src/renderer_legacy.o \
+./src/tinyxml2.o \
+./src/updates.o 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -28,7 +73,7 @@ src/%.o: ../src/%.cpp src/subdir.mk
 clean: clean-src
 
 clean-src:
-	-$(RM) ./src/conetree.d ./src/conetree.o ./src/tinyxml2.d ./src/tinyxml2.o
+	-$(RM) ./src/camera.d ./src/camera.o ./src/conetree.d ./src/conetree.o ./src/decompress.d ./src/decompress.o ./src/fswalk.d ./src/fswalk.o ./src/glcore.d ./src/glcore.o ./src/importers.d ./src/importers.o ./src/inputlog.d ./src/inputlog.o ./src/journal.d ./src/journal.o ./src/memreport.d ./src/memreport.o ./src/metrics.d ./src/metrics.o ./src/mmfile.d ./src/mmfile.o ./src/oit.d ./src/oit.o ./src/renderer.d ./src/renderer.o ./src/renderer_core.d ./src/renderer_core.o ./src/renderer_legacy.d ./src/renderer_legacy.o ./src/tinyxml2.d ./src/tinyxml2.o ./src/updates.d ./src/updates.o
 
 .PHONY: clean-src
 
@@ -0,0 +1,180 @@
+#include "camera.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+// The vertical field of view and far plane of frameProjectionMatrix()
+static const float halfFovDeg = 22.5f;
+static const float maxFlightDistance = 900.0f;
+
+Mat4 cameraView(const CameraPose &pose) {
+
+	const Pos &t = pose.target;
+	return mat4Translate(0.0f, 0.0f, -pose.distance)
+			* mat4Quat(pose.orientation) * mat4Translate(-t.x, -t.y, -t.z);
+}
+
+// A view-space vector in world space
+static Pos toWorld(const Quat &orientation, float x, float y, float z) {
+
+	Mat4 r = mat4Quat(orientation);
+	const float *m = r.m;
+	Pos w;
+	w.x = m[0] * x + m[1] * y + m[2] * z;
+	w.y = m[4] * x + m[5] * y + m[6] * z;
+	w.z = m[8] * x + m[9] * y + m[10] * z;
+	return w;
+}
+
+Camera::Camera() :
+		next(0), recordingOn(false) {
+	setEuler(0.0f, 0.0f, 20.0f, 0.0f, 0.0f);
+}
+
+void Camera::orbit(float aboutViewX, float aboutWorldY) {
+
+	pose.orientation = quatNormalize(
+			quatRotate(aboutViewX, 1.0f, 0.0f, 0.0f) * pose.orientation
+					* quatRotate(aboutWorldY, 0.0f, 1.0f, 0.0f));
+}
+
+void Camera::pan(float dx, float dy) {
+
+	Pos d = toWorld(pose.orientation, dx, dy, 0.0f);
+	pose.target.x -= d.x;
+	pose.target.y -= d.y;
+	pose.target.z -= d.z;
+}
+
+void Camera::dolly(float delta) {
+
+	pose.distance = std::max(minDistance, pose.distance + delta);
+}
+
+void Camera::setEuler(float rotX, float rotY, float zoom, float panX,
+		float panY) {
+
+	pose.orientation = quatRotate(rotX, 1.0f, 0.0f, 0.0f)
+			* quatRotate(rotY, 0.0f, 1.0f, 0.0f);
+	pose.distance = 2.0f * zoom;
+	// The world origin shown (panX, panY) off the view's center
+	Pos d = toWorld(pose.orientation, panX, panY, 0.0f);
+	pose.target = { -d.x, -d.y, -d.z };
+}
+
+void Camera::flyTo(const CameraPose &to, int frames) {
+
+	const CameraPose from = pose;
+	float dx = to.target.x - from.target.x, dy = to.target.y - from.target.y,
+			dz = to.target.z - from.target.z;
+	float travel = sqrtf(dx * dx + dy * dy + dz * dz);
+	// Halfway the view spans the whole way, if the ends do not already,
+	// though not past where frameProjectionMatrix() clips
+	float highest = std::max(from.distance, to.distance);
+	float rise = std::max(0.0f,
+			std::min(travel / tanf(halfFovDeg * (float) M_PI / 180.0f) * 0.5f,
+					maxFlightDistance) - highest);
+
+	trajectory.clear();
+	frames = std::max(frames, 1);
+	for (int i = 1; i <= frames; ++i) {
+		float s = (float) i / frames;
+		float u = s * s * s * (s * (s * 6.0f - 15.0f) + 10.0f);
+		CameraPose p;
+		p.orientation = quatSlerp(from.orientation, to.orientation, u);
+		p.target.x = from.target.x + dx * u;
+		p.target.y = from.target.y + dy * u;
+		p.target.z = from.target.z + dz * u;
+		p.distance = from.distance + (to.distance - from.distance) * u
+				+ 4.0f * u * (1.0f - u) * rise;
+		trajectory.push_back(p);
+	}
+	next = 0;
+}
+
+CameraPose Camera::fit(const Pos &lo, const Pos &hi, float aspect) const {
+
+	Pos center = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z)
+			* 0.5f };
+	float radius = 0.5f
+			* sqrtf((hi.x - lo.x) * (hi.x - lo.x) + (hi.y - lo.y) * (hi.y - lo.y)
+					+ (hi.z - lo.z) * (hi.z - lo.z));
+	return fit(center, radius, aspect);
+}
+
+CameraPose Camera::fit(const Pos &center, float radius, float aspect) const {
+
+	CameraPose p = pose;
+	p.target = center;
+	// Room for the node spheres and the cone under a single node
+	radius = std::max(radius, 1.0f) + 0.5f;
+	float halfY = halfFovDeg * (float) M_PI / 180.0f;
+	float halfX = atanf(tanf(halfY) * std::max(aspect, 0.01f));
+	p.distance = radius / sinf(std::min(halfX, halfY));
+	return p;
+}
+
+bool Camera::step() {
+
+	if (next >= trajectory.size())
+		return false;
+	pose = trajectory[next++];
+	return true;
+}
+
+void Camera::stop() {
+
+	trajectory.clear();
+	next = 0;
+}
+
+void Camera::startRecording() {
+
+	recorded.clear();
+	recordingOn = true;
+}
+
+bool Camera::stopRecording(const string &filename) {
+
+	recordingOn = false;
+	ofstream out(filename);
+	if (!out)
+		return false;
+	// Nine significant digits read back as the same floats
+	out << "# conetree camera path: qw qx qy qz  x y z  distance\n"
+			<< setprecision(9);
+	for (const CameraPose &p : recorded) {
+		const Quat &q = p.orientation;
+		out << q.w << ' ' << q.x << ' ' << q.y << ' ' << q.z << "  "
+				<< p.target.x << ' ' << p.target.y << ' ' << p.target.z << "  "
+				<< p.distance << '\n';
+	}
+	recorded.clear();
+	return bool(out);
+}
+
+bool Camera::play(const string &filename) {
+
+	ifstream in(filename);
+	if (!in)
+		return false;
+	vector<CameraPose> path;
+	string line;
+	while (getline(in, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		istringstream fields(line);
+		CameraPose p;
+		Quat &q = p.orientation;
+		if (!(fields >> q.w >> q.x >> q.y >> q.z >> p.target.x >> p.target.y
+				>> p.target.z >> p.distance))
+			return false;
+		path.push_back(p);
+	}
+	trajectory.swap(path);
+	next = 0;
+	return true;
+}
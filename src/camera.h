@@ -0,0 +1,105 @@
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "conetree.h"
+#include "vecmath.h"
+#include <vector>
+#include <string>
+
+// Where the camera is: it looks at 'target' from 'distance' away, turned
+// by 'orientation' (world to view).
+struct CameraPose {
+	Quat orientation;
+	Pos target;
+	float distance;
+};
+
+// The view matrix of a pose: translate(0, 0, -distance), rotate by the
+// orientation, translate(-target).
+Mat4 cameraView(const CameraPose &pose);
+
+// The viewer's camera. The mouse turns, pans and dollies it directly;
+// flights and recorded paths are trajectories computed up front, one pose
+// per frame, which step() then plays: the same path always shows the same
+// frames, however long each takes to draw.
+class Camera {
+public:
+	Camera();
+
+	CameraPose pose;
+
+	Mat4 view() const {
+		return cameraView(pose);
+	}
+
+	// Turntable orbit: degrees about the view's X axis and the world's Y
+	// axis (as the old rotX and rotY).
+	void orbit(float aboutViewX, float aboutWorldY);
+
+	// Moves the target across the view.
+	void pan(float dx, float dy);
+
+	// Moves the camera nearer (negative) or farther, not nearer than
+	// minDistance.
+	void dolly(float delta);
+
+	// The camera the viewer had before: translate(panX, panY, -2 * zoom),
+	// rotate rotX about X, rotY about Y.
+	void setEuler(float rotX, float rotY, float zoom, float panX, float panY);
+
+	// Flies to 'to' in 'frames' frames, easing in and out, and rising on
+	// the way when the targets lie far apart so that both stay in view.
+	void flyTo(const CameraPose &to, int frames);
+
+	// The pose that fits the box lo-hi in a view of 'aspect' (width over
+	// height), keeping the current orientation.
+	CameraPose fit(const Pos &lo, const Pos &hi, float aspect) const;
+
+	// The same for the sphere of 'radius' around 'center'
+	CameraPose fit(const Pos &center, float radius, float aspect) const;
+
+	// Moves to the next pose of the flight or path being played; false if
+	// there is none.
+	bool step();
+
+	bool moving() const {
+		return next < trajectory.size();
+	}
+
+	// Ends a flight or path where it is.
+	void stop();
+
+	// Keeps the pose of every frame from start until stop.
+	void startRecording();
+	void sample() {
+		if (recordingOn)
+			recorded.push_back(pose);
+	}
+	// Ends recording and writes the path to 'filename', a pose per line;
+	// false if it cannot.
+	bool stopRecording(const std::string &filename);
+
+	bool recording() const {
+		return recordingOn;
+	}
+
+	// Plays the path in 'filename' from its first pose. False if it cannot
+	// be read.
+	bool play(const std::string &filename);
+
+	// Frames in the path or flight being played
+	size_t frames() const {
+		return trajectory.size();
+	}
+
+	static constexpr float minDistance = 10.0f;
+
+private:
+	std::vector<CameraPose> trajectory;
+	size_t next;
+	std::vector<CameraPose> recorded;
+	bool recordingOn;
+};
+
+#endif // CAMERA_H
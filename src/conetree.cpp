@@ -1,48 +1,113 @@
 
+
+#include "glcore.h" // before GL/glut.h: enables the GL 3.3 prototypes
 #include <GL/glut.h>
+#include <GL/freeglut_ext.h>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "tinyxml2.h"
+#include "conetree.h"
+#include "renderer.h"
+#include "metrics.h"
+#include "memreport.h"
+#include "mmfile.h"
+#include "journal.h"
+#include "importers.h"
+#include "fswalk.h"
+#include "updates.h"
+#include "decompress.h"
+#include "camera.h"
+#include "inputlog.h"
 
 using namespace std;
 using namespace tinyxml2;
 
-struct Pos {
-	float x, y, z;
-};
-
-struct Node {
-	string text;
-	vector<Node*> children;
-	Pos pos;
-	int size;
-};
-
 Node *root = nullptr;
-GLUquadric *quad = nullptr;
-float rot_x = 0.0f, rot_y = 0.0f, zoom = 20.0f;
+string mapFilename;
+MapEnvelope mapEnvelope;
+MapFormat mapFormat = FORMAT_FREEMIND;
+bool fsMode = false;		// --fs: mapFilename is a directory to scan
+vector<string> forestFiles;	// several maps given: shown as one forest
+Node *forestRoot = nullptr;	// the root made for them
+bool forestGrid = true;		// the maps side by side, not on the root's circle
+DirectoryWalker fsWalker;
+bool scanning = false;		// fsWalker still reading
+string updateSource;		// --updates: "-" for stdin or a socket path
+UpdateStream updates;
+StreamedTree streamed;		// the nodes updates can name
+bool streaming = false;		// updates still open
+InputLog inputLog;			// --record, --replay
+bool replaying = false;		// events come from inputLog, not from GLUT
+bool headless = false;		// a replay without a window or GL
+unsigned replayClockMs = 0;	// the recorded time of the event replayed
+Renderer *renderer = nullptr;
+Camera camera;
 int last_mouse_x = 0, last_mouse_y = 0;
 bool vertical_mode = true;
 bool proportional_layout = false;
 bool animation_on = false;
 float animation_angle = 0.0f;
 int button;
-float panX = 0.0f;
-float panY = 0.0f;
 bool fullScreen;
+int windowWidth = 800, windowHeight = 600;
 
 // Cone selection/animation
 // - selectedConeIndex == -1 : ALL cones are selected
-// - selectedConeIndex >= 0  : only that cone index is selected (draw-order index)
+// - selectedConeIndex >= 0  : that cone index is selected (draw-order index),
+//   along with the cones marked into the multi-selection
 int selectedConeIndex = -1;
 float coneSpinAllDeg = 0.0f;
-float coneSpinSingleDeg = 0.0f;
+
+// Each cone's own spin by draw-order index: its angle, and its angular
+// velocity in degrees per tick. The selected cone and the marked ones turn
+// while animating; the others stay at the angle they stopped at.
+enum {
+	SPIN_MARKED = 1,	// in the multi-selection
+	SPIN_TOUCHED = 2	// in 'touched'
+};
+struct ConeSpin {
+	vector<float> angle, velocity;
+	vector<unsigned char> flags;	// SPIN_*
+	vector<int> marked;		// the marked cones, in draw order
+	// Cones not at rest or not at the default velocity, with their nodes:
+	// what carries over when the tree changes and the indexes with it.
+	vector<pair<const Node*, int>> touched;
+	unsigned treeVersion = 0;
+	unsigned markVersion = 0;
+} coneSpin;
+const float defaultConeVelocity = 4.0f;
 float animationSpeed = 1.0f; // 1.0 = normal speed
 int totalCones = 0;
 
+// GLUT redraws on its own unless a replay decides the frames.
+static void redisplay() {
+
+	if (!replaying)
+		glutPostRedisplay();
+}
+
+// Milliseconds since GLUT started, or in a replay since the recording did
+static unsigned clockMs() {
+
+	return replaying ? replayClockMs : glutGet(GLUT_ELAPSED_TIME);
+}
+
 static int countCones(const Node *n) {
 	if (!n)
 		return 0;
@@ -52,6 +117,50 @@ static int countCones(const Node *n) {
 	return c;
 }
 
+// Node whose cone has draw-order index 'cone' (the pre-order of the nodes
+// with children), found in O(depth) through the per-subtree cone counts.
+static const Node* coneNode(const Node *n, int cone) {
+
+	while (n && cone >= 0 && cone < n->cones) {
+		if (cone == 0)
+			return n;
+		cone--;
+		const Node *next = nullptr;
+		for (auto ch : n->children) {
+			if (cone < ch->cones) {
+				next = ch;
+				break;
+			}
+			cone -= ch->cones;
+		}
+		n = next;
+	}
+	return nullptr;
+}
+
+// The same walk, collecting the nodes from 'n' down to that node in 'path'
+// (left empty if there is no such cone).
+static void conePath(Node *n, int cone, vector<Node*> &path) {
+
+	size_t first = path.size();
+	while (n && cone >= 0 && cone < n->cones) {
+		path.push_back(n);
+		if (cone == 0)
+			return;
+		cone--;
+		Node *next = nullptr;
+		for (auto ch : n->children) {
+			if (cone < ch->cones) {
+				next = ch;
+				break;
+			}
+			cone -= ch->cones;
+		}
+		n = next;
+	}
+	path.resize(first);
+}
+
 static Pos rotateOffsetAroundConeAxis(const Pos &offset, float deg, bool vertical) {
 	// vertical: rotate around Y axis (X/Z plane)
 	// horizontal: rotate around X axis (Y/Z plane)
@@ -76,57 +185,368 @@ static Pos rotateOffsetAroundConeAxis(const Pos &offset, float deg, bool vertica
 	return out;
 }
 
-Node* parseMM(const string &filename) {
+// One document for every load of a single map: Clear() keeps its pool
+// blocks, so reloading a map reuses them instead of reallocating.
+static XMLDocument mapDocument;
 
-	XMLDocument doc;
-	if (doc.LoadFile(filename.c_str()) != XML_SUCCESS) {
-		cerr << "Failed to load " << filename << endl;
-		return nullptr;
+// Runs task(0) to task(count - 1) on up to one thread per core, each
+// thread taking the next index whenever it finishes one.
+static void parallelFor(size_t count, const function<void(size_t)> &task) {
+
+	size_t threads = std::min<size_t>(count,
+			std::max(1u, thread::hardware_concurrency()));
+	atomic<size_t> next(0);
+	auto work = [&] {
+		for (size_t i; (i = next++) < count;)
+			task(i);
+	};
+	vector<thread> pool;
+	for (size_t t = 1; t < threads; ++t)
+		pool.emplace_back(work);
+	work();
+	for (auto &t : pool)
+		t.join();
+}
+
+// Pool blocks of about 1/64 of the file, between tinyxml2's default and
+// the huge page size: a large map then takes a few hundred big blocks
+// rather than hundreds of thousands of 4 KB ones.
+static size_t poolBlockSize(size_t fileBytes) {
+
+	size_t block = TINYXML2_POOL_BLOCK_SIZE;
+	while (block < fileBytes / 64 && block < TINYXML2_LARGE_BLOCK_SIZE)
+		block *= 2;
+	return block;
+}
+
+// A map file mapped copy-on-write, plus one zero byte past its end, for
+// XMLDocument::ParseInPlace(): the parser then works on the page cache
+// instead of a heap copy of the whole file. 'data' stays null for what
+// cannot be mapped (pipes, empty files). 'pristine' is a read-only view
+// of the same bytes, which parsing in place leaves untouched (see
+// SourceCapture).
+struct MappedFile {
+	char *data = nullptr;
+	const char *pristine = nullptr;
+	size_t size = 0;
+
+	explicit MappedFile(const string &filename) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0)
+			return;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			// Reserve size + 1 bytes, then map the file over the start.
+			size_t n = st.st_size;
+			void *mem = mmap(nullptr, n + 1, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem != MAP_FAILED) {
+				if (mmap(mem, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+						fd, 0) != MAP_FAILED) {
+					data = (char*) mem;
+					size = n;
+					void *view = mmap(nullptr, n, PROT_READ, MAP_SHARED, fd, 0);
+					if (view != MAP_FAILED)
+						pristine = (const char*) view;
+				} else {
+					munmap(mem, n + 1);
+				}
+			}
+		}
+		close(fd);
+	}
+
+	~MappedFile() {
+		if (data)
+			munmap(data, size + 1);
+		if (pristine)
+			munmap((void*) pristine, size);
+	}
+};
+
+// Whether a raw label needs XMLUtil::TranslateText(): entities or carriage
+// returns, the only things tinyxml2 changes in an attribute value (it keeps
+// whitespace as it is). Most labels have none and are final as read.
+bool needsTranslation(const char *s, size_t n) {
+
+	for (size_t i = 0; i < n; ++i)
+		if (s[i] == '&' || s[i] == '\r')
+			return true;
+	return false;
+}
+
+// Copies the TEXT attribute untranslated; see Node::label().
+static void readLabel(const XMLElement *elem, Node *node) {
+
+	const XMLAttribute *attr = elem->FindAttribute("TEXT");
+	if (!attr)
+		return;
+	size_t length = 0;
+	const char *raw = attr->RawValue(&length);
+	if (!raw) {
+		node->text = attr->Value();
+		return;
+	}
+	node->text.assign(raw, length);
+	node->rawText = needsTranslation(raw, length);
+	node->textAsRead = true;
+}
+
+void decodeLabel(const Node *node) {
+
+	string &s = node->text;
+	if (node->textAsRead && node->rawTextLength == 0) {
+		// Saving writes the label as it was read
+		node->source.insert(node->textAt, s);
+		node->sourceSplit += s.size();
+		node->rawTextLength = s.size();
 	}
+	char *begin = &s[0];
+	char *end = XMLUtil::TranslateText(begin, begin + s.size(),
+			StrPair::ATTRIBUTE_VALUE);
+	s.resize(end - begin);
+	node->rawText = false;
+}
+
+// The tree of a FreeMind map parsed from 'file' into 'doc'. With
+// 'envelope', every Node also gets its uninterpreted source bytes for
+// saveMM() (when the file could be mapped twice).
+static Node* parseMM(XMLDocument &doc, MappedFile &file,
+		MapEnvelope *envelope) {
+
 	XMLElement *map = doc.FirstChildElement("map");
-	if (!map)
-		return nullptr;
-	XMLElement *rootElem = map->FirstChildElement("node");
+	XMLElement *rootElem = map ? map->FirstChildElement("node") : nullptr;
 	if (!rootElem)
 		return nullptr;
 
 	Node *root = new Node();
-	root->text = rootElem->Attribute("TEXT") ? rootElem->Attribute("TEXT") : "";
+	readLabel(rootElem, root);
+
+	// Without an untouched view of the input, only labels and attributes
+	// survive a save.
+	SourceCapture *capture = nullptr;
+	if (envelope && file.pristine) {
+		capture = new SourceCapture(file.data, file.pristine, file.size);
+		capture->begin(rootElem, *envelope);
+		envelope->partial = false;
+	}
 
 	auto parseRec = [&](auto &&self, XMLElement *elem, Node *node) -> void {
+		if (capture)
+			capture->open(elem, node);
+		for (XMLElement *attr = elem->FirstChildElement("attribute"); attr;
+				attr = attr->NextSiblingElement("attribute")) {
+			const char *name = attr->Attribute("NAME");
+			const char *value = attr->Attribute("VALUE");
+			if (name && value)
+				node->attributes.emplace_back(name, value);
+		}
 		for (XMLElement *child = elem->FirstChildElement("node"); child; child =
 				child->NextSiblingElement("node")) {
 			Node *newNode = new Node();
-			newNode->text =
-					child->Attribute("TEXT") ? child->Attribute("TEXT") : "";
+			readLabel(child, newNode);
 			node->children.insert(node->children.begin(), std::move(newNode));
+			if (capture)
+				capture->child(child, node);
 			self(self, child, newNode);
 		}
+		if (capture)
+			capture->close(node);
 	};
 	parseRec(parseRec, rootElem, root);
+	if (capture) {
+		capture->end(*envelope);
+		delete capture;
+	}
 	return root;
 }
 
+// Reads a map in any format detectFormat() knows, into 'format' if given,
+// gzip or zstd compressed or not. 'envelope', when given, receives the
+// source around the root node of an uncompressed FreeMind map (a default
+// one otherwise, marked partial for FreeMind), for saveMM(). 'mem', when
+// given, receives the document's pool usage, measured just before
+// the document is cleared. Loads on several threads need a document each.
+Node* loadMap(const string &filename, MapEnvelope *envelope = nullptr,
+		MemoryReport *mem = nullptr, MapFormat *format = nullptr,
+		XMLDocument &doc = mapDocument) {
+
+	// What cannot be mapped (pipes) is read into a buffer with the same
+	// zero byte past the end.
+	MappedFile file(filename);
+	vector<char> copy;
+	char *data = file.data;
+	size_t size = file.size;
+	if (!data) {
+		ifstream in(filename, ios::binary);
+		if (!in) {
+			cerr << "Failed to load " << filename << endl;
+			return nullptr;
+		}
+		copy.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		size = copy.size();
+		copy.push_back('\0');
+		data = copy.data();
+	}
+
+	// Compressed input is decompressed on another thread while it is read,
+	// the format told by the name inside and the first chunk.
+	Compression compression = detectCompression(data, size);
+	string name = filename;
+	Decompressor inflater;
+	const char *chunk = nullptr;
+	size_t chunkSize = 0;
+	bool inflating = false;	// until next() says the output has ended
+	if (compression != COMPRESSION_NONE) {
+		name = withoutCompressionExtension(filename);
+		if (!inflater.start(data, size, compression)) {
+			cerr << "Failed to load " << filename << ": " << inflater.error()
+					<< endl;
+			return nullptr;
+		}
+		inflating = inflater.next(chunk, chunkSize);
+		data = nullptr;
+	}
+
+	MapFormat detected = compression == COMPRESSION_NONE ?
+			detectFormat(filename, data, size) :
+			detectFormat(name, chunk, chunkSize);
+	if (format)
+		*format = detected;
+	if (envelope) {
+		envelope->head = "<map version=\"1.0.1\">\n";
+		envelope->tail = "\n</map>\n";
+		envelope->partial = detected == FORMAT_FREEMIND;
+	}
+	if (compression != COMPRESSION_NONE && detected != FORMAT_FREEMIND) {
+		// The other importers read their input whole.
+		copy.clear();
+		for (; inflating; inflating = inflater.next(chunk, chunkSize))
+			copy.insert(copy.end(), chunk, chunk + chunkSize);
+		size = copy.size();
+		copy.push_back('\0');
+		data = copy.data();
+	}
+
+	Node *root = nullptr;
+	TreeBuilder builder;
+	string title = name.substr(name.find_last_of('/') + 1);
+	bool imported = true;
+	// error() is the worker's until next() has returned false
+	if (!inflating && !inflater.error().empty()) {
+		imported = false;
+		builder.error = inflater.error();
+	} else if (compression != COMPRESSION_NONE && detected == FORMAT_FREEMIND) {
+		// Never decompressed whole: the tree grows chunk by chunk as the
+		// next ones are decompressed.
+		FreeMindReader reader(builder);
+		for (; inflating && imported;
+				inflating = inflater.next(chunk, chunkSize))
+			imported = reader.feed(chunk, chunkSize);
+		if (imported && !inflater.error().empty()) {
+			imported = false;
+			builder.error = inflater.error();
+		}
+		imported = imported && reader.finish();
+		if (mem)
+			mem->add("decompression chunks", inflater.memoryBytes());
+	} else if (detected == FORMAT_JSON) {
+		imported = importJSON(data, size, builder);
+	} else if (detected == FORMAT_TEXT) {
+		imported = importText(data, size, builder);
+	} else if (detected == FORMAT_EDGES) {
+		imported = importEdgeList(data, size, builder);
+		if (imported && builder.topLevel() > 1)
+			cerr << filename << ": " << builder.topLevel()
+					<< " rows without a parent, joined under one root" << endl;
+	} else {
+		doc.SetPoolBlockSize(poolBlockSize(size));
+		if (doc.ParseInPlace(data, size) != XML_SUCCESS) {
+			cerr << "Failed to load " << filename << endl;
+			doc.Clear();
+			return nullptr;
+		}
+		if (detected == FORMAT_OPML)
+			imported = importOPML(doc, builder, title);
+		else
+			root = parseMM(doc, file, envelope);
+		if (mem) {
+			mem->addDocument(doc);
+			if (file.data && compression == COMPRESSION_NONE)
+				mem->add("XML mapped input", 0, file.size + 1);
+		}
+		doc.Clear();
+	}
+	if (!imported) {
+		cerr << "Failed to load " << filename << " as " << formatName(detected)
+				<< ": " << builder.error << endl;
+		return nullptr;
+	}
+	if (!root)
+		root = builder.finish(title);
+	if (!root)
+		cerr << "No nodes in " << filename << endl;
+	return root;
+}
+
+// Reads every map of forestFiles, each on a thread with its own document,
+// under a new root made the forest root. Maps that fail to load are left
+// out; null if none loads. The maps' envelopes are not kept: a forest is
+// saved as one new map.
+Node* loadForest(MapEnvelope *envelope) {
+
+	vector<Node*> maps(forestFiles.size(), nullptr);
+	parallelFor(maps.size(), [&](size_t i) {
+		XMLDocument doc;
+		maps[i] = loadMap(forestFiles[i], nullptr, nullptr, nullptr, doc);
+	});
+
+	Node *forest = new Node();
+	for (auto map = maps.rbegin(); map != maps.rend(); ++map)
+		if (*map)
+			forest->children.push_back(*map);
+	if (forest->children.empty()) {
+		delete forest;
+		return nullptr;
+	}
+	forest->text = to_string(forest->children.size()) + " maps";
+	if (envelope) {
+		envelope->head = "<map version=\"1.0.1\">\n";
+		envelope->tail = "\n</map>\n";
+	}
+	forestRoot = forest;
+	return forest;
+}
+
 int computeSize(Node *node) {
 
 	if (!node)
 		return 0;
 	node->size = 1;
+	node->childTotal = 0.0f;
 	for (auto child : node->children) {
 		node->size += computeSize(child);
+		node->childTotal += child->total;
 	}
+	node->total = node->weight + node->childTotal;
 	return node->size;
 }
 
-float findMinY(const Node *node) {
+static void growBounds(const Pos &p, Pos &lo, Pos &hi) {
 
-	if (!node)
-		return 0.0f;
-	float minY = node->pos.y;
-	for (const auto *child : node->children) {
-		minY = std::min(minY, findMinY(child));
-	}
-	return minY;
+	lo.x = std::min(lo.x, p.x);
+	lo.y = std::min(lo.y, p.y);
+	lo.z = std::min(lo.z, p.z);
+	hi.x = std::max(hi.x, p.x);
+	hi.y = std::max(hi.y, p.y);
+	hi.z = std::max(hi.z, p.z);
+}
+
+void growBounds(const Node *node, Pos &lo, Pos &hi) {
+
+	growBounds(node->pos, lo, hi);
+	for (const auto *child : node->children)
+		growBounds(child, lo, hi);
 }
 
 void shiftTree(Node *node, float dx, float dy, float dz) {
@@ -141,225 +561,662 @@ void shiftTree(Node *node, float dx, float dy, float dz) {
 	}
 }
 
-void layoutTree(Node *node, bool vertical, bool proportional,
-		float level_height = 5.0f, float base_radius_factor = 0.5f,
-		float bottom_margin = 4.0f) {
-
-	if (!node)
+// Set by layoutTree()
+unsigned layoutVersion = 0;
+Pos overviewCenter = { 0.0f, 0.0f, 0.0f };
+float overviewRadius = 1.0f;
+float overviewBound = 1.0f;
+Pos layoutLo, layoutHi;	// box around the node positions
+
+// Places the children of 'curr' on a circle under it, the first one at
+// 'angle' past where curr itself sits on its parent's circle, and hands
+// each one to next(child, its angle).
+template<typename Next>
+static void placeOnCircle(Node *curr, float angle, bool vertical,
+		bool proportional, float level_height, float base_radius_factor,
+		Next next) {
+
+	if (curr->children.empty())
 		return;
 
-	// Layout assuming root at (0,0,0)
-	node->pos = { 0.0f, 0.0f, 0.0f };
+	int num_children = curr->children.size();
+	float total_sub = proportional ? (curr->size - 1) : num_children;
+	float radius = total_sub * base_radius_factor + 1.0f;
+	float total_weight = proportional ? curr->childTotal : num_children;
+	float cum_angle = angle;
 
-	auto layoutRec = [&](auto &&self, Node *curr, Pos parent_pos,
-			float parent_angle, bool is_root = true) -> void {
-		if (!is_root) {
-			curr->pos = parent_pos;
-		}
-		if (curr->children.empty())
-			return;
-
-		int num_children = curr->children.size();
-		if (num_children == 0)
-			return;
+	Pos base_center = curr->pos;
+	if (vertical) {
+		base_center.y -= level_height;
+	} else {
+		base_center.x += level_height;
+	}
 
-		float total_sub = proportional ? (curr->size - 1) : num_children;
-		float radius = total_sub * base_radius_factor + 1.0f;
-		float cum_angle = parent_angle;
+	for (auto child : curr->children) {
+		float span_weight = proportional ? child->total : 1.0f;
+		float span = 2.0f * M_PI * (span_weight / total_weight);
+		float child_angle = cum_angle + span / 2.0f;
 
-		Pos base_center = parent_pos;
+		Pos child_pos = base_center;
 		if (vertical) {
-			base_center.y -= level_height;
+			child_pos.x += radius * sin(child_angle);
+			child_pos.z += radius * cos(child_angle);
 		} else {
-			base_center.x += level_height;
+			child_pos.y += radius * sin(child_angle);
+			child_pos.z += radius * cos(child_angle);
 		}
 
-		for (auto child : curr->children) {
-			float span_weight = proportional ? child->size : 1.0f;
-			float span = 2.0f * M_PI * (span_weight / total_sub);
-			float child_angle = cum_angle + span / 2.0f;
+		child->pos = child_pos;
+		next(child, child_angle);
+		cum_angle += span;
+	}
+}
+
+// Lays out the subtree below 'curr' around its position. With 'parallel',
+// the children's subtrees are laid out on threads of their own (they share
+// nothing).
+static void placeChildren(Node *curr, float angle, bool vertical,
+		bool proportional, float level_height, float base_radius_factor,
+		bool parallel = false) {
+
+	vector<float> angles;
+	placeOnCircle(curr, angle, vertical, proportional, level_height,
+			base_radius_factor, [&](Node *child, float child_angle) {
+				if (parallel)
+					angles.push_back(child_angle);
+				else
+					placeChildren(child, child_angle, vertical, proportional,
+							level_height, base_radius_factor);
+			});
+	if (parallel)
+		parallelFor(angles.size(), [&](size_t i) {
+			placeChildren(curr->children[i], angles[i], vertical, proportional,
+					level_height, base_radius_factor);
+		});
+}
 
-			Pos child_pos = base_center;
-			if (vertical) {
-				child_pos.x += radius * sin(child_angle);
-				child_pos.z += radius * cos(child_angle);
-			} else {
-				child_pos.y += radius * sin(child_angle);
-				child_pos.z += radius * cos(child_angle);
-			}
+// The angle placeChildren() gave 'child' on the circle of 'parent', read
+// back from their positions. Maps on the forest grid are laid out from 0.
+static float placedAngle(const Node *parent, const Node *child,
+		bool vertical) {
 
-			self(self, child, child_pos, child_angle, false);
-			cum_angle += span;
-		}
-	};
+	if (parent == forestRoot && forestGrid)
+		return 0.0f;
 
-	layoutRec(layoutRec, node, node->pos, 0.0f, true);
+	float across = vertical ?
+			child->pos.x - parent->pos.x : child->pos.y - parent->pos.y;
+	return atan2f(across, child->pos.z - parent->pos.z);
+}
 
-	// Find lowest point and shift whole tree upward
-	if (vertical) {
-		float min_y = findMinY(node);
-		float shift_up = -min_y + bottom_margin;
-		shiftTree(node, 0.0f, shift_up, 0.0f);
+// Subtree bounds for culling and proxies, from the children's. Spinning
+// swings a child's subtree around the child, so bound it by distance plus
+// child extent.
+static void nodeBounds(Node *curr, bool proportional, float level_height,
+		float base_radius_factor) {
+
+	curr->extent = 0.2f; // node sphere
+	curr->cones = 0;
+	if (curr->children.empty())
+		return;
+
+	float total_sub = proportional ? (curr->size - 1) : curr->children.size();
+	float radius = total_sub * base_radius_factor + 1.0f;
+	curr->extent = std::max(curr->extent, hypotf(radius, level_height));
+	curr->cones = 1;
+	for (auto child : curr->children) {
+		float dist = sqrtf(
+				(child->pos.x - curr->pos.x) * (child->pos.x - curr->pos.x)
+						+ (child->pos.y - curr->pos.y)
+								* (child->pos.y - curr->pos.y)
+						+ (child->pos.z - curr->pos.z)
+								* (child->pos.z - curr->pos.z));
+		curr->extent = std::max(curr->extent, dist + child->extent);
+		curr->cones += child->cones;
 	}
 }
 
-void deleteTree(Node *node) {
+static void subtreeBounds(Node *curr, bool proportional, float level_height,
+		float base_radius_factor) {
 
-	if (!node)
+	for (auto child : curr->children)
+		subtreeBounds(child, proportional, level_height, base_radius_factor);
+	nodeBounds(curr, proportional, level_height, base_radius_factor);
+}
+
+// placeChildren(), subtreeBounds() and growBounds() in one pass over the
+// subtree, which on a large tree misses the cache at about every node: the
+// sizes too, on the way back up, except in proportional layout, which
+// needs them on the way down (from computeSize()).
+static void laySubtree(Node *curr, float angle, bool vertical,
+		bool proportional, float level_height, float base_radius_factor,
+		Pos &lo, Pos &hi) {
+
+	placeOnCircle(curr, angle, vertical, proportional, level_height,
+			base_radius_factor, [&](Node *child, float child_angle) {
+				laySubtree(child, child_angle, vertical, proportional,
+						level_height, base_radius_factor, lo, hi);
+			});
+	if (!proportional) {
+		curr->size = 1;
+		curr->childTotal = 0.0f;
+		for (const auto *child : curr->children) {
+			curr->size += child->size;
+			curr->childTotal += child->total;
+		}
+		curr->total = curr->weight + curr->childTotal;
+	}
+	nodeBounds(curr, proportional, level_height, base_radius_factor);
+	growBounds(curr->pos, lo, hi);
+}
+
+// Overview framing: a sphere around the laid-out nodes, and one around
+// that center which also holds every spin (for the clip planes).
+static void frameOverview(const Node *node) {
+
+	const Pos &lo = layoutLo, &hi = layoutHi;
+	Pos c = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f };
+	overviewCenter = c;
+	overviewRadius = 0.5f
+			* sqrtf((hi.x - lo.x) * (hi.x - lo.x) + (hi.y - lo.y) * (hi.y - lo.y)
+					+ (hi.z - lo.z) * (hi.z - lo.z)) + 0.2f;
+	overviewBound = sqrtf(
+			(node->pos.x - c.x) * (node->pos.x - c.x)
+					+ (node->pos.y - c.y) * (node->pos.y - c.y)
+					+ (node->pos.z - c.z) * (node->pos.z - c.z)) + node->extent;
+}
+
+// The maps of a forest, each laid out on a thread of its own. On the grid
+// they are laid out apart and then moved into cells one level below the
+// root, in file order, as many columns as rows: each column as wide and
+// each row as deep as the widest bounds in it (spinning included), so no
+// two maps can meet. The grid lies across the cone axis, on the ground in
+// vertical mode and upright in horizontal mode.
+static void layoutForest(Node *forest, bool vertical, bool proportional,
+		float level_height, float base_radius_factor) {
+
+	vector<Node*> maps(forest->children.rbegin(), forest->children.rend());
+	if (!forestGrid) {
+		placeChildren(forest, 0.0f, vertical, proportional, level_height,
+				base_radius_factor, true);
+		parallelFor(maps.size(), [&](size_t i) {
+			subtreeBounds(maps[i], proportional, level_height,
+					base_radius_factor);
+		});
 		return;
-	for (auto child : node->children) {
-		deleteTree(child);
 	}
-	delete node;
+
+	parallelFor(maps.size(), [&](size_t i) {
+		maps[i]->pos = forest->pos;
+		placeChildren(maps[i], 0.0f, vertical, proportional, level_height,
+				base_radius_factor);
+		subtreeBounds(maps[i], proportional, level_height, base_radius_factor);
+	});
+
+	size_t columns = ceilf(sqrtf(maps.size()));
+	size_t rows = (maps.size() + columns - 1) / columns;
+	vector<float> across(columns, 0.0f), along(rows, 0.0f);
+	for (size_t i = 0; i < maps.size(); ++i) {
+		float cell = 2.0f * maps[i]->extent + level_height;
+		across[i % columns] = std::max(across[i % columns], cell);
+		along[i / columns] = std::max(along[i / columns], cell);
+	}
+	// Cell centers, the grid centered under the root
+	auto centers = [](vector<float> &cells) {
+		float total = 0.0f;
+		for (float cell : cells)
+			total += cell;
+		float edge = -total * 0.5f;
+		for (float &cell : cells) {
+			edge += cell;
+			cell = edge - cell * 0.5f;
+		}
+	};
+	centers(across);
+	centers(along);
+
+	parallelFor(maps.size(), [&](size_t i) {
+		float a = across[i % columns], b = along[i / columns];
+		if (vertical)
+			shiftTree(maps[i], a, -level_height, b);
+		else
+			shiftTree(maps[i], level_height, a, b);
+	});
 }
 
-void drawNodeAt(const Node *node, const Pos &p) {
+void layoutTree(Node *node, bool vertical, bool proportional,
+		float level_height = 5.0f, float base_radius_factor = 0.5f,
+		float bottom_margin = 4.0f) {
+
+	if (!node)
+		return;
 
-	// ----- Draw sphere normally (3D depth tested) -----
-	glPushMatrix();
-	glTranslatef(p.x, p.y, p.z);
+	// Layout assuming root at (0,0,0). A forest's maps have their bounds;
+	// they only move as a whole after.
+	node->pos = { 0.0f, 0.0f, 0.0f };
+	layoutLo = layoutHi = node->pos;
+	if (node == forestRoot) {
+		layoutForest(node, vertical, proportional, level_height,
+				base_radius_factor);
+		nodeBounds(node, proportional, level_height, base_radius_factor);
+		growBounds(node, layoutLo, layoutHi);
+	} else {
+		laySubtree(node, 0.0f, vertical, proportional, level_height,
+				base_radius_factor, layoutLo, layoutHi);
+	}
+	layoutVersion++;
 
-	glColor3f(0.0f, 0.0f, 1.0f);
-	glutSolidSphere(0.2f, 10, 10);
+	// Shift the whole tree up from its lowest point
+	if (vertical) {
+		float shift_up = -layoutLo.y + bottom_margin;
+		shiftTree(node, 0.0f, shift_up, 0.0f);
+		layoutLo.y += shift_up;
+		layoutHi.y += shift_up;
+	}
+	frameOverview(node);
+}
 
-	glPopMatrix();
+// Levels of room left below the tree when a batch of updates raises it
+const int raiseHeadroom = 4;
+
+// Lays out again what edits of the children of path.back() moved, for each
+// path in 'paths' (running from the root down, none ending under another's
+// end): that node's subtree, then the sizes, cone counts and extents of the
+// nodes above. Proportional layout spreads every ancestor's children by
+// subtree size, so it lays out the whole tree; without 'spread', each
+// subtree is laid out in the span its node has, which leaves the
+// ancestors' spans to a later layout of the whole tree. The tree is only
+// raised, once, if a subtree reaches below the bottom margin (without
+// 'spread', with room for a few more levels, so that growing deeper does
+// not shift the whole tree each time), and the overview box only grows.
+// Returns whether the tree wants that later layout.
+bool relayoutSubtrees(const vector<vector<Node*>> &paths, bool vertical,
+		bool proportional, bool spread = true, float level_height = 5.0f,
+		float base_radius_factor = 0.5f, float bottom_margin = 4.0f) {
+
+	if (paths.empty())
+		return false;
+	Node *top = paths.front().front();
+	bool whole = proportional && spread;
+	for (const auto &path : paths)
+		whole = whole || path.size() < 2;
+	if (whole) {
+		computeSize(top);
+		layoutTree(top, vertical, proportional, level_height,
+				base_radius_factor, bottom_margin);
+		return false;
+	}
 
-	// ----- Draw billboarded text ALWAYS visible -----
-	glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT);
+	float min_y = bottom_margin;
+	vector<pair<size_t, Node*>> above;	// ancestors by depth
+	unordered_set<const Node*> seen;
+	for (const auto &path : paths) {
+		Node *node = path.back();
+		if (proportional)
+			computeSize(node);
+		Pos lo = node->pos, hi = node->pos;
+		laySubtree(node, placedAngle(path[path.size() - 2], node, vertical),
+				vertical, proportional, level_height, base_radius_factor, lo,
+				hi);
+		if (vertical)
+			min_y = std::min(min_y, lo.y);
+		growBounds(lo, layoutLo, layoutHi);
+		growBounds(hi, layoutLo, layoutHi);
+		// Each ancestor once, however many paths share it: above one seen
+		// before, all were
+		for (size_t i = path.size() - 1; i-- > 0 && seen.insert(path[i]).second;)
+			above.emplace_back(i, path[i]);
+	}
+	layoutVersion++;
+
+	// Deepest first
+	sort(above.begin(), above.end(), greater<pair<size_t, Node*>>());
+	for (const auto &a : above) {
+		Node *n = a.second;
+		n->size = 1;
+		n->childTotal = 0.0f;
+		for (const auto *child : n->children) {
+			n->size += child->size;
+			n->childTotal += child->total;
+		}
+		n->total = n->weight + n->childTotal;
+		nodeBounds(n, proportional, level_height, base_radius_factor);
+	}
 
-	// Disable depth so text is never hidden
-	glDisable(GL_DEPTH_TEST);
-	glDepthMask(GL_FALSE);
+	bool raised = min_y < bottom_margin;
+	if (raised) {
+		float shift_up = bottom_margin - min_y;
+		if (!spread)
+			shift_up += raiseHeadroom * level_height;
+		shiftTree(top, 0.0f, shift_up, 0.0f);
+		layoutLo.y += shift_up;
+		layoutHi.y += shift_up;
+	}
+	frameOverview(top);
+	return proportional || (raised && !spread);
+}
 
-	glPushMatrix();
-	glTranslatef(p.x, p.y, p.z);
+void relayoutSubtree(const vector<Node*> &path, bool vertical,
+		bool proportional) {
 
-	// Cancel scene rotations (billboard)
-	// display() does: RotateX(rot_x) then RotateY(rot_y)
-	// To undo, apply inverse in reverse order:
-	glRotatef(-rot_y, 0.0f, 1.0f, 0.0f);
-	glRotatef(-rot_x, 1.0f, 0.0f, 0.0f);
+	relayoutSubtrees( { path }, vertical, proportional);
+}
 
-	glColor3f(1.0f, 1.0f, 1.0f);
-	glRasterPos3f(0.35f, 0.0f, 0.0f);
+static void freeTree(Node *node, const unordered_set<const Node*> &spun,
+		unordered_set<const Node*> &freed) {
 
-	for (char c : node->text) {
-		glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
+	for (auto child : node->children) {
+		freeTree(child, spun, freed);
 	}
+	if (!spun.empty() && spun.count(node))
+		freed.insert(node);
+	delete node;
+}
 
-	glPopMatrix();
+// Frees 'node' and its subtree. The spins of its cones go with it: a node
+// allocated later at the same address must not pick them up (see
+// currentConeSpin()).
+void deleteTree(Node *node) {
 
-	// Restore depth settings
-	glDepthMask(GL_TRUE);
-	glPopAttrib();
+	if (!node)
+		return;
+	unordered_set<const Node*> spun, freed;
+	for (const auto &t : coneSpin.touched)
+		spun.insert(t.first);
+	freeTree(node, spun, freed);
+	if (freed.empty())
+		return;
+	auto &touched = coneSpin.touched;
+	touched.erase(remove_if(touched.begin(), touched.end(),
+			[&](const pair<const Node*, int> &t) {
+				return freed.count(t.first) > 0;
+			}), touched.end());
 }
 
+// Cone colors indexed by [selected]
+const float coneFillColor[2][4] = { { 0.15f, 0.55f, 1.00f, 0.40f }, { 0.20f,
+		1.00f, 0.35f, 0.70f } };
+const float coneWireColor[2][4] = { { 0.4f, 0.8f, 1.0f, 0.7f }, { 0.30f, 1.00f,
+		0.45f, 0.95f } };
+
+FrameData frame;
+RenderStats frameStats = { 0, 0 };
+unsigned treeVersion = 1;
+bool oit_on = true;
+
+// Color-by-metric: values computed once after load, colors on each switch
+TreeMetrics metrics;
+int colorMetric = METRIC_NONE;
+vector<float> nodeColors;
+bool stats_on = false;
+bool memReport = false;		// --mem-report: print after the first frame
+MemoryReport memUsage;
+bool overview_on = false;
+bool overviewDrag = false;	// left button went down inside the overview
+bool renaming = false;		// 'e': keys edit renameText until Enter or ESC
+string renameText;
+vector<Node*> movingPath;	// to the node picked up with 'k', moved by 'y'
+EditJournal journal;		// 'z' undoes, 'Z' redoes
+bool metricsStale = false;	// the tree was edited since metrics.compute()
+
+// Adaptive quality. While the user drags or zooms, a frame over budget
+// steps down one quality level (cheaper) and a frame well under it steps
+// back up. Once input stops, timer() refines one level per tick until the
+// frame is back at full quality.
+struct QualityLevel {
+	bool labels;
+	int detail;			// DETAIL_*
+	float proxyPixels;	// subtrees smaller than this on screen are drawn as
+						// their top cone only (0 = never)
+};
 
-void drawCone(const Pos &parent_pos, const Pos &base_center, float radius,
-		float height, bool vertical, bool selected, float spinDeg) {
+const QualityLevel qualityLevels[] = {
+	{ true, DETAIL_FULL, 0.0f },
+	{ false, DETAIL_REDUCED, 2.0f },
+	{ false, DETAIL_COARSE, 8.0f },
+	{ false, DETAIL_COARSE, 24.0f } };
+const int QUALITY_LEVELS = sizeof(qualityLevels) / sizeof(qualityLevels[0]);
+const float frameBudgetMs = 1000.0f / 60.0f;
+const int idleRefineDelayMs = 150;
+
+// Flights take a second at the 20 ms timer. A camera path plays a frame
+// per tick too; the time it took to draw is reported when it ends.
+const int flightFrames = 50;
+string cameraPathFile = "camera.path";
+bool playingPath = false;
+int pathFrames = 0;
+float pathMs = 0.0f, pathWorstMs = 0.0f;
+
+int qualityLevel = 0;
+bool mouseDown = false;
+int lastInputMs = -idleRefineDelayMs;
+float lastFrameMs = 0.0f;
+
+static void noteInput() {
+
+	lastInputMs = clockMs();
+}
 
-	glPushMatrix();
+static bool interacting() {
 
-	// Move to the PARENT (apex/narrow end)
-	glTranslatef(parent_pos.x, parent_pos.y, parent_pos.z);
+	return mouseDown
+			|| (int) clockMs() - lastInputMs < idleRefineDelayMs;
+}
 
-	// Cone shading
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	if (selected) {
-		glColor4f(0.20f, 1.00f, 0.35f, 0.70f);
-	} else {
-		glColor4f(0.15f, 0.55f, 1.00f, 0.40f);
-	}
+// Per-frame visibility parameters for the tree walk.
+struct WalkView {
+	Mat4 view;
+	float projX, projY;	// projection scale on x and y
+	float pixelScale;	// on-screen pixels per unit of size at distance 1
+	float proxyPixels;
+	bool cull;			// off with GPU culling, which tests every cone itself
+	bool slots;			// keep walkNodeSlot and walkSpinDeg
+};
 
-	GLUquadric *quad = gluNewQuadric();
-	gluQuadricDrawStyle(quad, GLU_FILL);
-	gluQuadricNormals(quad, GLU_SMOOTH);
+// Everything besides the camera that the walk's output depends on. With
+// GPU culling the walk does not depend on the camera either, so it only
+// runs when this changes; cones turning on their own only move their
+// subtrees (see moveSpunSubtrees()).
+struct WalkKey {
+	unsigned treeVersion, layoutVersion;
+	bool vertical, proportional, animation;
+	float spinAllDeg;
+	int selected;
+	unsigned marks;
+	int colorMetric;
+
+	bool operator==(const WalkKey &k) const {
+		return treeVersion == k.treeVersion && layoutVersion == k.layoutVersion
+				&& vertical == k.vertical && proportional == k.proportional
+				&& animation == k.animation && spinAllDeg == k.spinAllDeg
+				&& selected == k.selected && marks == k.marks
+				&& colorMetric == k.colorMetric;
+	}
+};
 
-	// Orient so cylinder axis matches the tree axis, then spin about that axis.
-	if (vertical) {
-		glRotatef(90.0f, 1.0f, 0.0f, 0.0f);
-		glRotatef(180.0f, 0.0f, 0.0f, 1.0f);
-		if (spinDeg != 0.0f)
-			glRotatef(spinDeg, 0.0f, 0.0f, 1.0f);
-		gluCylinder(quad, 0.0f, radius, height, 32, 1);
-	} else {
-		glRotatef(90.0f, 0.0f, 1.0f, 0.0f);
-		if (spinDeg != 0.0f)
-			glRotatef(spinDeg, 0.0f, 0.0f, 1.0f);
-		gluCylinder(quad, 0.0f, radius, height, 32, 1);
+WalkKey lastWalk;
+unsigned walkCount = 0;
+
+// What the last whole walk (with GPU culling) drew each cone with: the
+// index of its node in frame.nodes and its angle. Cone i is frame.cones[i -
+// walkConeBase].
+vector<int> walkNodeSlot;
+vector<float> walkSpinDeg;
+int walkConeBase = 0;
+
+static void carrySpin(const Node *n, int &cone,
+		const unordered_map<const Node*, int> &was, const ConeSpin &old) {
+
+	int self = cone++;
+	auto it = was.find(n);
+	if (it != was.end()) {
+		coneSpin.angle[self] = old.angle[it->second];
+		coneSpin.velocity[self] = old.velocity[it->second];
+		coneSpin.flags[self] = old.flags[it->second];
+		coneSpin.touched.push_back( { n, self });
+		if (coneSpin.flags[self] & SPIN_MARKED)
+			coneSpin.marked.push_back(self);
 	}
+	for (auto ch : n->children)
+		if (!ch->children.empty())
+			carrySpin(ch, cone, was, old);
+}
 
-	glPopMatrix();
+// Sizes the spin state to the tree's cones, moving what the cones had to
+// their new indexes when the tree changed.
+static ConeSpin& currentConeSpin() {
+
+	if (coneSpin.treeVersion == treeVersion)
+		return coneSpin;
+	ConeSpin old;
+	std::swap(old, coneSpin);
+	int cones = root ? root->cones : 0;
+	coneSpin.angle.assign(cones, 0.0f);
+	coneSpin.velocity.assign(cones, defaultConeVelocity);
+	coneSpin.flags.assign(cones, 0);
+	if (!old.touched.empty() && cones > 0) {
+		unordered_map<const Node*, int> was;
+		for (const auto &t : old.touched)
+			was[t.first] = t.second;
+		int cone = 0;
+		carrySpin(root, cone, was, old);
+	}
+	coneSpin.treeVersion = treeVersion;
+	coneSpin.markVersion = old.markVersion + 1;
+	return coneSpin;
+}
 
-	gluDeleteQuadric(quad);
-	glDisable(GL_BLEND);
+static void touchCone(int cone) {
 
-	// Wireframe
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glLineWidth(1.2f);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	if (selected)
-		glColor4f(0.30f, 1.00f, 0.45f, 0.95f);
-	else
-		glColor4f(0.4f, 0.8f, 1.0f, 0.7f);
+	if (!(coneSpin.flags[cone] & SPIN_TOUCHED)) {
+		coneSpin.flags[cone] |= SPIN_TOUCHED;
+		coneSpin.touched.push_back( { coneNode(root, cone), cone });
+	}
+}
 
-	GLUquadric *quad_wire = gluNewQuadric();
-	glPushMatrix();
-	glTranslatef(parent_pos.x, parent_pos.y, parent_pos.z);
-	if (vertical) {
-		glRotatef(90.0f, 1.0f, 0.0f, 0.0f);
-		glRotatef(180.0f, 0.0f, 0.0f, 1.0f);
-		if (spinDeg != 0.0f)
-			glRotatef(spinDeg, 0.0f, 0.0f, 1.0f);
-	} else {
-		glRotatef(90.0f, 0.0f, 1.0f, 0.0f);
-		if (spinDeg != 0.0f)
-			glRotatef(spinDeg, 0.0f, 0.0f, 1.0f);
+// Adds the selected cone to the multi-selection or takes it out; with all
+// cones selected, empties the multi-selection.
+static void toggleConeMark() {
+
+	ConeSpin &spin = currentConeSpin();
+	int cone = selectedConeIndex;
+	if (cone < 0) {
+		for (int c : spin.marked)
+			spin.flags[c] &= ~SPIN_MARKED;
+		spin.marked.clear();
+	} else if (cone < (int) spin.flags.size()) {
+		touchCone(cone);
+		spin.flags[cone] ^= SPIN_MARKED;
+		auto at = lower_bound(spin.marked.begin(), spin.marked.end(), cone);
+		if (spin.flags[cone] & SPIN_MARKED)
+			spin.marked.insert(at, cone);
+		else
+			spin.marked.erase(at);
 	}
-	gluCylinder(quad_wire, 0.0, radius, height, 32, 1);
-	glPopMatrix();
-	gluDeleteQuadric(quad_wire);
+	spin.markVersion++;
+}
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glDisable(GL_BLEND);
+// Turns the selected cone and the marked ones by their velocities.
+static void advanceConeSpins() {
+
+	ConeSpin &spin = currentConeSpin();
+	auto advance = [&](int cone) {
+		touchCone(cone);
+		float &a = spin.angle[cone];
+		a += spin.velocity[cone] * animationSpeed;
+		if (a >= 360.0f)
+			a -= 360.0f;
+	};
+	for (int c : spin.marked)
+		advance(c);
+	int cone = selectedConeIndex;
+	if (cone >= 0 && cone < (int) spin.flags.size()
+			&& !(spin.flags[cone] & SPIN_MARKED))
+		advance(cone);
+}
+
+static bool outsideFrustum(const Pos &v, float r, const WalkView &w) {
+
+	// v is in view space; the side planes pass through the eye.
+	if (v.z - r > 0.0f)
+		return true;
+	float nx = sqrtf(w.projX * w.projX + 1.0f);
+	float ny = sqrtf(w.projY * w.projY + 1.0f);
+	return (w.projX * v.x + v.z) / nx > r || (-w.projX * v.x + v.z) / nx > r
+			|| (w.projY * v.y + v.z) / ny > r || (-w.projY * v.y + v.z) / ny > r;
+}
+
+static float coneRadius(const Node *node) {
+
+	return (proportional_layout ? (node->size - 1) : node->children.size())
+			* 0.5f + 1.0f;
 }
 
 void drawTree(const Node *node, bool vertical, int &coneIndex,
-		const Pos &worldPos, float height = 5.0f) {
+		const Pos &worldPos, const WalkView &walk, float height = 5.0f) {
+
+	// Skip subtrees entirely outside the view; keep the draw-order cone
+	// index in step so selection is unaffected.
+	const float *m = walk.view.m;
+	Pos v;
+	v.x = m[0] * worldPos.x + m[4] * worldPos.y + m[8] * worldPos.z + m[12];
+	v.y = m[1] * worldPos.x + m[5] * worldPos.y + m[9] * worldPos.z + m[13];
+	v.z = m[2] * worldPos.x + m[6] * worldPos.y + m[10] * worldPos.z + m[14];
+	if (walk.cull && outsideFrustum(v, node->extent, walk)) {
+		coneIndex += node->cones;
+		return;
+	}
+
+	// The root of a forest on the grid joins nothing that is drawn: only its
+	// maps are, each culled as a whole above when out of view.
+	if (node == forestRoot && forestGrid) {
+		coneIndex++;
+		for (auto child : node->children) {
+			Pos childWorld;
+			childWorld.x = worldPos.x + child->pos.x - node->pos.x;
+			childWorld.y = worldPos.y + child->pos.y - node->pos.y;
+			childWorld.z = worldPos.z + child->pos.z - node->pos.z;
+			drawTree(child, vertical, coneIndex, childWorld, walk, height);
+		}
+		return;
+	}
 
-	// Draw this node at its computed world position (after any parent spinning)
-	drawNodeAt(node, worldPos);
+	// Record this node at its computed world position (after any parent spinning)
+	frame.nodes.push_back( { node, worldPos });
 
 	if (node->children.empty())
 		return;
 
-	float radius = (proportional_layout ? (node->size - 1) : node->children.size())
-			* 0.5f + 1.0f;
+	// A subtree only a few pixels across is drawn as its top cone (a proxy
+	// for everything below it).
+	float dist = -v.z;
+	bool proxy = walk.proxyPixels > 0.0f && dist > node->extent
+			&& node->extent * walk.pixelScale / dist < walk.proxyPixels;
+
+	float radius = coneRadius(node);
 
 	// Determine selection/spin for THIS cone
 	bool allSelected = (selectedConeIndex == -1);
-	bool thisConeSelected = allSelected || (coneIndex == selectedConeIndex);
+	bool thisConeSelected = allSelected || (coneIndex == selectedConeIndex)
+			|| (coneSpin.flags[coneIndex] & SPIN_MARKED);
 
 	float spinDeg = 0.0f;
-	if (animation_on) {
-		if (allSelected) {
-			spinDeg = coneSpinAllDeg;
-		} else if (thisConeSelected) {
-			spinDeg = coneSpinSingleDeg;
-		}
-	}
-
-	Pos base_center = worldPos;
-	if (vertical)
-		base_center.y -= height;
-	else
-		base_center.x += height;
+	if (animation_on)
+		spinDeg = allSelected ? coneSpinAllDeg : coneSpin.angle[coneIndex];
 
-	drawCone(worldPos, base_center, radius, height, vertical, thisConeSelected, spinDeg);
+	if (walk.slots) {
+		walkNodeSlot[coneIndex] = (int) frame.nodes.size() - 1;
+		walkSpinDeg[coneIndex] = spinDeg;
+		walkConeBase = coneIndex - (int) frame.cones.size();
+	}
+	frame.cones.push_back( { worldPos, radius, height, spinDeg, thisConeSelected,
+			node });
 	coneIndex++;
 
+	if (proxy) {
+		coneIndex += node->cones - 1;
+		return;
+	}
+
 	// Rotate the entire subtree placement around this cone's axis so that
 	// spheres and labels move with the spinning cone.
 	for (auto child : node->children) {
@@ -380,74 +1237,694 @@ void drawTree(const Node *node, bool vertical, int &coneIndex,
 		childWorld.y = worldPos.y + rel.y;
 		childWorld.z = worldPos.z + rel.z;
 
-		drawTree(child, vertical, coneIndex, childWorld, height);
+		drawTree(child, vertical, coneIndex, childWorld, walk, height);
 	}
 }
 
-void display() {
+// Keeps the runs in 'r' sorted and merged, with no run inside another.
+static void mergeRanges(vector<InstanceRange> &r) {
+
+	sort(r.begin(), r.end(),
+			[](const InstanceRange &a, const InstanceRange &b) {
+				return a.first < b.first;
+			});
+	size_t kept = 0;
+	for (size_t i = 0; i < r.size(); ++i) {
+		if (kept > 0 && r[i].first <= r[kept - 1].first + r[kept - 1].count) {
+			InstanceRange &last = r[kept - 1];
+			last.count = std::max(last.first + last.count,
+					r[i].first + r[i].count) - last.first;
+		} else {
+			r[kept++] = r[i];
+		}
+	}
+	r.resize(kept);
+}
+
+// The overview's instances are the tree's top levels, as many as fit in
+// overviewNodes, at rest: the cones of the last level stand for their
+// subtrees. They do not depend on the camera or on cone spins, only on
+// what buildOverview() keys them by.
+const size_t overviewNodes = 20000;
+WalkKey lastOverview;
+unsigned overviewCount = 0;
+
+static void addOverviewTree(const Node *node, int depth, int &coneIndex,
+		OverviewData &o) {
+
+	// As in drawTree(), the root of a forest on the grid is not drawn
+	bool drawn = !(node == forestRoot && forestGrid);
+	if (drawn)
+		o.nodes.push_back( { node, node->pos });
+	if (node->children.empty())
+		return;
+	if (drawn) {
+		bool selected = selectedConeIndex == -1
+				|| coneIndex == selectedConeIndex
+				|| (coneSpin.flags[coneIndex] & SPIN_MARKED);
+		o.cones.push_back( { node->pos, coneRadius(node), 5.0f, 0.0f,
+				selected, node });
+	}
+	coneIndex++;
+	if (depth == 0) {
+		coneIndex += node->cones - 1;
+		return;
+	}
+	for (auto child : node->children)
+		addOverviewTree(child, depth - 1, coneIndex, o);
+}
+
+static void buildOverview(OverviewData &o, const WalkKey &key) {
+
+	if (o.version != 0 && key == lastOverview)
+		return;
+
+	// The deepest level down to which the tree fits
+	int depth = 0;
+	size_t total = 1;
+	vector<const Node*> level = { root }, next;
+	for (bool fits = true; fits; ) {
+		next.clear();
+		for (size_t i = 0; i < level.size() && fits; ++i) {
+			next.insert(next.end(), level[i]->children.begin(),
+					level[i]->children.end());
+			fits = total + next.size() <= overviewNodes;
+		}
+		fits = fits && !next.empty();
+		if (fits) {
+			total += next.size();
+			depth++;
+			level.swap(next);
+		}
+	}
+
+	o.cones.clear();
+	o.nodes.clear();
+	int coneIndex = 0;
+	addOverviewTree(root, depth, coneIndex, o);
+	o.version = ++overviewCount;
+	lastOverview = key;
+}
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glLoadIdentity();
+// Turns cone 'cone' in the frame from the angle the walk drew it at to its
+// own: each child moves to where the turn takes it, and the child's whole
+// subtree (a pre-order run of frame.nodes and frame.cones, node->size and
+// node->cones long) with it. False if the frame does not hold the cone's
+// subtree where the walk left it. Cones the walk drew nothing for (the
+// root of a forest on the grid) have nothing to move.
+static bool moveSpunSubtree(int cone) {
+
+	float deg = coneSpin.angle[cone];
+	if (deg == walkSpinDeg[cone] || walkNodeSlot[cone] < 0)
+		return true;
+	size_t slot = walkNodeSlot[cone];
+	size_t coneSlot = cone - walkConeBase;
+	if (slot >= frame.nodes.size() || coneSlot >= frame.cones.size())
+		return false;
+	const Node *n = frame.nodes[slot].node;
+	if (frame.cones[coneSlot].node != n
+			|| slot + n->size > frame.nodes.size()
+			|| coneSlot + n->cones > frame.cones.size())
+		return false;
+
+	size_t childSlot = slot + 1, childCone = coneSlot + 1;
+	for (auto ch : n->children) {
+		if (frame.nodes[childSlot].node != ch)
+			return false;
+		Pos rel;
+		rel.x = ch->pos.x - n->pos.x;
+		rel.y = ch->pos.y - n->pos.y;
+		rel.z = ch->pos.z - n->pos.z;
+		Pos from = rotateOffsetAroundConeAxis(rel, walkSpinDeg[cone],
+				vertical_mode);
+		Pos to = rotateOffsetAroundConeAxis(rel, deg, vertical_mode);
+		float dx = to.x - from.x, dy = to.y - from.y, dz = to.z - from.z;
+		for (size_t i = childSlot; i < childSlot + ch->size; ++i) {
+			Pos &p = frame.nodes[i].pos;
+			p.x += dx;
+			p.y += dy;
+			p.z += dz;
+		}
+		for (size_t i = childCone; i < childCone + ch->cones; ++i) {
+			Pos &p = frame.cones[i].apex;
+			p.x += dx;
+			p.y += dy;
+			p.z += dz;
+		}
+		childSlot += ch->size;
+		childCone += ch->cones;
+	}
+	frame.cones[coneSlot].spinDeg = deg;
+	walkSpinDeg[cone] = deg;
+	frame.movedNodes.push_back( { slot + 1, (size_t) n->size - 1 });
+	frame.movedCones.push_back( { coneSlot, (size_t) n->cones });
+	return true;
+}
 
-	glTranslatef(panX, panY, -zoom);
+// With the walk kept (GPU culling), a tick that only turned cones moves
+// their subtrees in place: the cost follows the size of the spinning
+// subtrees, not of the tree. False if it takes a whole walk.
+static bool moveSpunSubtrees() {
+
+	frame.movedNodes.clear();
+	frame.movedCones.clear();
+	if (!animation_on || selectedConeIndex < 0)
+		return true;
+	for (int c : coneSpin.marked)
+		if (!moveSpunSubtree(c))
+			return false;
+	if (selectedConeIndex < (int) coneSpin.flags.size()
+			&& !moveSpunSubtree(selectedConeIndex))
+		return false;
+	if (frame.movedCones.empty())
+		return true;
+	mergeRanges(frame.movedNodes);
+	mergeRanges(frame.movedCones);
+	frame.movedFrom = frame.instanceVersion;
+	frame.instanceVersion = ++walkCount;
+	return true;
+}
+
+// Metrics are only needed by the stats panel and color-by-metric, so edits
+// leave them stale until one of those asks.
+static void updateMetrics() {
+
+	if (!metricsStale)
+		return;
+	metrics.compute(root);
+	if (colorMetric >= metrics.count())
+		colorMetric = METRIC_NONE;
+	metrics.colorize(colorMetric, nodeColors);
+	metricsStale = false;
+}
+
+void display() {
 
-	glTranslatef(0.0f, 0.0f, -zoom);
-	glRotatef(rot_x, 1.0f, 0.0f, 0.0f);
-	glRotatef(rot_y, 0.0f, 1.0f, 0.0f);
+	auto start = chrono::steady_clock::now();
+	int quality = qualityLevel;
 
+	frameStats = { 0, 0 };
 	if (root) {
-		int coneIndex = 0;
-		drawTree(root, vertical_mode, coneIndex, root->pos);
-		totalCones = coneIndex;
+		const QualityLevel &level = qualityLevels[qualityLevel];
+		if (stats_on || colorMetric != METRIC_NONE)
+			updateMetrics();
+		frame.treeVersion = treeVersion;
+		frame.vertical = vertical_mode;
+		frame.oit = oit_on && renderer->oitAvailable();
+		frame.labels = level.labels;
+		frame.detail = level.detail;
+		frame.nodeColors =
+				colorMetric != METRIC_NONE ? nodeColors.data() : nullptr;
+
+		// Statistics of the selected cone's subtree, or of the whole tree
+		frame.panel.clear();
+		if (stats_on) {
+			const Node *n = coneNode(root, selectedConeIndex);
+			metrics.report(n ? n : root, frame.panel);
+		}
+		if (renaming)
+			frame.panel.insert(frame.panel.begin(),
+					"Rename: " + renameText + "_");
+		if (scanning)
+			frame.panel.insert(frame.panel.begin(),
+					"Scanning: " + to_string(fsWalker.directories())
+							+ " directories, " + to_string(fsWalker.files())
+							+ " files");
+		frame.view = camera.view();
+		frame.width = windowWidth;
+		frame.height = windowHeight;
+
+		// Overview in the top right corner, a quarter of the window across
+		OverviewData &o = frame.overview;
+		o.enabled = overview_on;
+		o.size = std::max(std::min(windowWidth, windowHeight) / 4, 16);
+		o.x = windowWidth - o.size - 10;
+		o.y = windowHeight - o.size - 10;
+		o.center = overviewCenter;
+		o.radius = overviewRadius;
+		o.bound = overviewBound;
+
+		Mat4 proj = frameProjectionMatrix(frame);
+		WalkView walk;
+		walk.view = frameViewMatrix(frame);
+		walk.projX = proj.m[0];
+		walk.projY = proj.m[5];
+		walk.pixelScale = proj.m[5] * windowHeight * 0.5f;
+		walk.proxyPixels = level.proxyPixels;
+		walk.cull = true;
+
+		bool gpuCulling = renderer->gpuCulling();
+		const ConeSpin &spin = currentConeSpin();
+		WalkKey key = { treeVersion, layoutVersion, vertical_mode,
+				proportional_layout, animation_on, coneSpinAllDeg,
+				selectedConeIndex, spin.markVersion, colorMetric };
+		if (overview_on) {
+			WalkKey atRest = key;
+			atRest.animation = false;
+			atRest.spinAllDeg = 0.0f;
+			buildOverview(o, atRest);
+		}
+		walk.slots = gpuCulling;
+		if (gpuCulling) {
+			walk.cull = false;
+			walk.proxyPixels = 0.0f;
+		}
+		bool kept = gpuCulling && walkCount > 0 && key == lastWalk;
+		if (kept && !moveSpunSubtrees())
+			kept = false;
+		if (!kept) {
+			frame.cones.clear();
+			frame.nodes.clear();
+			frame.movedNodes.clear();
+			frame.movedCones.clear();
+			if (walk.slots) {
+				walkNodeSlot.assign(spin.flags.size(), -1);
+				walkSpinDeg.assign(spin.flags.size(), 0.0f);
+			}
+			int coneIndex = 0;
+			drawTree(root, vertical_mode, coneIndex, root->pos, walk);
+			totalCones = coneIndex;
+			frame.instanceVersion = ++walkCount;
+			lastWalk = key;
+		}
+
+		renderer->draw(frame, frameStats);
 	}
 
-	glutSwapBuffers();
+	if (!headless)
+		glutSwapBuffers();
+
+	if (memReport) {
+		memUsage.addTree(root);
+		memUsage.add("node metrics", metrics.memoryBytes());
+		memUsage.add("metric colors", vectorBytes(nodeColors));
+		memUsage.add("edit journal", journal.memoryBytes());
+		memUsage.add("frame instances",
+				vectorBytes(frame.cones) + vectorBytes(frame.nodes));
+		renderer->memoryUsage(memUsage);
+		memUsage.print(cout, root ? root->size : 0);
+		deleteTree(root);
+		renderer->release();
+		delete renderer;
+		exit(0);
+	}
+
+	lastFrameMs = chrono::duration<float, milli>(
+			chrono::steady_clock::now() - start).count();
+	if (playingPath) {
+		pathFrames++;
+		pathMs += lastFrameMs;
+		pathWorstMs = std::max(pathWorstMs, lastFrameMs);
+	}
+	inputLog.add(InputEvent::FRAME, clockMs(), quality, frame.cones.size(),
+			frame.nodes.size(), (int) (lastFrameMs * 1000.0f));
+	if (interacting()) {
+		if (lastFrameMs > frameBudgetMs && qualityLevel < QUALITY_LEVELS - 1)
+			qualityLevel++;
+		else if (lastFrameMs < frameBudgetMs / 3.0f && qualityLevel > 0)
+			qualityLevel--;
+	}
 }
 
 void reshape(int w, int h) {
 
-	glViewport(0, 0, w, h);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(45.0, (float) w / h, 0.1, 1000.0); // Near and far clipping planes
-	glMatrixMode(GL_MODELVIEW);
+	inputLog.add(InputEvent::RESHAPE, clockMs(), 0, 0, w, h);
+	windowWidth = w;
+	windowHeight = h;
+	renderer->resize(w, h);
+}
+
+// Re-aims the main camera at the point under window pixel (x, y) of the
+// overview, if it is inside it. The overview looks at the tree center with
+// the main rotation, so the point is taken on the plane through the center
+// facing the viewer, and becomes the camera's target.
+static bool aimFromOverview(int x, int y) {
+
+	const OverviewData &o = frame.overview;
+	int gy = windowHeight - 1 - y;
+	if (!o.enabled || x < o.x || x >= o.x + o.size || gy < o.y
+			|| gy >= o.y + o.size)
+		return false;
+
+	Mat4 view = overviewViewMatrix(frame);
+	Mat4 proj = overviewProjectionMatrix(frame);
+	float ndcX = (x - o.x + 0.5f) / o.size * 2.0f - 1.0f;
+	float ndcY = (gy - o.y + 0.5f) / o.size * 2.0f - 1.0f;
+	float dist = -(view.m[2] * o.center.x + view.m[6] * o.center.y
+			+ view.m[10] * o.center.z + view.m[14]);
+
+	// The offset across the view, back in world space
+	float dx = ndcX * dist / proj.m[0], dy = ndcY * dist / proj.m[5];
+	const float *m = view.m;
+	Pos &t = camera.pose.target;
+	t.x = o.center.x + m[0] * dx + m[1] * dy;
+	t.y = o.center.y + m[4] * dx + m[5] * dy;
+	t.z = o.center.z + m[8] * dx + m[9] * dy;
+	camera.stop();
+	redisplay();
+	return true;
 }
 
 void mouse(int btn, int state, int x, int y) {
 
+	inputLog.add(InputEvent::MOUSE, clockMs(), btn, state, x, y);
+	noteInput();
 	if (state == GLUT_DOWN) {
-		button = btn;
+		// Taking the mouse ends a flight or path.
+		camera.stop();
+		playingPath = false;
+		overviewDrag = (btn == GLUT_LEFT_BUTTON && aimFromOverview(x, y));
+		button = overviewDrag ? -1 : btn;
+		mouseDown = (btn == GLUT_LEFT_BUTTON || btn == GLUT_RIGHT_BUTTON);
 		last_mouse_x = x;
 		last_mouse_y = y;
 	} else if (state == GLUT_UP) {
+		mouseDown = false;
+		overviewDrag = false;
 		if (btn == 3)
-			zoom = std::max(5.0f, zoom - 1.5f);
+			camera.dolly(-3.0f);
 		else if (btn == 4)
-			zoom += 1.5f;
-		glutPostRedisplay();
+			camera.dolly(3.0f);
+		redisplay();
 	}
 }
 
 void motion(int mx, int my) {
 
+	inputLog.add(InputEvent::MOTION, clockMs(), 0, 0, mx, my);
+	noteInput();
+	if (overviewDrag) {
+		aimFromOverview(mx, my);
+		return;
+	}
+
 	int dx = mx - last_mouse_x;
 	int dy = my - last_mouse_y;
 
-	if (button == GLUT_LEFT_BUTTON) {
-		rot_y += dx * 0.4f;
-		rot_x += dy * 0.4f;
-	} else if (button == GLUT_RIGHT_BUTTON) {
-		panX += dx * 0.018f;
-		panY -= dy * 0.018f;
-	}
+	if (button == GLUT_LEFT_BUTTON)
+		camera.orbit(dy * 0.4f, dx * 0.4f);
+	else if (button == GLUT_RIGHT_BUTTON)
+		camera.pan(dx * 0.018f, -dy * 0.018f);
 
 	last_mouse_x = mx;
 	last_mouse_y = my;
-	glutPostRedisplay();
+	redisplay();
+}
+
+// Draw-order cone index of path.back(), 'path' running down from the root,
+// or -1 if it has no cone. O(depth x fan-out) through the cone counts.
+static int conePathIndex(const vector<Node*> &path) {
+
+	if (path.empty() || path.front() != root || path.back()->children.empty())
+		return -1;
+	int cone = 0;
+	for (size_t i = 0; i + 1 < path.size(); ++i) {
+		cone++;
+		for (auto ch : path[i]->children) {
+			if (ch == path[i + 1])
+				break;
+			cone += ch->cones;
+		}
+	}
+	return cone;
+}
+
+// After the children of path.back() changed: lays out again under it.
+static void childrenChanged(const vector<Node*> &path) {
+
+	relayoutSubtree(path, vertical_mode, proportional_layout);
+	metricsStale = true;
+	totalCones = 0;
+	treeVersion++;
+}
+
+// Re-reads the map from disk, keeping the camera and modes.
+void reloadMap() {
+
+	MapEnvelope envelope;
+	Node *fresh;
+	if (fsMode) {
+		// Scan again from the start
+		fresh = fsWalker.start(mapFilename);
+		scanning = fresh != nullptr;
+	} else if (!forestFiles.empty()) {
+		fresh = loadForest(&envelope);
+	} else {
+		fresh = loadMap(mapFilename, &envelope, nullptr, &mapFormat);
+	}
+	if (!fresh)
+		return;
+	journal.clear();
+	deleteTree(root);
+	root = fresh;
+	streamed.reset(root);
+	mapEnvelope = envelope;
+	movingPath.clear();
+	computeSize(root);
+	metricsStale = true;
+	updateMetrics();
+	layoutTree(root, vertical_mode, proportional_layout);
+	if (selectedConeIndex >= countCones(root))
+		selectedConeIndex = -1;
+	totalCones = 0;
+	treeVersion++;
+}
+
+// Edits apply to the node of the selected cone, or to the root while all
+// cones are selected; 'path' gets the nodes from the root down to it.
+static Node* selectedNode(vector<Node*> &path) {
+
+	path.clear();
+	conePath(root, selectedConeIndex, path);
+	if (path.empty())
+		path.push_back(root);
+	return path.back();
+}
+
+// Each cone's neighbours in the tree, by draw-order index (-1 for none):
+// the cone of its node's parent, of its first child with children, and of
+// the siblings before and after it that have children. Rebuilt in one walk
+// when the tree changes, so that moving the selection is a lookup.
+struct ConeLinks {
+	vector<int> parent, firstChild, prevSibling, nextSibling;
+	unsigned treeVersion = 0;
+} coneLinks;
+
+static void linkCones(const Node *n, int parent, int &cone) {
+
+	int self = cone++;
+	coneLinks.parent[self] = parent;
+	int prev = -1;
+	for (auto ch : n->children) {
+		if (ch->children.empty())
+			continue;
+		int child = cone;
+		linkCones(ch, self, cone);
+		if (prev < 0)
+			coneLinks.firstChild[self] = child;
+		else
+			coneLinks.nextSibling[prev] = child;
+		coneLinks.prevSibling[child] = prev;
+		prev = child;
+	}
+}
+
+static const ConeLinks& currentConeLinks() {
+
+	if (coneLinks.treeVersion != treeVersion) {
+		int cones = root ? root->cones : 0;
+		coneLinks.parent.assign(cones, -1);
+		coneLinks.firstChild.assign(cones, -1);
+		coneLinks.prevSibling.assign(cones, -1);
+		coneLinks.nextSibling.assign(cones, -1);
+		int cone = 0;
+		if (cones > 0)
+			linkCones(root, -1, cone);
+		coneLinks.treeVersion = treeVersion;
+	}
+	return coneLinks;
+}
+
+// Keys while renaming: text, Backspace, Enter to apply, ESC to cancel.
+static void renameKey(unsigned char key) {
+
+	switch (key) {
+	case '\r':
+	case '\n': {
+		vector<Node*> path;
+		journal.rename(selectedNode(path), renameText);
+		renaming = false;
+		treeVersion++;
+		break;
+	}
+	case 27:
+		renaming = false;
+		break;
+	case 8:
+	case 127:
+		// Drop a whole UTF-8 sequence
+		while (!renameText.empty() && (renameText.back() & 0xC0) == 0x80)
+			renameText.pop_back();
+		if (!renameText.empty())
+			renameText.pop_back();
+		break;
+	default:
+		if (key >= 32)
+			renameText += (char) key;
+	}
+}
+
+static void editKey(unsigned char key) {
+
+	// Directory listings are still being linked into the tree
+	if (scanning) {
+		cout << "Editing waits for the scan to finish" << endl;
+		return;
+	}
+	// Updates name nodes the keys could delete or move
+	if (streaming && key != 'w') {
+		cout << "The tree is being updated through " << updateSource
+				<< "; only saving is possible" << endl;
+		return;
+	}
+	vector<Node*> path;
+	Node *selected = selectedNode(path);
+	bool all = selectedConeIndex < 0;
+	switch (key) {
+	case 'e':
+		renameText = selected->label();
+		renaming = true;
+		break;
+	case 'n': {
+		// Last in file order: children are kept last-to-first
+		Node *child = new Node();
+		child->text = "New node";
+		journal.insert(path, child, 0);
+		childrenChanged(path);
+		selectedConeIndex = all ? -1 : conePathIndex(path);
+		break;
+	}
+	case 'x': {
+		if (selected == root) {
+			cout << "The root cannot be deleted" << endl;
+			break;
+		}
+		if (find(movingPath.begin(), movingPath.end(), selected)
+				!= movingPath.end())
+			movingPath.clear();
+		path.pop_back();
+		journal.remove(path, selected);
+		childrenChanged(path);
+		selectedConeIndex = conePathIndex(path);
+		break;
+	}
+	case 'k':
+		if (selected == root) {
+			cout << "The root cannot be moved" << endl;
+			break;
+		}
+		movingPath = path;
+		cout << "Moving \"" << selected->label()
+				<< "\": select the new parent and press y" << endl;
+		break;
+	case 'y': {
+		if (movingPath.empty())
+			break;
+		Node *moving = movingPath.back();
+		if (find(path.begin(), path.end(), moving) != path.end()) {
+			cout << "Cannot move a node into its own subtree" << endl;
+			break;
+		}
+		movingPath.pop_back();
+		journal.move(movingPath, moving, path, 0);
+		childrenChanged(movingPath);
+		childrenChanged(path);
+		movingPath.clear();
+		selectedConeIndex = all ? -1 : conePathIndex(path);
+		break;
+	}
+	case 'z':
+	case 'Z': {
+		const Edit *edit = key == 'z' ? journal.undo() : journal.redo();
+		if (!edit) {
+			cout << "Nothing to " << (key == 'z' ? "undo" : "redo") << endl;
+			break;
+		}
+		movingPath.clear();
+		if (edit->kind == Edit::RENAME) {
+			treeVersion++;
+			break;
+		}
+		// Lay out again under both parents, and follow the selection if
+		// the relinked node was on its path
+		const vector<Node*> &to = key == 'z' ? edit->from : edit->to;
+		if (!edit->from.empty())
+			childrenChanged(edit->from);
+		if (!edit->to.empty())
+			childrenChanged(edit->to);
+		auto moved = find(path.begin(), path.end(), edit->node);
+		if (moved != path.end()) {
+			vector<Node*> followed(to);
+			followed.insert(followed.end(), moved, path.end());
+			path.swap(followed);
+		}
+		selectedConeIndex = all ? -1 : conePathIndex(path);
+		break;
+	}
+	case 'w': {
+		// Imported maps are saved next to their source, as FreeMind, and
+		// compressed ones uncompressed
+		string target = withoutCompressionExtension(mapFilename);
+		if (fsMode) {
+			// A scan is saved in the current directory, named after its root
+			while (target.size() > 1 && target.back() == '/')
+				target.pop_back();
+			target = target.substr(target.find_last_of('/') + 1) + ".mm";
+		} else if (mapFormat != FORMAT_FREEMIND) {
+			size_t dot = target.find_last_of('.');
+			if (dot != string::npos && target.find('/', dot) == string::npos)
+				target.erase(dot);
+			target += ".mm";
+		} else if (mapEnvelope.partial) {
+			// Overwriting the map (or its uncompressed twin) would drop
+			// everything but labels and attributes
+			cout << "Not saving " << target << ": " << mapFilename
+					<< " was read without its source (compressed or piped),"
+					<< " so icons, notes, IDs and styles would be lost;"
+					<< " load the uncompressed .mm to save it" << endl;
+			break;
+		}
+		if (saveMM(root, mapEnvelope, target))
+			cout << "Saved " << target << endl;
+		else
+			cout << "Failed to save " << target << endl;
+		break;
+	}
+	}
+}
+
+// Plays cameraPathFile from its start.
+static bool playCameraPath() {
+
+	if (!camera.play(cameraPathFile)) {
+		cout << "Cannot read the camera path " << cameraPathFile << endl;
+		return false;
+	}
+	playingPath = true;
+	pathFrames = 0;
+	pathMs = pathWorstMs = 0.0f;
+	return true;
 }
 
 void keyboard(unsigned char key, int x, int y) {
 
+	inputLog.add(InputEvent::KEY, clockMs(), key, 0, x, y);
+	if (renaming) {
+		renameKey(key);
+		redisplay();
+		return;
+	}
+
 	switch (key) {
 	case 'c':
 	case 'C': {
@@ -498,8 +1975,25 @@ void keyboard(unsigned char key, int x, int y) {
 		// Speed up animation
 		animationSpeed = std::min(10.0f, animationSpeed * 1.25f);
 		break;
+	case ' ':
+		toggleConeMark();
+		break;
+	case '{':
+	case '}':
+		// Slow down or speed up the selected cone alone
+		if (selectedConeIndex >= 0
+				&& selectedConeIndex < (int) currentConeSpin().flags.size()) {
+			touchCone(selectedConeIndex);
+			float &v = coneSpin.velocity[selectedConeIndex];
+			v = key == '{' ? std::max(0.4f, v * 0.8f) : std::min(40.0f,
+					v * 1.25f);
+		}
+		break;
 	case 'f':
 	case 'F':
+		// A replay has the window sizes recorded
+		if (replaying)
+			break;
 		if (!fullScreen) {
 			glutFullScreen();
 			fullScreen = true;
@@ -509,73 +2003,694 @@ void keyboard(unsigned char key, int x, int y) {
 			fullScreen = false;
 		}
 		break;
+	case 'o':
+	case 'O':
+		oit_on = !oit_on;
+		break;
+	case 'm':
+	case 'M':
+		overview_on = !overview_on;
+		break;
+	case 's':
+	case 'S':
+		stats_on = !stats_on;
+		break;
+	case 'g':
+	case 'G':
+		// Cycle the color metric: none -> depth -> ... -> attributes -> none
+		updateMetrics();
+		colorMetric = (colorMetric + 1) % metrics.count();
+		metrics.colorize(colorMetric, nodeColors);
+		cout << "Coloring by " << metrics.name(colorMetric) << endl;
+		break;
+	case 'r':
+	case 'R':
+		reloadMap();
+		break;
+	case 'e':
+	case 'n':
+	case 'x':
+	case 'k':
+	case 'y':
+	case 'w':
+	case 'z':
+	case 'Z':
+	case 'E':
+	case 'N':
+	case 'X':
+	case 'K':
+	case 'Y':
+	case 'W':
+		editKey(key == 'Z' ? key : tolower(key));
+		break;
+	case 't':
+	case 'T': {
+		// Fly to the selected subtree (its extent holds it under any spin),
+		// or to the whole tree
+		float aspect = (float) windowWidth / windowHeight;
+		vector<Node*> path;
+		if (key == 't') {
+			const Node *n = selectedNode(path);
+			camera.flyTo(camera.fit(n->pos, n->extent, aspect), flightFrames);
+		} else {
+			camera.flyTo(camera.fit(layoutLo, layoutHi, aspect), flightFrames);
+		}
+		playingPath = false;
+		break;
+	}
+	case 'l':
+		// Record the camera path, for 'L' and --camera-path
+		if (!camera.recording()) {
+			camera.startRecording();
+			cout << "Recording the camera path" << endl;
+		} else if (camera.stopRecording(cameraPathFile)) {
+			cout << "Saved the camera path to " << cameraPathFile << endl;
+		} else {
+			cout << "Failed to save " << cameraPathFile << endl;
+		}
+		break;
+	case 'L':
+		playCameraPath();
+		break;
+	case 'i':
+	case 'I':
+		// Report draw calls / state changes of the last frame
+		cout << "Frame (" << renderer->name() << "): " << frame.nodes.size()
+				<< " nodes, " << frame.cones.size() << " cones, "
+				<< frameStats.drawCalls << " draw calls, "
+				<< frameStats.stateChanges << " state changes, " << lastFrameMs
+				<< " ms at quality level " << qualityLevel << endl;
+		break;
 	case 27: // ESC
+		inputLog.close();
+		fsWalker.stop();
+		updates.close();
+		streamed.reset(nullptr);
+		journal.clear();
 		deleteTree(root);
-		gluDeleteQuadric(quad);
+		renderer->release();
+		delete renderer;
 		exit(0);
 	}
-	glutPostRedisplay();
+	redisplay();
+}
+
+// Arrow keys move the selection through the tree: Up to the parent's cone,
+// Down to the first child's, Left and Right between siblings', Home to the
+// root's. With all cones selected any of them selects the root's.
+void special(int key, int x, int y) {
+
+	inputLog.add(InputEvent::SPECIAL, clockMs(), key, 0, x, y);
+	if (renaming)
+		return;
+	const ConeLinks &links = currentConeLinks();
+	int cones = (int) links.parent.size();
+	if (cones == 0)
+		return;
+	int cone = selectedConeIndex;
+	if (cone < 0 || cone >= cones || key == GLUT_KEY_HOME) {
+		cone = 0;
+	} else {
+		const vector<int> *move = nullptr;
+		switch (key) {
+		case GLUT_KEY_UP:
+			move = &links.parent;
+			break;
+		case GLUT_KEY_DOWN:
+			move = &links.firstChild;
+			break;
+		case GLUT_KEY_LEFT:
+			move = &links.prevSibling;
+			break;
+		case GLUT_KEY_RIGHT:
+			move = &links.nextSibling;
+			break;
+		default:
+			return;
+		}
+		if ((*move)[cone] >= 0)
+			cone = (*move)[cone];
+	}
+	if (cone != selectedConeIndex) {
+		// Each cone keeps its own angle: the last one stops where it is and
+		// this one turns on from where it stands
+		selectedConeIndex = cone;
+		redisplay();
+	}
+}
+
+static void reportScan() {
+
+	cout << "Scanned " << fsWalker.directories() << " directories, "
+			<< fsWalker.files() << " files";
+	if (fsWalker.errors())
+		cout << " (" << fsWalker.errors() << " unreadable)";
+	cout << endl;
+}
+
+// Links what the --fs scan read into the tree and lays it out again, at
+// most every few times as long as the last layout took, so a huge scan
+// keeps most of the time for drawing.
+static void pollScan() {
+
+	static chrono::steady_clock::time_point nextLayout;
+	if (!scanning)
+		return;
+	bool finished = fsWalker.done();
+	auto now = chrono::steady_clock::now();
+	if (!finished && now < nextLayout)
+		return;
+
+	if (fsWalker.drain() || finished) {
+		vector<Node*> selected;
+		conePath(root, selectedConeIndex, selected);
+		computeSize(root);
+		metricsStale = true;
+		layoutTree(root, vertical_mode, proportional_layout);
+		if (selectedConeIndex >= 0)
+			selectedConeIndex = conePathIndex(selected);
+		totalCones = 0;
+		treeVersion++;
+		redisplay();
+	}
+	auto after = chrono::steady_clock::now();
+	nextLayout = after + max(chrono::steady_clock::duration(
+			chrono::milliseconds(250)), (after - now) * 4);
+	if (finished) {
+		fsWalker.stop();
+		scanning = false;
+		reportScan();
+	}
+}
+
+// The cone of path.back(), or of its parent if it is a leaf
+static int coneAbove(vector<Node*> &path) {
+
+	while (path.size() > 1 && path.back()->children.empty())
+		path.pop_back();
+	return conePathIndex(path);
+}
+
+// Updates applied per batch: as many as take half a frame by the recent
+// cost of one, so there is time left to draw one between batches.
+// Proportional layout is not spread over the ancestors per batch (a whole
+// layout each time), nor is a tree raised by a batch lowered again; the
+// tree is laid out whole once the updates pause.
+size_t updateBatch = 1024;
+bool layoutUnsettled = false;
+float updateMs = 0.0f;
+const size_t minUpdateBatch = 64;
+const size_t maxUpdateBatch = 1 << 15;
+
+// Applies the updates read since the last batch: the tree changes first,
+// then one layout under each parent they touched (or of the whole tree, if
+// their paths hold more nodes than it), then selection and camera. Returns
+// how many there were.
+static size_t pollUpdates() {
+
+	static vector<Update> batch;
+	static vector<vector<Node*>> dirty;
+	if (!updates.take(batch, updateBatch)) {
+		if (layoutUnsettled) {
+			layoutUnsettled = false;
+			layoutTree(root, vertical_mode, proportional_layout);
+			redisplay();
+		}
+		if (updates.ended()) {
+			updates.close();
+			streaming = false;
+			cout << "End of updates" << endl;
+		}
+		return 0;
+	}
+
+	vector<Node*> selected;
+	conePath(root, selectedConeIndex, selected);
+	const Update *select = nullptr;
+	bool changed = false;
+	string error;
+	for (const Update &u : batch) {
+		switch (u.op) {
+		case Update::SELECT:
+			select = &u;
+			break;
+		case Update::CAMERA: {
+			// Without a pan the world origin stays where it is in the view.
+			Mat4 view = camera.view();
+			bool panned = u.valueCount == 5;
+			camera.stop();
+			camera.setEuler(u.values[0], u.values[1],
+					std::max(5.0f, u.values[2]),
+					panned ? u.values[3] : view.m[12],
+					panned ? u.values[4] : view.m[13]);
+			break;
+		}
+		case Update::INVALID:
+			cerr << "Not an update: " << u.text << endl;
+			break;
+		default:
+			if (streamed.apply(u, error))
+				changed = true;
+			else
+				cerr << error << endl;
+		}
+	}
+
+	if (changed) {
+		if (streamed.takeDirty(dirty, root->size)) {
+			bool unsettled = relayoutSubtrees(dirty, vertical_mode,
+					proportional_layout, false);
+			layoutUnsettled = layoutUnsettled || unsettled;
+		} else {
+			computeSize(root);
+			layoutTree(root, vertical_mode, proportional_layout);
+			layoutUnsettled = false;
+		}
+		metricsStale = true;
+		totalCones = 0;
+		treeVersion++;
+
+		// Keep the selected cone, or what is left of its path
+		auto gone = find_if(selected.begin(), selected.end(),
+				[](const Node *n) {
+					return streamed.removed(n);
+				});
+		selected.erase(gone, selected.end());
+		if (selectedConeIndex >= 0)
+			selectedConeIndex = coneAbove(selected);
+		streamed.collect();
+	}
+
+	if (select) {
+		if (!select->id.empty() && streamed.path(select->id, selected))
+			selectedConeIndex = coneAbove(selected);
+		else if (select->id.empty())
+			selectedConeIndex = -1;
+		else
+			cerr << "No node " << select->id << endl;
+	}
+	redisplay();
+	return batch.size();
+}
+
+// Polls the updates between frames, at once again while a sender is ahead
+// of the viewer, sizing the batches to the time they took.
+void updateTimer(int value) {
+
+	if (!streaming)
+		return;
+	auto start = chrono::steady_clock::now();
+	size_t applied = pollUpdates();
+	bool behind = applied == updateBatch;
+	if (applied > 0) {
+		// A moving average, so the odd full layout does not starve the rest
+		float ms = chrono::duration<float, milli>(
+				chrono::steady_clock::now() - start).count();
+		updateMs += (ms / applied - updateMs) * 0.25f;
+		updateBatch = std::max(minUpdateBatch, std::min(maxUpdateBatch,
+				(size_t) (frameBudgetMs / 2.0f / std::max(updateMs, 1e-6f))));
+	}
+	glutTimerFunc(behind ? 0 : 10, updateTimer, 0);
 }
 
 void timer(int value) {
 
+	inputLog.add(InputEvent::TICK, clockMs());
+	pollScan();
+
+	if (camera.step()) {
+		redisplay();
+	} else if (playingPath) {
+		playingPath = false;
+		cout << "Camera path: " << pathFrames << " frames, "
+				<< (pathFrames ? pathMs / pathFrames : 0.0f) << " ms average, "
+				<< pathWorstMs << " ms worst" << endl;
+	}
+
 	if (animation_on) {
 
 		if (selectedConeIndex == -1) {
 			// ALL selected: animate scene rotation + all cones
 			if (vertical_mode)
-				rot_y += 1.0f * animationSpeed;
+				camera.orbit(0.0f, 1.0f * animationSpeed);
 			else
-				rot_x += 1.0f * animationSpeed;
+				camera.orbit(1.0f * animationSpeed, 0.0f);
 
 			coneSpinAllDeg += 2.5f * animationSpeed;
 			if (coneSpinAllDeg >= 360.0f)
 				coneSpinAllDeg -= 360.0f;
 
 		} else {
-			// Single cone selected: animate ONLY that cone (no scene rotation)
-			coneSpinSingleDeg += 4.0f * animationSpeed;
-			if (coneSpinSingleDeg >= 360.0f)
-				coneSpinSingleDeg -= 360.0f;
+			// The selected and marked cones turn (no scene rotation)
+			advanceConeSpins();
 		}
 
-		glutPostRedisplay();
+		redisplay();
 	}
-	glutTimerFunc(20, timer, 0);
+
+	// Progressive refinement once input has stopped
+	if (qualityLevel > 0 && !interacting()) {
+		qualityLevel--;
+		redisplay();
+	}
+	camera.sample();
+	if (!replaying)
+		glutTimerFunc(20, timer, 0);
+}
+
+// A replay's frames: the time each took when recorded and now, and
+// whether it still shows the same number of cones and nodes.
+struct ReplayedFrame {
+	float recordedMs, replayedMs;
+	int quality;
+	bool differs;
+};
+vector<ReplayedFrame> replayedFrames;
+size_t replayNext = 0;
+int replayStartMs = 0;
+string frameTimesFile;	// --frame-times: every frame's, as CSV
+
+// Feeds one recorded event to the callback GLUT gave it to. A frame is
+// drawn at the quality level it had, which the recording chose from the
+// time frames took then. False at the ESC that quit, which ends the replay.
+static bool replayEvent(const InputEvent &e) {
+
+	replayClockMs = e.ms;
+	switch (e.type) {
+	case InputEvent::MOUSE:
+		mouse(e.a, e.b, e.c, e.d);
+		break;
+	case InputEvent::MOTION:
+		motion(e.c, e.d);
+		break;
+	case InputEvent::KEY:
+		// ESC quits, unless it cancels a rename
+		if (e.a == 27 && !renaming)
+			return false;
+		keyboard(e.a, e.c, e.d);
+		break;
+	case InputEvent::SPECIAL:
+		special(e.a, e.c, e.d);
+		break;
+	case InputEvent::TICK:
+		timer(0);
+		break;
+	case InputEvent::RESHAPE:
+		reshape(e.c, e.d);
+		break;
+	case InputEvent::FRAME: {
+		qualityLevel = e.a;
+		display();
+		ReplayedFrame f = { e.d / 1000.0f, lastFrameMs, e.a,
+				(int) frame.cones.size() != e.b
+						|| (int) frame.nodes.size() != e.c };
+		replayedFrames.push_back(f);
+		break;
+	}
+	default:
+		break;
+	}
+	return true;
+}
+
+// Average, 99th percentile and worst of the recorded or replayed times
+static void frameTimeSummary(bool recorded, float out[3]) {
+
+	vector<float> ms;
+	for (const ReplayedFrame &f : replayedFrames)
+		ms.push_back(recorded ? f.recordedMs : f.replayedMs);
+	out[0] = out[1] = out[2] = 0.0f;
+	if (ms.empty())
+		return;
+	sort(ms.begin(), ms.end());
+	for (float m : ms)
+		out[0] += m;
+	out[0] /= ms.size();
+	out[1] = ms[std::min(ms.size() - 1, ms.size() * 99 / 100)];
+	out[2] = ms.back();
+}
+
+static void finishReplay() {
+
+	float now[3], then[3];
+	frameTimeSummary(false, now);
+	frameTimeSummary(true, then);
+	size_t differ = 0, first = 0;
+	for (size_t i = replayedFrames.size(); i-- > 0;) {
+		if (replayedFrames[i].differs) {
+			differ++;
+			first = i;
+		}
+	}
+	cout << "Replayed " << replayNext << " events, " << replayedFrames.size()
+			<< " frames: " << now[0] << " ms average, " << now[1]
+			<< " ms 99th percentile, " << now[2] << " ms worst (recorded "
+			<< then[0] << ", " << then[1] << ", " << then[2] << ")" << endl;
+	if (differ)
+		cout << differ << " frames differ from the recording, the first being "
+				<< first << endl;
+	else
+		cout << "Every frame as recorded" << endl;
+
+	if (!frameTimesFile.empty()) {
+		ofstream out(frameTimesFile);
+		out << "frame,quality,recorded_ms,replayed_ms,differs\n";
+		for (size_t i = 0; i < replayedFrames.size(); ++i) {
+			const ReplayedFrame &f = replayedFrames[i];
+			out << i << ',' << f.quality << ',' << f.recordedMs << ','
+					<< f.replayedMs << ',' << f.differs << '\n';
+		}
+		if (!out)
+			cerr << "Failed to write " << frameTimesFile << endl;
+	}
+
+	streamed.reset(nullptr);
+	journal.clear();
+	deleteTree(root);
+	renderer->release();
+	delete renderer;
+	exit(0);
+}
+
+// Windowed replays keep the recorded pace: each tick feeds the events due
+// by then and waits for the next one.
+static void replayTimer(int value) {
+
+	const vector<InputEvent> &events = inputLog.events;
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	if (replayNext == 0)
+		replayStartMs = now - (events.empty() ? 0 : events[0].ms);
+	while (replayNext < events.size()
+			&& (int) events[replayNext].ms <= now - replayStartMs) {
+		if (!replayEvent(events[replayNext++]))
+			finishReplay();
+	}
+	if (replayNext == events.size())
+		finishReplay();
+	glutTimerFunc(events[replayNext].ms - (now - replayStartMs), replayTimer,
+			0);
+}
+
+static void usage(const char *argv0) {
+
+	cerr << "Usage: " << argv0
+			<< " [--renderer=legacy|core] [--gpu-cull] [--stats] [--mem-report]"
+					" [--updates -|socket] [--forest=grid|root]"
+					" [--camera-path file] [--record file]"
+					" [--replay file [--headless] [--frame-times file.csv]]"
+					" map.mm|.opml|.json|.txt|.csv|.tsv[.gz|.zst] ..."
+					" | --fs directory"
+			<< endl;
 }
 
 int main(int argc, char **argv) {
 
-	if (argc < 2) {
-		cerr << "Usage: " << argv[0] << " mindmap.mm" << endl;
+	string &filename = mapFilename;
+	bool coreProfile = false;
+	bool gpuCull = false;
+	bool statsOnly = false;
+	bool playPath = false;
+	string recordFile, replayFile;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--renderer=core") == 0) {
+			coreProfile = true;
+		} else if (strcmp(argv[i], "--renderer=legacy") == 0) {
+			coreProfile = false;
+		} else if (strcmp(argv[i], "--gpu-cull") == 0) {
+			gpuCull = true;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			statsOnly = true;
+		} else if (strcmp(argv[i], "--mem-report") == 0) {
+			memReport = true;
+		} else if (strcmp(argv[i], "--updates") == 0 && i + 1 < argc) {
+			updateSource = argv[++i];
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordFile = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayFile = argv[++i];
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		} else if (strcmp(argv[i], "--frame-times") == 0 && i + 1 < argc) {
+			frameTimesFile = argv[++i];
+		} else if (strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc) {
+			cameraPathFile = argv[++i];
+			playPath = true;
+		} else if (strcmp(argv[i], "--forest=grid") == 0) {
+			forestGrid = true;
+		} else if (strcmp(argv[i], "--forest=root") == 0) {
+			forestGrid = false;
+		} else if (strcmp(argv[i], "--fs") == 0 && i + 1 < argc) {
+			fsMode = true;
+			filename = argv[++i];
+		} else if (argv[i][0] == '-' && argv[i][1] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			forestFiles.push_back(argv[i]);
+		}
+	}
+	if (forestFiles.size() == 1 || fsMode) {
+		if (!fsMode)
+			filename = forestFiles[0];
+		forestFiles.clear();
+	} else if (!forestFiles.empty()) {
+		// Saved as one map
+		filename = "forest.mm";
+	}
+	if (filename.empty() && updateSource.empty()) {
+		usage(argv[0]);
 		return 1;
 	}
-	string filename = argv[1];
-	root = parseMM(filename);
+
+	if (filename.empty()) {
+		// Everything will come from the updates
+		root = new Node();
+		root->text = "Updates";
+	} else if (fsMode) {
+		// Sizes are what a file system view is about
+		proportional_layout = true;
+		root = fsWalker.start(filename);
+		if (!root) {
+			cerr << "Cannot scan " << filename << endl;
+			return 1;
+		}
+		scanning = true;
+		if (statsOnly || memReport) {
+			// Nothing to draw meanwhile
+			while (!fsWalker.done())
+				this_thread::sleep_for(chrono::milliseconds(10));
+			fsWalker.stop();
+			scanning = false;
+			if (statsOnly)
+				reportScan();
+		}
+	} else if (!forestFiles.empty()) {
+		root = loadForest(&mapEnvelope);
+	} else {
+		root = loadMap(filename, &mapEnvelope,
+				memReport ? &memUsage : nullptr, &mapFormat);
+	}
 	if (!root)
 		return 1;
 	computeSize(root);
+	metrics.compute(root);
+
+	if (statsOnly) {
+		// Whole-file statistics, no window
+		vector<string> lines;
+		metrics.report(root, lines);
+		for (const string &line : lines)
+			cout << line << endl;
+		deleteTree(root);
+		return 0;
+	}
+
 	layoutTree(root, vertical_mode, proportional_layout);
 
+	if (!updateSource.empty()) {
+		if (!updates.open(updateSource)) {
+			cerr << "Cannot read updates from " << updateSource << endl;
+			return 1;
+		}
+		streamed.reset(root);
+		streaming = true;
+	}
+
+	if (!replayFile.empty()) {
+		if (!inputLog.read(replayFile)) {
+			cerr << "Cannot read the input log " << replayFile << endl;
+			return 1;
+		}
+		if (inputLog.mapNodes != root->size)
+			cerr << replayFile << " was recorded with a map of "
+					<< inputLog.mapNodes << " nodes, this one has " << root->size
+					<< "; the replay will differ" << endl;
+		replaying = true;
+	} else if (headless) {
+		cerr << "--headless needs --replay, ignored" << endl;
+		headless = false;
+	}
+
+	if (headless) {
+		// Every event in turn, as fast as the frames can be walked
+		renderer = createNullRenderer();
+		renderer->init();
+		while (replayNext < inputLog.events.size()
+				&& replayEvent(inputLog.events[replayNext]))
+			replayNext++;
+		finishReplay();
+	}
+
+	// A replay opens the window the recording had
+	int initialWidth = 800, initialHeight = 600;
+	for (const InputEvent &e : inputLog.events) {
+		if (e.type == InputEvent::RESHAPE) {
+			initialWidth = e.c;
+			initialHeight = e.d;
+			break;
+		}
+	}
+
 	glutInit(&argc, argv);
+	if (coreProfile) {
+		glutInitContextVersion(3, 3);
+		glutInitContextProfile(GLUT_CORE_PROFILE);
+	}
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-	glutInitWindowSize(800, 600);
+	glutInitWindowSize(initialWidth, initialHeight);
 	glutCreateWindow("ConeTree Viewer");
 
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	quad = gluNewQuadric();
-	gluQuadricDrawStyle(quad, GLU_FILL);
+	if (gpuCull && !coreProfile)
+		cerr << "--gpu-cull needs --renderer=core, ignored" << endl;
+	renderer = coreProfile ?
+			createCoreRenderer(gpuCull) : createLegacyRenderer();
+	if (!renderer->init()) {
+		cerr << "Failed to initialize the " << renderer->name() << " renderer"
+				<< endl;
+		return 1;
+	}
 
 	glutDisplayFunc(display);
+	if (replaying) {
+		// The log feeds the callbacks; the window only shows the frames
+		glutTimerFunc(0, replayTimer, 0);
+		glutMainLoop();
+		return 0;
+	}
 	glutReshapeFunc(reshape);
 	glutMouseFunc(mouse);
 	glutMotionFunc(motion);
 	glutKeyboardFunc(keyboard);
+	glutSpecialFunc(special);
 	glutTimerFunc(20, timer, 0);
+	if (playPath && !playCameraPath())
+		return 1;
+	if (streaming)
+		glutTimerFunc(0, updateTimer, 0);
+	if (!recordFile.empty() && !inputLog.record(recordFile, root->size)) {
+		cerr << "Cannot write the input log " << recordFile << endl;
+		return 1;
+	}
 
 	glutMainLoop();
 	return 0;
@@ -0,0 +1,156 @@
+
+#ifndef CONETREE_H
+#define CONETREE_H
+
+#include "vecmath.h"
+#include <vector>
+#include <string>
+
+struct Pos {
+	float x, y, z;
+};
+
+struct Node;
+
+// Translates a raw label in place (see Node::label()).
+void decodeLabel(const Node *node);
+
+// Whether a raw label has anything decodeLabel() would change
+bool needsTranslation(const char *s, size_t n);
+
+// Frees a node and its subtree.
+void deleteTree(Node *node);
+
+struct Node {
+	// The label as read. While rawText is set it still has its entities,
+	// character references and carriage returns; label() translates them
+	// as XMLAttribute::Value() would the first time it is needed, so
+	// labels never drawn are never decoded.
+	mutable std::string text;
+	mutable bool rawText;
+	// Whether the label is still the TEXT attribute as read from a .mm file
+	// (edits clear it), so that saving can write that attribute unchanged.
+	bool textAsRead;
+	std::vector<Node*> children;
+	std::vector<std::pair<std::string, std::string>> attributes; // FreeMind <attribute NAME= VALUE=>
+	Pos pos;
+	int size;		// nodes in the subtree, set by computeSize()
+	// Proportional layout spreads children by subtree weight: 'weight' is
+	// the node's own (1 unless a source says otherwise, such as a file's
+	// size), 'total' that of its subtree and 'childTotal' that of its
+	// children's subtrees, which its circle is shared by, set by
+	// computeSize(). The latter is summed on its own rather than taken as
+	// total - weight, which cancels when the node's own weight dominates.
+	float weight = 1.0f;
+	float total;
+	float childTotal;
+	float extent;	// bounding radius of the subtree around pos, any spin
+	int cones;		// number of cones in the subtree
+	int index;		// pre-order number, set by TreeMetrics::compute()
+
+	// Source bytes the viewer does not interpret, written back unchanged
+	// when the map is saved: [0, sourceSplit) are the other attributes of
+	// the <node> tag, TEXT having been at offset textAt; the rest is the
+	// element's content other than child nodes. Empty for new nodes. Once
+	// a label is decoded, its raw TEXT value is kept at textAt, the next
+	// rawTextLength bytes.
+	mutable std::string source;
+	mutable unsigned sourceSplit;
+	unsigned textAt;
+	mutable unsigned rawTextLength;
+
+	const std::string& label() const {
+		if (rawText)
+			decodeLabel(this);
+		return text;
+	}
+};
+
+// What surrounds the root <node> of a .mm file (the <map> tag, anything
+// else outside the root), kept byte for byte for saving. 'partial' when
+// a FreeMind map was read without its source (compressed, or a pipe): its
+// save would keep only labels and attributes.
+struct MapEnvelope {
+	std::string head;
+	std::string tail;
+	bool partial = false;
+};
+
+// Per-frame draw lists. The tree walk in display() only records world
+// positions (after cone spinning); renderers then draw each primitive type
+// in its own pass with its GL state set once.
+struct ConeInstance {
+	Pos apex;
+	float radius;
+	float height;
+	float spinDeg;
+	bool selected;
+	const Node *node;
+};
+
+struct NodeInstance {
+	const Node *node;
+	Pos pos;
+};
+
+struct RenderStats {
+	int drawCalls;
+	int stateChanges;
+};
+
+// Rendering detail, from full quality down to the cheapest mode used while
+// the user drags or zooms. Renderers pick cone/sphere tessellation from it.
+enum {
+	DETAIL_FULL = 0, DETAIL_REDUCED = 1, DETAIL_COARSE = 2, DETAIL_LEVELS = 3
+};
+
+// Picture-in-picture overview of the whole tree, drawn over the main view
+// with the main camera's rotation. The viewport is a square in GL window
+// coordinates (origin bottom left). The view frames the sphere
+// center/radius; 'bound' (>= radius, same center) contains the tree under
+// any cone spin and sets the clip planes. The overview draws its own
+// instances, not the main view's (which are culled to the main camera):
+// the top levels of the tree at rest, rebuilt when 'version' changes.
+struct OverviewData {
+	bool enabled;
+	int x, y, size;
+	Pos center;
+	float radius;
+	float bound;
+	std::vector<ConeInstance> cones;
+	std::vector<NodeInstance> nodes;
+	unsigned version;
+};
+
+// A run of frame.nodes or frame.cones
+struct InstanceRange {
+	size_t first, count;
+};
+
+// Everything a renderer needs to draw one frame. 'view' is the camera's
+// (see cameraView()), with a 45 degree perspective.
+struct FrameData {
+	std::vector<ConeInstance> cones;
+	std::vector<NodeInstance> nodes;
+	unsigned treeVersion;	// bumped whenever nodes or labels change
+	unsigned instanceVersion;	// changes whenever cones/nodes are rebuilt
+	// When instanceVersion went on from movedFrom by spinning cones only:
+	// the runs of nodes and cones that moved. Nothing else changed.
+	unsigned movedFrom;
+	std::vector<InstanceRange> movedNodes, movedCones;
+	bool vertical;
+	bool oit;
+	bool labels;
+	int detail;		// DETAIL_*
+	const float *nodeColors;	// RGB per Node::index, null = default colors
+	std::vector<std::string> panel;	// text lines at the top left, if any
+	Mat4 view;
+	int width, height;
+	OverviewData overview;
+};
+
+// Cone colors indexed by [selected]
+extern const float coneFillColor[2][4];
+extern const float coneWireColor[2][4];
+
+#endif // CONETREE_H
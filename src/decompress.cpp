@@ -0,0 +1,324 @@
+#include "decompress.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <dlfcn.h>
+#include <zlib.h>
+
+using namespace std;
+
+Compression detectCompression(const char *data, size_t size) {
+
+	if (!data)
+		return COMPRESSION_NONE;
+	if (size >= 2 && memcmp(data, "\x1F\x8B", 2) == 0)
+		return COMPRESSION_GZIP;
+	if (size >= 4 && memcmp(data, "\x28\xB5\x2F\xFD", 4) == 0)
+		return COMPRESSION_ZSTD;
+	return COMPRESSION_NONE;
+}
+
+const char* compressionName(Compression compression) {
+
+	static const char *names[] = { "uncompressed", "gzip", "zstd" };
+	return names[compression];
+}
+
+string withoutCompressionExtension(const string &filename) {
+
+	for (const char *ext : { ".gz", ".zst", ".zstd" }) {
+		size_t n = strlen(ext);
+		if (filename.size() <= n)
+			continue;
+		size_t at = filename.size() - n;
+		bool match = true;
+		for (size_t i = 0; i < n && match; ++i)
+			match = tolower((unsigned char) filename[at + i]) == ext[i];
+		if (match)
+			return filename.substr(0, at);
+	}
+	return filename;
+}
+
+// The part of libzstd's streaming API used here, as zstd.h declares it
+struct ZstdInBuffer {
+	const void *src;
+	size_t size;
+	size_t pos;
+};
+struct ZstdOutBuffer {
+	void *dst;
+	size_t size;
+	size_t pos;
+};
+struct Zstd {
+	void* (*createDStream)();
+	size_t (*freeDStream)(void *stream);
+	size_t (*initDStream)(void *stream);
+	size_t (*decompressStream)(void *stream, ZstdOutBuffer *out,
+			ZstdInBuffer *in);
+	unsigned (*isError)(size_t code);
+	const char* (*getErrorName)(size_t code);
+};
+
+// Null if libzstd is not installed
+static const Zstd* loadZstd() {
+
+	static const Zstd *zstd = []() -> const Zstd* {
+		void *lib = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+		if (!lib)
+			lib = dlopen("libzstd.so", RTLD_NOW | RTLD_LOCAL);
+		if (!lib)
+			return nullptr;
+		static Zstd api;
+		api.createDStream = (void* (*)()) dlsym(lib, "ZSTD_createDStream");
+		api.freeDStream = (size_t (*)(void*)) dlsym(lib, "ZSTD_freeDStream");
+		api.initDStream = (size_t (*)(void*)) dlsym(lib, "ZSTD_initDStream");
+		api.decompressStream = (size_t (*)(void*, ZstdOutBuffer*,
+				ZstdInBuffer*)) dlsym(lib, "ZSTD_decompressStream");
+		api.isError = (unsigned (*)(size_t)) dlsym(lib, "ZSTD_isError");
+		api.getErrorName = (const char* (*)(size_t)) dlsym(lib,
+				"ZSTD_getErrorName");
+		if (!api.createDStream || !api.freeDStream || !api.initDStream
+				|| !api.decompressStream || !api.isError || !api.getErrorName)
+			return nullptr;
+		return &api;
+	}();
+	return zstd;
+}
+
+Decompressor::Decompressor() :
+		input(nullptr), inputSize(0), compression(COMPRESSION_NONE), stopping(
+				false), produced(0), reading(nullptr), finished(true) {
+}
+
+Decompressor::~Decompressor() {
+	stop();
+}
+
+bool Decompressor::start(const char *data, size_t size,
+		Compression compression) {
+
+	stop();
+	failure.clear();
+	if (compression == COMPRESSION_ZSTD && !loadZstd()) {
+		failure = "zstd input needs libzstd, which is not installed";
+		return false;
+	}
+	if (compression == COMPRESSION_NONE) {
+		failure = "the input is not compressed";
+		return false;
+	}
+	input = data;
+	inputSize = size;
+	this->compression = compression;
+	produced = 0;
+	chunks.resize(chunkCount);
+	full.clear();
+	empty.clear();
+	for (Chunk &c : chunks) {
+		c.data.resize(chunkSize);
+		c.size = 0;
+		empty.push_back(&c);
+	}
+	reading = nullptr;
+	finished = false;
+	stopping = false;
+	worker = thread(&Decompressor::run, this);
+	return true;
+}
+
+bool Decompressor::next(const char *&chunk, size_t &size) {
+
+	unique_lock<mutex> guard(lock);
+	if (reading) {
+		empty.push_back(reading);
+		reading = nullptr;
+		changed.notify_all();
+	}
+	changed.wait(guard, [this] {
+		return !full.empty() || finished;
+	});
+	if (full.empty())
+		return false;
+	reading = full.front();
+	full.pop_front();
+	chunk = reading->data.data();
+	size = reading->size;
+	return true;
+}
+
+void Decompressor::stop() {
+
+	// Under the lock, or the worker could miss the notify between testing
+	// its wait predicate and blocking
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	if (worker.joinable())
+		worker.join();
+}
+
+void Decompressor::run() {
+
+	bool ok = compression == COMPRESSION_GZIP ? inflateGzip() : inflateZstd();
+	lock_guard<mutex> guard(lock);
+	if (!ok && failure.empty() && !stopping)
+		failure = "corrupt input";
+	finished = true;
+	changed.notify_all();
+}
+
+// Waits for the reader to hand one back; null once stopping
+Decompressor::Chunk* Decompressor::emptyChunk() {
+
+	unique_lock<mutex> guard(lock);
+	changed.wait(guard, [this] {
+		return !empty.empty() || stopping;
+	});
+	if (stopping)
+		return nullptr;
+	Chunk *c = empty.back();
+	empty.pop_back();
+	c->size = 0;
+	return c;
+}
+
+// Queues a filled chunk; a chunk with nothing in it goes back to 'empty'.
+bool Decompressor::deliver(Chunk *chunk) {
+
+	lock_guard<mutex> guard(lock);
+	if (chunk->size == 0) {
+		empty.push_back(chunk);
+	} else {
+		produced += chunk->size;
+		full.push_back(chunk);
+		changed.notify_all();
+	}
+	return !stopping;
+}
+
+bool Decompressor::inflateGzip() {
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	// 15 window bits, plus 32: a gzip (or zlib) header
+	if (inflateInit2(&z, 15 + 32) != Z_OK)
+		return false;
+	const unsigned char *in = (const unsigned char*) input;
+	size_t left = inputSize;
+	Chunk *out = nullptr;
+	int status = Z_OK;
+	bool ok = true;
+	while (ok) {
+		if (!out && !(out = emptyChunk())) {
+			ok = false;
+			break;
+		}
+		if (z.avail_in == 0) {
+			if (left == 0)
+				break;
+			// avail_in is 32 bits wide
+			z.next_in = (Bytef*) in;
+			z.avail_in = min<size_t>(left, UINT_MAX);
+			in += z.avail_in;
+			left -= z.avail_in;
+		}
+		z.next_out = (Bytef*) out->data.data() + out->size;
+		z.avail_out = chunkSize - out->size;
+		status = inflate(&z, Z_NO_FLUSH);
+		out->size = chunkSize - z.avail_out;
+		if (status == Z_STREAM_END) {
+			// Another member may follow; anything else is trailing padding,
+			// which gzip ignores too.
+			if (z.avail_in + left >= 2 && z.next_in[0] == 0x1F
+					&& z.next_in[1] == 0x8B) {
+				inflateReset(&z);
+			} else {
+				left = 0;
+				z.avail_in = 0;
+			}
+		} else if (status != Z_OK && status != Z_BUF_ERROR) {
+			lock_guard<mutex> guard(lock);
+			failure = z.msg ? z.msg : "corrupt gzip input";
+			ok = false;
+		} else if (status == Z_BUF_ERROR && z.avail_in == 0 && left == 0) {
+			break;
+		}
+		if (out->size == chunkSize) {
+			ok = deliver(out);
+			out = nullptr;
+		}
+	}
+	if (ok && status != Z_STREAM_END) {
+		lock_guard<mutex> guard(lock);
+		failure = "truncated gzip input";
+		ok = false;
+	}
+	if (out)
+		deliver(out);
+	inflateEnd(&z);
+	return ok;
+}
+
+bool Decompressor::inflateZstd() {
+
+	const Zstd *zstd = loadZstd();
+	void *stream = zstd->createDStream();
+	if (!stream)
+		return false;
+	zstd->initDStream(stream);
+	ZstdInBuffer in = { input, inputSize, 0 };
+	Chunk *out = nullptr;
+	size_t status = 0;
+	bool ok = true;
+	while (ok && in.pos < in.size) {
+		if (!out && !(out = emptyChunk())) {
+			ok = false;
+			break;
+		}
+		ZstdOutBuffer buffer = { out->data.data(), chunkSize, out->size };
+		// Returns 0 where a frame ends; the next call starts the next one
+		status = zstd->decompressStream(stream, &buffer, &in);
+		out->size = buffer.pos;
+		if (zstd->isError(status)) {
+			lock_guard<mutex> guard(lock);
+			failure = zstd->getErrorName(status);
+			ok = false;
+		}
+		if (out->size == chunkSize) {
+			ok = deliver(out) && ok;
+			out = nullptr;
+		}
+	}
+	// What the decoder still holds once the input is all in
+	while (ok && status != 0) {
+		if (!out && !(out = emptyChunk())) {
+			ok = false;
+			break;
+		}
+		ZstdOutBuffer buffer = { out->data.data(), chunkSize, out->size };
+		status = zstd->decompressStream(stream, &buffer, &in);
+		if (zstd->isError(status)) {
+			lock_guard<mutex> guard(lock);
+			failure = zstd->getErrorName(status);
+			ok = false;
+		} else if (buffer.pos == out->size) {
+			lock_guard<mutex> guard(lock);
+			failure = "truncated zstd input";
+			ok = false;
+		}
+		out->size = buffer.pos;
+		if (out->size == chunkSize) {
+			ok = deliver(out) && ok;
+			out = nullptr;
+		}
+	}
+	if (out)
+		deliver(out);
+	zstd->freeDStream(stream);
+	return ok;
+}
@@ -0,0 +1,95 @@
+
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// Maps archived compressed: gzip (any number of members) and zstd (any
+// number of frames), told apart by their magic bytes.
+enum Compression {
+	COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD
+};
+
+Compression detectCompression(const char *data, size_t size);
+
+const char* compressionName(Compression compression);
+
+// 'filename' without a .gz, .zst or .zstd extension, for what it holds.
+std::string withoutCompressionExtension(const std::string &filename);
+
+// Decompresses on a thread of its own, into a few fixed-size chunks that
+// the reader takes one at a time and hands back by taking the next: the
+// decompressed input is never held whole, and decompressing the next
+// chunks overlaps with whatever the reader does with this one. zlib is
+// linked; libzstd is loaded the first time a zstd input is opened, so the
+// viewer neither needs it to build nor to run without zstd maps.
+class Decompressor {
+public:
+	Decompressor();
+	~Decompressor();
+
+	// Starts decompressing the 'size' bytes at 'data', which must stay
+	// valid until the end. False, with error() set, if it cannot.
+	bool start(const char *data, size_t size, Compression compression);
+
+	// The next chunk of output, valid until the next call. False at the end
+	// of the input or on an error, which error() then tells.
+	bool next(const char *&chunk, size_t &size);
+
+	// Empty unless the input is corrupt or truncated. The worker writes it
+	// until it ends, so read it only once start() or next() has returned
+	// false.
+	const std::string& error() const {
+		return failure;
+	}
+
+	// Bytes of output so far
+	size_t total() const {
+		return produced;
+	}
+
+	// Buffers allocated, for the memory report
+	size_t memoryBytes() const {
+		return chunkCount * chunkSize;
+	}
+
+	static const size_t chunkSize = 1 << 20;
+	static const size_t chunkCount = 4;
+
+private:
+	struct Chunk {
+		std::vector<char> data;
+		size_t size;
+	};
+
+	void run();
+	bool inflateGzip();
+	bool inflateZstd();
+	Chunk* emptyChunk();
+	bool deliver(Chunk *chunk);
+	void stop();
+
+	const char *input;
+	size_t inputSize;
+	Compression compression;
+	std::thread worker;
+	std::atomic<bool> stopping;
+	std::atomic<size_t> produced;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::vector<Chunk> chunks;
+	std::deque<Chunk*> full;	// decompressed, in order
+	std::vector<Chunk*> empty;	// free for the worker
+	Chunk *reading;				// the reader's, until its next call
+	bool finished;
+	std::string failure;
+};
+
+#endif // DECOMPRESS_H
@@ -0,0 +1,205 @@
+
+#include "fswalk.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+// The records getdents64 fills its buffer with
+struct LinuxDirent64 {
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static const size_t direntBufferSize = 1 << 16;
+
+DirectoryWalker::DirectoryWalker() :
+		pending(0), stopping(false), dirCount(0), fileCount(0), errorCount(0) {
+}
+
+DirectoryWalker::~DirectoryWalker() {
+	stop();
+}
+
+Node* DirectoryWalker::start(const string &path, unsigned threads) {
+
+	stop();
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+		return nullptr;
+
+	Node *root = new Node();
+	root->text = path;
+	dirCount = 1;
+	fileCount = errorCount = 0;
+	stopping = false;
+
+	if (threads == 0)
+		threads = max(1u, thread::hardware_concurrency()) * 2;
+	queues.clear();
+	for (unsigned i = 0; i < threads; ++i)
+		queues.emplace_back(new TaskQueue());
+	queues[0]->tasks.push_back( { root, path });
+	pending = 1;
+	for (unsigned i = 0; i < threads; ++i)
+		workers.emplace_back(&DirectoryWalker::work, this, i);
+	return root;
+}
+
+// The newest task of this worker, or else the oldest of another one
+bool DirectoryWalker::take(unsigned worker, Task &task) {
+
+	{
+		TaskQueue &own = *queues[worker];
+		lock_guard<mutex> hold(own.lock);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for (size_t i = 1; i < queues.size(); ++i) {
+		TaskQueue &other = *queues[(worker + i) % queues.size()];
+		lock_guard<mutex> hold(other.lock);
+		if (!other.tasks.empty()) {
+			task = std::move(other.tasks.front());
+			other.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void DirectoryWalker::work(unsigned worker) {
+
+	vector<char> buffer(direntBufferSize);
+	Task task;
+	while (!stopping) {
+		if (take(worker, task)) {
+			scan(worker, task, buffer);
+			pending--;
+		} else if (pending == 0) {
+			break;
+		} else {
+			this_thread::sleep_for(chrono::microseconds(100));
+		}
+	}
+}
+
+void DirectoryWalker::scan(unsigned worker, const Task &task,
+		vector<char> &buffer) {
+
+	int fd = open(task.path.c_str(),
+			O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		errorCount++;
+		return;
+	}
+
+	Listing listing = { task.node, { } };
+	vector<Task> subdirs;
+	string prefix = task.path;
+	if (prefix.empty() || prefix.back() != '/')
+		prefix += '/';
+	long files = 0;
+	for (;;) {
+		long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+		if (n <= 0) {
+			if (n < 0)
+				errorCount++;
+			break;
+		}
+		for (long at = 0; at < n;) {
+			const LinuxDirent64 *d = (const LinuxDirent64*) (buffer.data() + at);
+			at += d->d_reclen;
+			const char *name = d->d_name;
+			if (name[0] == '.'
+					&& (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+				continue;
+
+			unsigned char type = d->d_type;
+			struct stat st;
+			bool statted = false;
+			if (type == DT_UNKNOWN || type == DT_REG) {
+				statted = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+				if (!statted)
+					errorCount++;
+				else if (type == DT_UNKNOWN)
+					type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+			}
+
+			Node *child = new Node();
+			child->text = name;
+			if (type == DT_DIR) {
+				subdirs.push_back( { child, prefix + name });
+			} else {
+				if (statted && S_ISREG(st.st_mode))
+					child->weight = max<float>(st.st_size, 1.0f);
+				files++;
+			}
+			listing.children.push_back(child);
+		}
+	}
+	close(fd);
+
+	// By name, stored last-to-first like every child list
+	sort(listing.children.begin(), listing.children.end(),
+			[](const Node *a, const Node *b) {
+				return a->text > b->text;
+			});
+	dirCount += subdirs.size();
+	fileCount += files;
+
+	// Hand the listing over before its subdirectories can be scanned, so
+	// drain() always links a directory before its contents.
+	{
+		lock_guard<mutex> hold(listingLock);
+		listings.push_back(std::move(listing));
+	}
+	if (!subdirs.empty()) {
+		pending += subdirs.size();
+		TaskQueue &own = *queues[worker];
+		lock_guard<mutex> hold(own.lock);
+		for (Task &t : subdirs)
+			own.tasks.push_back(std::move(t));
+	}
+}
+
+bool DirectoryWalker::drain() {
+
+	vector<Listing> ready;
+	{
+		lock_guard<mutex> hold(listingLock);
+		ready.swap(listings);
+	}
+	for (Listing &l : ready) {
+		auto &children = l.dir->children;
+		children.insert(children.end(), l.children.begin(), l.children.end());
+	}
+	return !ready.empty();
+}
+
+bool DirectoryWalker::done() const {
+
+	return pending == 0;
+}
+
+void DirectoryWalker::stop() {
+
+	stopping = true;
+	for (auto &w : workers)
+		w.join();
+	workers.clear();
+	drain();
+	queues.clear();
+	pending = 0;
+}
@@ -0,0 +1,84 @@
+
+#ifndef FSWALK_H
+#define FSWALK_H
+
+#include "conetree.h"
+#include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+// --fs: a directory tree as a cone tree, one Node per entry. Files weigh
+// their size in bytes, so proportional layout gives them their share of
+// the disk; symbolic links are not followed.
+//
+// The scan runs on a pool of threads, one directory per task: a worker
+// reads it with getdents64 (stat'ing entries with fstatat only where the
+// type is unknown or the size is needed), makes a Node per entry, hands
+// the list to the main thread and queues the subdirectories on its own
+// deque. Workers take their newest task first and steal the oldest ones
+// of others, which are the nearest the root and so the largest. Workers
+// never touch a Node once it is handed over: drain() links the lists into
+// the tree on the main thread, which can draw it while the scan goes on.
+class DirectoryWalker {
+public:
+	DirectoryWalker();
+	~DirectoryWalker();
+
+	// Starts scanning 'path' on 'threads' workers (0: two per core, as they
+	// mostly wait for the file system) and returns its root node, owned by
+	// the caller; null if it is not a readable directory.
+	Node* start(const std::string &path, unsigned threads = 0);
+
+	// Links the directories read since the last call into the tree.
+	// Returns false if there were none.
+	bool drain();
+
+	// Every directory read; a last drain() links the rest.
+	bool done() const;
+
+	// Ends the scan early; what was read is still linked.
+	void stop();
+
+	long long directories() const {
+		return dirCount;
+	}
+	long long files() const {
+		return fileCount;
+	}
+	long long errors() const {
+		return errorCount;
+	}
+
+private:
+	struct Task {
+		Node *node;
+		std::string path;
+	};
+	struct TaskQueue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+	struct Listing {
+		Node *dir;
+		std::vector<Node*> children;
+	};
+
+	void work(unsigned worker);
+	bool take(unsigned worker, Task &task);
+	void scan(unsigned worker, const Task &task, std::vector<char> &buffer);
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<long long> pending;		// tasks queued or being scanned
+	std::atomic<bool> stopping;
+	std::atomic<long long> dirCount, fileCount, errorCount;
+
+	std::mutex listingLock;
+	std::vector<Listing> listings;
+};
+
+#endif // FSWALK_H
@@ -0,0 +1,584 @@
+
+#include "glcore.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+using namespace std;
+
+const char *coneVertexShader = R"(#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec4 aApexRadius;
+layout(location = 2) in vec4 aParams;	// height, spin, vertical, unused
+layout(location = 3) in vec4 aFill;
+layout(location = 4) in vec4 aWire;
+
+layout(std140) uniform Camera {
+	mat4 uView;
+	mat4 uProj;
+	vec4 uViewport;
+};
+uniform bool uWire;
+
+out vec4 vColor;
+out float vViewZ;
+
+void main() {
+	float r = aApexRadius.w;
+	vec3 p = aPos * vec3(r, r, aParams.x);
+
+	// Same transform as the fixed-function path: spin about the axis, then
+	// rotate the +Z axis onto -Y (vertical) or +X (horizontal).
+	bool vertical = aParams.z > 0.5;
+	float s = aParams.y + (vertical ? 3.14159265 : 0.0);
+	p.xy = mat2(cos(s), sin(s), -sin(s), cos(s)) * p.xy;
+	vec3 w = vertical ? vec3(p.x, -p.z, p.y) : vec3(p.z, p.y, -p.x);
+
+	vec4 viewPos = uView * vec4(aApexRadius.xyz + w, 1.0);
+	vViewZ = viewPos.z;
+	vColor = uWire ? aWire : aFill;
+	gl_Position = uProj * viewPos;
+}
+)";
+
+// Frustum test shared by both culling passes: the bounding sphere of the
+// cone around its axis midpoint (spin does not move it) against the side
+// planes of the view, which pass through the eye.
+static const char *coneVisibleGlsl = R"(
+layout(std140) uniform Camera {
+	mat4 uView;
+	mat4 uProj;
+	vec4 uViewport;
+};
+
+bool coneVisible(vec4 apexRadius, vec4 params) {
+	vec3 axis = params.z > 0.5 ? vec3(0.0, -1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 center = apexRadius.xyz + axis * (0.5 * params.x);
+	float r = length(vec2(apexRadius.w, 0.5 * params.x));
+	vec3 v = (uView * vec4(center, 1.0)).xyz;
+	if (v.z - r > 0.0)
+		return false;
+	vec2 p = vec2(uProj[0][0], uProj[1][1]);
+	vec2 d = (p * abs(v.xy) + v.z) * inversesqrt(p * p + 1.0);
+	return d.x <= r && d.y <= r;
+}
+)";
+
+// Both culling shaders are completed with coneVisibleGlsl after the
+// version line.
+static const char *coneCullComputeShader = R"(
+layout(local_size_x = 64) in;
+
+struct Instance {
+	vec4 apexRadius;
+	vec4 params;
+	vec4 fill;
+	vec4 wire;
+};
+layout(std430, binding = 0) readonly buffer Source {
+	Instance src[];
+};
+layout(std430, binding = 1) writeonly buffer Visible {
+	Instance dst[];
+};
+// Two DrawElementsIndirectCommands (fill, wire): count, instanceCount,
+// firstIndex, baseVertex, baseInstance
+layout(std430, binding = 2) buffer Commands {
+	uint cmd[10];
+};
+uniform uint uCount;
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= uCount || !coneVisible(src[i].apexRadius, src[i].params))
+		return;
+	uint slot = atomicAdd(cmd[1], 1u);
+	atomicAdd(cmd[6], 1u);
+	dst[slot] = src[i];
+}
+)";
+
+static const char *coneCullVertexShader = R"(#version 330 core
+layout(location = 0) in vec4 aApexRadius;
+layout(location = 1) in vec4 aParams;
+layout(location = 2) in vec4 aFill;
+layout(location = 3) in vec4 aWire;
+
+out vec4 vApexRadius;
+out vec4 vParams;
+out vec4 vFill;
+out vec4 vWire;
+
+void main() {
+	vApexRadius = aApexRadius;
+	vParams = aParams;
+	vFill = aFill;
+	vWire = aWire;
+}
+)";
+
+static const char *coneCullGeometryShader = R"(
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+in vec4 vApexRadius[];
+in vec4 vParams[];
+in vec4 vFill[];
+in vec4 vWire[];
+
+out vec4 oApexRadius;
+out vec4 oParams;
+out vec4 oFill;
+out vec4 oWire;
+
+void main() {
+	if (!coneVisible(vApexRadius[0], vParams[0]))
+		return;
+	oApexRadius = vApexRadius[0];
+	oParams = vParams[0];
+	oFill = vFill[0];
+	oWire = vWire[0];
+	EmitVertex();
+	EndPrimitive();
+}
+)";
+
+static const char* shaderTypeName(GLenum type) {
+
+	switch (type) {
+	case GL_VERTEX_SHADER:
+		return "vertex";
+	case GL_GEOMETRY_SHADER:
+		return "geometry";
+	case GL_COMPUTE_SHADER:
+		return "compute";
+	default:
+		return "fragment";
+	}
+}
+
+static GLuint compileShader(GLenum type, const char *src, const char *name) {
+
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &src, nullptr);
+	glCompileShader(shader);
+
+	GLint ok = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[2048];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		cerr << "Failed to compile " << name << " " << shaderTypeName(type)
+				<< " shader:\n" << log << endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+// Links the shaders (deleting them) and binds the Camera block. Shaders
+// that failed to compile are 0, in which case nothing is linked.
+static GLuint linkProgram(const GLuint *shaders, int n,
+		const char *const *varyings, int varyingCount, const char *name) {
+
+	bool compiled = true;
+	for (int i = 0; i < n; ++i)
+		compiled = compiled && shaders[i];
+	if (!compiled) {
+		for (int i = 0; i < n; ++i)
+			glDeleteShader(shaders[i]);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	for (int i = 0; i < n; ++i)
+		glAttachShader(program, shaders[i]);
+	if (varyingCount > 0)
+		glTransformFeedbackVaryings(program, varyingCount, varyings,
+				GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+	for (int i = 0; i < n; ++i)
+		glDeleteShader(shaders[i]);
+
+	GLint ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[2048];
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		cerr << "Failed to link " << name << " program:\n" << log << endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	GLuint camera = glGetUniformBlockIndex(program, "Camera");
+	if (camera != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, camera, CAMERA_BLOCK_BINDING);
+	return program;
+}
+
+GLuint compileProgram(const char *vertexSrc, const char *fragmentSrc,
+		const char *name) {
+
+	GLuint shaders[] = { compileShader(GL_VERTEX_SHADER, vertexSrc, name),
+			compileShader(GL_FRAGMENT_SHADER, fragmentSrc, name) };
+	return linkProgram(shaders, 2, nullptr, 0, name);
+}
+
+GLuint compileComputeProgram(const char *computeSrc, const char *name) {
+
+	GLuint shader = compileShader(GL_COMPUTE_SHADER, computeSrc, name);
+	return linkProgram(&shader, 1, nullptr, 0, name);
+}
+
+GLuint compileFeedbackProgram(const char *vertexSrc, const char *geometrySrc,
+		const char *const *varyings, int varyingCount, const char *name) {
+
+	GLuint shaders[] = { compileShader(GL_VERTEX_SHADER, vertexSrc, name),
+			compileShader(GL_GEOMETRY_SHADER, geometrySrc, name) };
+	return linkProgram(shaders, 2, varyings, varyingCount, name);
+}
+
+bool glVersionAtLeast(int major, int minor) {
+
+	const char *version = (const char*) glGetString(GL_VERSION);
+	int maj = 0, min = 0;
+	if (!version || sscanf(version, "%d.%d", &maj, &min) != 2)
+		return false;
+	return maj > major || (maj == major && min >= minor);
+}
+
+CameraBlock::CameraBlock() :
+		ubo(0) {
+}
+
+bool CameraBlock::init() {
+
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, 36 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ubo);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void CameraBlock::release() {
+
+	glDeleteBuffers(1, &ubo);
+	ubo = 0;
+}
+
+void CameraBlock::update(const float *view, const float *proj, int width,
+		int height, int x, int y) {
+
+	float data[36];
+	std::copy(view, view + 16, data);
+	std::copy(proj, proj + 16, data + 16);
+	data[32] = (float) width;
+	data[33] = (float) height;
+	data[34] = (float) x;
+	data[35] = (float) y;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+ConeBatch::ConeBatch() :
+		vao(0), vertexBuffer(0), indexBuffer(0), instanceBuffer(0),
+		meshBytes(0), capacity(0), count(0), lods(), mode(CULL_NONE),
+		cullProgram(0), visibleVao(0), visibleBuffer(0), visibleCapacity(0),
+		indirectBuffer(0), feedbackVao(0), visibleQuery(0), visibleCount(0),
+		visibleLod(0) {
+}
+
+bool ConeBatch::init(const int (&segments)[LODS]) {
+
+	vector<float> verts;
+	vector<GLushort> indices;
+	for (int lod = 0; lod < LODS; ++lod) {
+		// The apex vertex, then the rim at z = 1 (radius 1).
+		int n = segments[lod];
+		GLushort apex = verts.size() / 3;
+		verts.insert(verts.end(), { 0.0f, 0.0f, 0.0f });
+		for (int i = 0; i < n; ++i) {
+			float a = 2.0f * (float) M_PI * i / n;
+			verts.push_back(cosf(a));
+			verts.push_back(sinf(a));
+			verts.push_back(1.0f);
+		}
+
+		// Fill triangles first, then the wire lines (apex spokes and rim ring).
+		Range &r = lods[lod];
+		r.fillFirst = indices.size();
+		for (int i = 0; i < n; ++i) {
+			indices.push_back(apex);
+			indices.push_back(apex + 1 + i);
+			indices.push_back(apex + 1 + (i + 1) % n);
+		}
+		r.fillCount = indices.size() - r.fillFirst;
+		r.wireFirst = indices.size();
+		for (int i = 0; i < n; ++i) {
+			indices.push_back(apex);
+			indices.push_back(apex + 1 + i);
+			indices.push_back(apex + 1 + i);
+			indices.push_back(apex + 1 + (i + 1) % n);
+		}
+		r.wireCount = indices.size() - r.wireFirst;
+	}
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), verts.data(),
+			GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort),
+			indices.data(), GL_STATIC_DRAW);
+	meshBytes = verts.size() * sizeof(float)
+			+ indices.size() * sizeof(GLushort);
+
+	glGenBuffers(1, &instanceBuffer);
+	bindInstances(instanceBuffer, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+// Instance attributes 1-4 of the bound VAO from 'buffer'
+void ConeBatch::bindInstances(GLuint buffer, GLuint divisor) const {
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	const GLsizei stride = sizeof(ConeGpuInstance);
+	const size_t offsets[] = { offsetof(ConeGpuInstance, apex), offsetof(
+			ConeGpuInstance, height), offsetof(ConeGpuInstance, fill), offsetof(
+			ConeGpuInstance, wire) };
+	for (int i = 0; i < 4; ++i) {
+		glEnableVertexAttribArray(1 + i);
+		glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, stride,
+				(const void*) offsets[i]);
+		glVertexAttribDivisor(1 + i, divisor);
+	}
+}
+
+void ConeBatch::release() {
+
+	if (mode != CULL_NONE) {
+		GLuint buffers[] = { visibleBuffer, indirectBuffer };
+		glDeleteBuffers(2, buffers);
+		GLuint vaos[] = { visibleVao, feedbackVao };
+		glDeleteVertexArrays(2, vaos);
+		glDeleteQueries(1, &visibleQuery);
+		glDeleteProgram(cullProgram);
+		visibleBuffer = indirectBuffer = visibleVao = feedbackVao = 0;
+		visibleQuery = cullProgram = 0;
+		visibleCapacity = visibleCount = 0;
+		mode = CULL_NONE;
+	}
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteVertexArrays(1, &vao);
+	vao = vertexBuffer = indexBuffer = instanceBuffer = 0;
+	meshBytes = capacity = count = 0;
+}
+
+size_t ConeBatch::bytes() const {
+
+	return meshBytes
+			+ (capacity + visibleCapacity) * sizeof(ConeGpuInstance)
+			+ (indirectBuffer ? 10 * sizeof(GLuint) : 0);
+}
+
+void ConeBatch::upload(const ConeGpuInstance *instances, size_t n) {
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	if (n > capacity) {
+		capacity = n + n / 2;
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(ConeGpuInstance),
+				nullptr, GL_STREAM_DRAW);
+	}
+	if (n > 0)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(ConeGpuInstance),
+				instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	count = n;
+}
+
+void ConeBatch::update(const ConeGpuInstance *instances, size_t first,
+		size_t n) {
+
+	if (n == 0 || first + n > count)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(ConeGpuInstance),
+			n * sizeof(ConeGpuInstance), instances + first);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ConeBatch::draw(GLuint program, bool wire, int lod) const {
+
+	if (count == 0)
+		return;
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "uWire"), wire ? 1 : 0);
+
+	const Range &r = lods[lod];
+	glBindVertexArray(vao);
+	if (wire) {
+		glDrawElementsInstanced(GL_LINES, r.wireCount, GL_UNSIGNED_SHORT,
+				(const void*) (r.wireFirst * sizeof(GLushort)), count);
+	} else {
+		glDrawElementsInstanced(GL_TRIANGLES, r.fillCount, GL_UNSIGNED_SHORT,
+				(const void*) (r.fillFirst * sizeof(GLushort)), count);
+	}
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+bool ConeBatch::enableCulling() {
+
+	if (glVersionAtLeast(4, 3)) {
+		string src = string("#version 430 core\n") + coneVisibleGlsl
+				+ coneCullComputeShader;
+		cullProgram = compileComputeProgram(src.c_str(), "cone cull");
+		mode = CULL_COMPUTE;
+	}
+	if (!cullProgram) {
+		// Transform feedback: one point per instance, which the geometry
+		// shader drops if it is culled.
+		const char *varyings[] = { "oApexRadius", "oParams", "oFill", "oWire" };
+		string src = string("#version 330 core\n") + coneVisibleGlsl
+				+ coneCullGeometryShader;
+		cullProgram = compileFeedbackProgram(coneCullVertexShader, src.c_str(),
+				varyings, 4, "cone cull");
+		mode = CULL_FEEDBACK;
+	}
+	if (!cullProgram) {
+		mode = CULL_NONE;
+		return false;
+	}
+
+	// The cone mesh again, with the compacted instances
+	glGenVertexArrays(1, &visibleVao);
+	glBindVertexArray(visibleVao);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glGenBuffers(1, &visibleBuffer);
+	bindInstances(visibleBuffer, 1);
+	glBindVertexArray(0);
+
+	if (mode == CULL_COMPUTE) {
+		glGenBuffers(1, &indirectBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, 10 * sizeof(GLuint), nullptr,
+				GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	} else {
+		glGenVertexArrays(1, &feedbackVao);
+		glBindVertexArray(feedbackVao);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (int i = 0; i < 4; ++i) {
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE,
+					sizeof(ConeGpuInstance),
+					(const void*) (i * 4 * sizeof(float)));
+		}
+		glBindVertexArray(0);
+		glGenQueries(1, &visibleQuery);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void ConeBatch::cull(int lod) {
+
+	visibleLod = lod;
+	if (visibleCapacity < capacity) {
+		visibleCapacity = capacity;
+		glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+		glBufferData(GL_ARRAY_BUFFER, visibleCapacity * sizeof(ConeGpuInstance),
+				nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	if (mode == CULL_COMPUTE) {
+		const Range &r = lods[lod];
+		const GLuint commands[10] = { (GLuint) r.fillCount, 0,
+				(GLuint) r.fillFirst, 0, 0, (GLuint) r.wireCount, 0,
+				(GLuint) r.wireFirst, 0, 0 };
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands), commands);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		if (count == 0)
+			return;
+
+		glUseProgram(cullProgram);
+		glUniform1ui(glGetUniformLocation(cullProgram, "uCount"), count);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirectBuffer);
+		glDispatchCompute((count + 63) / 64, 1, 1);
+		glMemoryBarrier(
+				GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+		glUseProgram(0);
+	} else {
+		visibleCount = 0;
+		if (count == 0)
+			return;
+
+		glUseProgram(cullProgram);
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, visibleBuffer);
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, visibleQuery);
+		glBeginTransformFeedback(GL_POINTS);
+		glBindVertexArray(feedbackVao);
+		glDrawArrays(GL_POINTS, 0, count);
+		glBindVertexArray(0);
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		glUseProgram(0);
+
+		// Waits for the pass; this fallback has no indirect draws.
+		glGetQueryObjectuiv(visibleQuery, GL_QUERY_RESULT, &visibleCount);
+	}
+}
+
+void ConeBatch::drawVisible(GLuint program, bool wire) const {
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "uWire"), wire ? 1 : 0);
+	glBindVertexArray(visibleVao);
+
+	GLenum prim = wire ? GL_LINES : GL_TRIANGLES;
+	if (mode == CULL_COMPUTE) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glDrawElementsIndirect(prim, GL_UNSIGNED_SHORT,
+				(const void*) ((wire ? 5 : 0) * sizeof(GLuint)));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	} else if (visibleCount > 0) {
+		const Range &r = lods[visibleLod];
+		glDrawElementsInstanced(prim, wire ? r.wireCount : r.fillCount,
+				GL_UNSIGNED_SHORT,
+				(const void*) ((wire ? r.wireFirst : r.fillFirst)
+						* sizeof(GLushort)), visibleCount);
+	}
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
@@ -0,0 +1,149 @@
+
+#ifndef GLCORE_H
+#define GLCORE_H
+
+// Core-profile (3.3) GL entry points. Mesa/glvnd's libGL exports them
+// directly, so no loader is needed on Linux.
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <cstddef>
+
+// Compile and link a vertex/fragment program. Errors go to stderr and 0 is
+// returned. 'name' is only used in the error messages. A "Camera" uniform
+// block, if the program declares one, is bound to CAMERA_BLOCK_BINDING.
+GLuint compileProgram(const char *vertexSrc, const char *fragmentSrc,
+		const char *name);
+
+// Program for a GPU culling pass: a compute shader, or a vertex and a
+// geometry shader whose outputs 'varyings' are captured interleaved by
+// transform feedback (no fragment stage). Same error handling as above.
+GLuint compileComputeProgram(const char *computeSrc, const char *name);
+GLuint compileFeedbackProgram(const char *vertexSrc, const char *geometrySrc,
+		const char *const *varyings, int varyingCount, const char *name);
+
+// True if the current context reports at least major.minor.
+bool glVersionAtLeast(int major, int minor);
+
+// Camera uniform block shared by every program:
+//   layout(std140) uniform Camera { mat4 uView; mat4 uProj; vec4 uViewport; };
+// uViewport is (width, height, x, y) of the viewport in pixels.
+enum {
+	CAMERA_BLOCK_BINDING = 0
+};
+
+class CameraBlock {
+public:
+	CameraBlock();
+
+	bool init();
+	void release();
+
+	// view/proj are column-major 4x4 matrices.
+	void update(const float *view, const float *proj, int width, int height,
+			int x = 0, int y = 0);
+
+private:
+	GLuint ubo;
+};
+
+// Per-cone instance data as laid out in the instance VBO.
+struct ConeGpuInstance {
+	float apex[3];
+	float radius;
+	float height;
+	float spinRad;	// spin about the cone axis, radians
+	float vertical;	// 1 = axis along -Y, 0 = axis along +X
+	float pad;
+	float fill[4];
+	float wire[4];
+};
+
+// Vertex shader shared by every cone program. It expands the unit cone
+// (apex at origin, axis +Z, radius and height 1) to an instance and exports
+// the view-space depth as 'vViewZ' and the instance color as 'vColor'.
+extern const char *coneVertexShader;
+
+// Instanced unit cone: one draw call for all fill triangles and one for all
+// wire lines, whatever the number of cones. The mesh exists at several
+// tessellations ("lod" 0 is the finest), all in the same buffers.
+//
+// With culling enabled, cull() tests every uploaded instance against the
+// current camera on the GPU and compacts the visible ones into a second
+// instance buffer, and drawVisible() draws only those. With GL 4.3 this is
+// a compute shader writing the instance counts straight into an indirect
+// draw buffer; otherwise a transform feedback pass does the compaction and
+// the count is read back with a query.
+class ConeBatch {
+public:
+	enum {
+		LODS = 3
+	};
+
+	enum CullMode {
+		CULL_NONE, CULL_FEEDBACK, CULL_COMPUTE
+	};
+
+	ConeBatch();
+
+	// Segments around the rim for each lod
+	bool init(const int (&segments)[LODS]);
+	void release();
+
+	void upload(const ConeGpuInstance *instances, size_t count);
+	// Replaces 'count' of the uploaded instances from 'first' on.
+	void update(const ConeGpuInstance *instances, size_t first, size_t count);
+
+	// 'program' must be built from coneVertexShader; the camera comes from
+	// the CameraBlock.
+	void draw(GLuint program, bool wire, int lod = 0) const;
+
+	size_t instanceCount() const {
+		return count;
+	}
+
+	// GL buffer bytes: mesh, instances and the culling buffers.
+	size_t bytes() const;
+
+	// Picks the best culling mode for the context; false if none works.
+	bool enableCulling();
+	CullMode cullMode() const {
+		return mode;
+	}
+
+	// Uses the CameraBlock for the frustum; 'lod' is the mesh drawVisible()
+	// will use.
+	void cull(int lod);
+	void drawVisible(GLuint program, bool wire) const;
+
+private:
+	struct Range {
+		int fillFirst, fillCount;
+		int wireFirst, wireCount;
+	};
+
+	void bindInstances(GLuint buffer, GLuint divisor) const;
+
+	GLuint vao;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	GLuint instanceBuffer;
+	size_t meshBytes;
+	size_t capacity;
+	size_t count;
+	Range lods[LODS];
+
+	CullMode mode;
+	GLuint cullProgram;
+	GLuint visibleVao;		// the mesh with visibleBuffer as instances
+	GLuint visibleBuffer;
+	size_t visibleCapacity;
+	GLuint indirectBuffer;	// CULL_COMPUTE: fill and wire draw commands
+	GLuint feedbackVao;		// CULL_FEEDBACK: instanceBuffer as points
+	GLuint visibleQuery;
+	GLuint visibleCount;	// CULL_FEEDBACK: read back from visibleQuery
+	int visibleLod;
+};
+
+#endif // GLCORE_H
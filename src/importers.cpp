@@ -0,0 +1,907 @@
+
+#include "importers.h"
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+
+using namespace std;
+using namespace tinyxml2;
+
+static bool hasExtension(const string &filename, const char *ext) {
+
+	size_t n = strlen(ext);
+	if (filename.size() < n)
+		return false;
+	for (size_t i = 0; i < n; ++i) {
+		if (tolower((unsigned char) filename[filename.size() - n + i]) != ext[i])
+			return false;
+	}
+	return true;
+}
+
+// Past a UTF-8 byte order mark
+static const char* skipBOM(const char *p, const char *end) {
+
+	if (end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+		return p + 3;
+	return p;
+}
+
+MapFormat detectFormat(const string &filename, const char *data,
+		size_t size) {
+
+	if (hasExtension(filename, ".mm"))
+		return FORMAT_FREEMIND;
+	if (hasExtension(filename, ".opml"))
+		return FORMAT_OPML;
+	if (hasExtension(filename, ".json"))
+		return FORMAT_JSON;
+	if (hasExtension(filename, ".txt"))
+		return FORMAT_TEXT;
+	if (hasExtension(filename, ".csv") || hasExtension(filename, ".tsv"))
+		return FORMAT_EDGES;
+	if (!data)
+		return FORMAT_FREEMIND;
+
+	const char *end = data + size;
+	const char *p = skipBOM(data, end);
+	while (p < end && isspace((unsigned char) *p))
+		++p;
+	if (p == end)
+		return FORMAT_TEXT;
+	if (*p == '{' || *p == '[')
+		return FORMAT_JSON;
+	if (end - p > 2 && tolower((unsigned char) p[0]) == 'i'
+			&& tolower((unsigned char) p[1]) == 'd'
+			&& (p[2] == ',' || p[2] == '\t'))
+		return FORMAT_EDGES;
+	if (*p != '<')
+		return FORMAT_TEXT;
+	// Past any declaration and comments to the document element
+	const char *sniffEnd = p + min<size_t>(end - p, 4096);
+	static const char opml[] = "<opml";
+	if (search(p, sniffEnd, opml, opml + 5) != sniffEnd)
+		return FORMAT_OPML;
+	return FORMAT_FREEMIND;
+}
+
+const char* formatName(MapFormat format) {
+
+	static const char *names[] = { "FreeMind", "OPML", "JSON", "text",
+			"edge list" };
+	return names[format];
+}
+
+TreeBuilder::TreeBuilder() {
+}
+
+TreeBuilder::~TreeBuilder() {
+
+	for (Node *n : tops)
+		deleteTree(n);
+}
+
+void TreeBuilder::open() {
+
+	Node *n = new Node();
+	if (stack.empty())
+		tops.push_back(n);
+	else
+		stack.back()->children.push_back(n);
+	stack.push_back(n);
+}
+
+void TreeBuilder::close() {
+
+	auto &children = stack.back()->children;
+	reverse(children.begin(), children.end());
+	stack.pop_back();
+}
+
+Node* TreeBuilder::finish(const string &rootLabel) {
+
+	while (!stack.empty())
+		close();
+	if (tops.empty())
+		return nullptr;
+	Node *root = tops[0];
+	if (tops.size() > 1) {
+		root = new Node();
+		root->text = rootLabel;
+		root->children.assign(tops.rbegin(), tops.rend());
+	}
+	tops.clear();
+	return root;
+}
+
+static void importOutlines(const XMLElement *parent, TreeBuilder &builder) {
+
+	for (const XMLElement *o = parent->FirstChildElement("outline"); o;
+			o = o->NextSiblingElement("outline")) {
+		builder.open();
+		for (const XMLAttribute *a = o->FirstAttribute(); a; a = a->Next()) {
+			if (strcmp(a->Name(), "text") == 0)
+				builder.label(a->Value(), strlen(a->Value()));
+			else
+				builder.attribute(a->Name(), a->Value());
+		}
+		importOutlines(o, builder);
+		builder.close();
+	}
+}
+
+bool importOPML(const XMLDocument &doc, TreeBuilder &builder, string &title) {
+
+	const XMLElement *opml = doc.FirstChildElement("opml");
+	const XMLElement *body = opml ? opml->FirstChildElement("body") : nullptr;
+	if (!body) {
+		builder.error = "no <opml><body>";
+		return false;
+	}
+	const XMLElement *head = opml->FirstChildElement("head");
+	const XMLElement *t = head ? head->FirstChildElement("title") : nullptr;
+	if (t && t->GetText())
+		title = t->GetText();
+	importOutlines(body, builder);
+	return true;
+}
+
+// Recursive descent over the bytes, feeding the builder as it goes.
+class JsonReader {
+public:
+	JsonReader(const char *data, size_t size, TreeBuilder &builder) :
+			begin(data), p(data), end(data + size), builder(builder) {
+		p = skipBOM(p, end);
+	}
+
+	bool read() {
+		skipSpace();
+		if (p < end && *p == '[') {
+			if (!nodeArray())
+				return false;
+		} else if (!node()) {
+			return false;
+		}
+		skipSpace();
+		return p == end || fail("unexpected data after the top level");
+	}
+
+private:
+	bool fail(const char *what) {
+		if (builder.error.empty())
+			builder.error = string(what) + " at line "
+					+ to_string(1 + count(begin, p, '\n'));
+		return false;
+	}
+
+	void skipSpace() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+			++p;
+	}
+
+	bool expect(char c) {
+		skipSpace();
+		if (p >= end || *p != c) {
+			string what = "expected '";
+			what += c;
+			return fail((what + "'").c_str());
+		}
+		++p;
+		return true;
+	}
+
+	static int hex(char c) {
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		c |= 0x20;
+		return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+	}
+
+	bool hex4(unsigned &u) {
+		if (end - p < 4)
+			return false;
+		u = 0;
+		for (int i = 0; i < 4; ++i) {
+			int h = hex(p[i]);
+			if (h < 0)
+				return false;
+			u = u << 4 | h;
+		}
+		p += 4;
+		return true;
+	}
+
+	static void appendUTF8(string &out, unsigned u) {
+		if (u < 0x80) {
+			out += (char) u;
+		} else if (u < 0x800) {
+			out += (char) (0xC0 | u >> 6);
+			out += (char) (0x80 | (u & 0x3F));
+		} else if (u < 0x10000) {
+			out += (char) (0xE0 | u >> 12);
+			out += (char) (0x80 | (u >> 6 & 0x3F));
+			out += (char) (0x80 | (u & 0x3F));
+		} else {
+			out += (char) (0xF0 | u >> 18);
+			out += (char) (0x80 | (u >> 12 & 0x3F));
+			out += (char) (0x80 | (u >> 6 & 0x3F));
+			out += (char) (0x80 | (u & 0x3F));
+		}
+	}
+
+	// The string at p ('"') into 'out', unescaped. Strings without escapes
+	// are copied in one go.
+	bool readString(string &out) {
+		const char *start = ++p;
+		while (p < end && *p != '"' && *p != '\\')
+			++p;
+		out.assign(start, p);
+		while (p < end && *p != '"') {
+			if (*p != '\\') {
+				out += *p++;
+				continue;
+			}
+			if (++p >= end)
+				break;
+			char c = *p++;
+			switch (c) {
+			case 'b':
+				out += '\b';
+				break;
+			case 'f':
+				out += '\f';
+				break;
+			case 'n':
+				out += '\n';
+				break;
+			case 'r':
+				out += '\r';
+				break;
+			case 't':
+				out += '\t';
+				break;
+			case 'u': {
+				unsigned u;
+				if (!hex4(u))
+					return fail("bad \\u escape");
+				// A surrogate pair is one code point
+				unsigned low;
+				if (u >= 0xD800 && u < 0xDC00 && end - p >= 6 && p[0] == '\\'
+						&& p[1] == 'u') {
+					p += 2;
+					if (!hex4(low) || low < 0xDC00 || low >= 0xE000)
+						return fail("bad surrogate pair");
+					u = 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUTF8(out, u);
+				break;
+			}
+			default:
+				out += c;
+			}
+		}
+		if (p >= end)
+			return fail("unterminated string");
+		++p;
+		return true;
+	}
+
+	// A number, true or false as its text; null as empty
+	bool readScalar(string &out) {
+		const char *start = p;
+		while (p < end && (isalnum((unsigned char) *p) || *p == '-' || *p == '+'
+				|| *p == '.'))
+			++p;
+		if (p == start)
+			return fail("expected a value");
+		out.assign(start, p);
+		if (out == "null")
+			out.clear();
+		return true;
+	}
+
+	// Past an object or array, strings included, without looking inside
+	bool skipValue() {
+		skipSpace();
+		if (p >= end)
+			return fail("expected a value");
+		if (*p == '"')
+			return readString(scratch);
+		if (*p != '{' && *p != '[')
+			return readScalar(scratch);
+		int depth = 0;
+		do {
+			char c = *p++;
+			if (c == '"') {
+				--p;
+				if (!readString(scratch))
+					return false;
+			} else if (c == '{' || c == '[') {
+				++depth;
+			} else if (c == '}' || c == ']') {
+				--depth;
+			}
+		} while (depth > 0 && p < end);
+		return depth == 0 || fail("unterminated object or array");
+	}
+
+	static int labelRank(const string &key) {
+		static const char *keys[] = { "text", "name", "label", "title" };
+		for (int i = 0; i < 4; ++i) {
+			if (key == keys[i])
+				return i;
+		}
+		return -1;
+	}
+
+	// [ node, node, ... ]; members that are not objects are skipped
+	bool nodeArray() {
+		++p;
+		skipSpace();
+		if (p < end && *p == ']') {
+			++p;
+			return true;
+		}
+		for (;;) {
+			skipSpace();
+			if (p < end && *p == '{') {
+				if (!node())
+					return false;
+			} else if (!skipValue()) {
+				return false;
+			}
+			skipSpace();
+			if (p < end && *p == ',') {
+				++p;
+				continue;
+			}
+			return expect(']');
+		}
+	}
+
+	bool node() {
+		if (!expect('{'))
+			return false;
+		builder.open();
+		int labelFrom = 4;	// rank of the key the label came from
+		skipSpace();
+		if (p < end && *p == '}') {
+			++p;
+			builder.close();
+			return true;
+		}
+		for (;;) {
+			skipSpace();
+			if (p >= end || *p != '"')
+				return fail("expected a member name");
+			if (!readString(key) || !expect(':'))
+				return false;
+			skipSpace();
+			if (p >= end)
+				return fail("expected a value");
+			if (*p == '[' && key == "children") {
+				if (!nodeArray())
+					return false;
+			} else if (*p == '{' || *p == '[') {
+				if (!skipValue())
+					return false;
+			} else {
+				bool quoted = *p == '"';
+				if (!(quoted ? readString(value) : readScalar(value)))
+					return false;
+				int rank = quoted ? labelRank(key) : -1;
+				if (rank >= 0 && rank < labelFrom) {
+					builder.label(value.data(), value.size());
+					labelFrom = rank;
+				} else if (quoted || !value.empty()) {
+					builder.attribute(key, value);
+				}
+			}
+			skipSpace();
+			if (p < end && *p == ',') {
+				++p;
+				continue;
+			}
+			if (!expect('}'))
+				return false;
+			builder.close();
+			return true;
+		}
+	}
+
+	const char *begin, *p, *end;
+	TreeBuilder &builder;
+	string key, value, scratch;
+};
+
+bool importJSON(const char *data, size_t size, TreeBuilder &builder) {
+
+	return JsonReader(data, size, builder).read();
+}
+
+bool importText(const char *data, size_t size, TreeBuilder &builder) {
+
+	const char *end = data + size;
+	const char *p = skipBOM(data, end);
+	vector<int> indents;	// of the open nodes
+	while (p < end) {
+		const char *eol = (const char*) memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		int column = 0;
+		for (; p < eol && (*p == ' ' || *p == '\t'); ++p)
+			column = *p == '\t' ? (column / 4 + 1) * 4 : column + 1;
+		const char *last = eol;
+		while (last > p && isspace((unsigned char) last[-1]))
+			--last;
+		if (last - p >= 2 && (*p == '-' || *p == '*' || *p == '+')
+				&& p[1] == ' ') {
+			p += 2;
+			while (p < last && *p == ' ')
+				++p;
+		}
+		if (p < last) {
+			while (!indents.empty() && indents.back() >= column) {
+				builder.close();
+				indents.pop_back();
+			}
+			builder.open();
+			builder.label(p, last - p);
+			indents.push_back(column);
+		}
+		p = eol + 1;
+	}
+	return true;
+}
+
+// A field of an edge list row, within the input buffer
+struct EdgeField {
+	const char *text;
+	uint32_t length;
+};
+
+// Reads the field at p up to 'delimiter' or the end of the line, CSV
+// quotes unescaped in place, and returns where the next one starts.
+static char* readField(char *p, char *end, char delimiter, EdgeField &field,
+		bool &lineEnd) {
+
+	if (p < end && *p == '"') {
+		char *out = ++p;
+		field.text = out;
+		while (p < end) {
+			if (*p == '"') {
+				if (p + 1 < end && p[1] == '"') {
+					*out++ = '"';
+					p += 2;
+					continue;
+				}
+				++p;
+				break;
+			}
+			*out++ = *p++;
+		}
+		field.length = out - field.text;
+		while (p < end && *p != delimiter && *p != '\n')
+			++p;
+	} else {
+		field.text = p;
+		while (p < end && *p != delimiter && *p != '\n')
+			++p;
+		const char *last = p;
+		if (last > field.text && last[-1] == '\r')
+			--last;
+		field.length = last - field.text;
+	}
+	lineEnd = p >= end || *p == '\n';
+	return p < end ? p + 1 : p;
+}
+
+static bool sameField(const EdgeField &a, const EdgeField &b) {
+
+	return a.length == b.length && memcmp(a.text, b.text, a.length) == 0;
+}
+
+// FNV-1a
+static uint64_t hashField(const EdgeField &f) {
+
+	uint64_t h = 14695981039346656037ull;
+	for (uint32_t i = 0; i < f.length; ++i)
+		h = (h ^ (unsigned char) f.text[i]) * 1099511628211ull;
+	return h ^ (h >> 29);
+}
+
+bool importEdgeList(char *data, size_t size, TreeBuilder &builder) {
+
+	char *end = data + size;
+	char *p = data + (skipBOM(data, end) - data);
+	const char *firstEol = (const char*) memchr(p, '\n', end - p);
+	char delimiter =
+			memchr(p, '\t', (firstEol ? firstEol : end) - p) ? '\t' : ',';
+	auto lineOf = [&](const char *at) {
+		return to_string(1 + count((const char*) data, at, '\n'));
+	};
+
+	// One pass over the rows: the first three fields of each, and any
+	// further ones in 'extras'
+	struct Row {
+		EdgeField id, parent, label;
+		uint32_t extra, extraCount;
+	};
+	vector<Row> rows;
+	vector<EdgeField> extras;
+	vector<string> columns;		// header names of the extra fields
+	bool header = false;
+	rows.reserve(size / 32);
+	while (p < end) {
+		Row row = { { p, 0 }, { p, 0 }, { p, 0 }, (uint32_t) extras.size(), 0 };
+		bool lineEnd = false;
+		EdgeField f;
+		for (int column = 0; !lineEnd; ++column) {
+			p = readField(p, end, delimiter, f, lineEnd);
+			if (column == 0)
+				row.id = f;
+			else if (column == 1)
+				row.parent = f;
+			else if (column == 2)
+				row.label = f;
+			else {
+				extras.push_back(f);
+				row.extraCount++;
+			}
+		}
+		if (row.id.length == 0 && row.extraCount == 0
+				&& row.parent.length == 0)
+			continue;	// blank line
+		if (rows.empty() && !header && row.id.length == 2
+				&& tolower((unsigned char) row.id.text[0]) == 'i'
+				&& tolower((unsigned char) row.id.text[1]) == 'd') {
+			header = true;
+			for (uint32_t i = 0; i < row.extraCount; ++i)
+				columns.emplace_back(extras[row.extra + i].text,
+						extras[row.extra + i].length);
+			extras.clear();
+			continue;
+		}
+		rows.push_back(row);
+	}
+	if (rows.size() >= UINT32_MAX) {
+		builder.error = "too many rows";
+		return false;
+	}
+	uint32_t n = rows.size();
+
+	// Ids into an open-addressing table of row numbers + 1, at most half full
+	size_t capacity = 16;
+	while (capacity < (size_t) n * 2)
+		capacity *= 2;
+	size_t mask = capacity - 1;
+	vector<uint32_t> slots(capacity, 0);
+	for (uint32_t i = 0; i < n; ++i) {
+		size_t s = hashField(rows[i].id) & mask;
+		while (slots[s]) {
+			if (sameField(rows[slots[s] - 1].id, rows[i].id)) {
+				builder.error = "duplicate id \""
+						+ string(rows[i].id.text, rows[i].id.length)
+						+ "\" at line " + lineOf(rows[i].id.text);
+				return false;
+			}
+			s = (s + 1) & mask;
+		}
+		slots[s] = i + 1;
+	}
+
+	// Parent row numbers; n for the roots
+	vector<uint32_t> parent(n);
+	for (uint32_t i = 0; i < n; ++i) {
+		const EdgeField &id = rows[i].parent;
+		if (id.length == 0) {
+			parent[i] = n;
+			continue;
+		}
+		size_t s = hashField(id) & mask;
+		while (slots[s] && !sameField(rows[slots[s] - 1].id, id))
+			s = (s + 1) & mask;
+		if (!slots[s]) {
+			builder.error = "unknown parent \"" + string(id.text, id.length)
+					+ "\" at line " + lineOf(id.text);
+			return false;
+		}
+		parent[i] = slots[s] - 1;
+	}
+	vector<uint32_t>().swap(slots);
+
+	// Counting sort by parent: the children of row k are
+	// order[first[k], first[k + 1]), in input order; the roots come last.
+	vector<uint32_t> first(n + 2, 0);
+	for (uint32_t i = 0; i < n; ++i)
+		first[parent[i] + 1]++;
+	for (uint32_t k = 0; k <= n; ++k)
+		first[k + 1] += first[k];
+	vector<uint32_t> order(n);
+	{
+		vector<uint32_t> next(first.begin(), first.end() - 1);
+		for (uint32_t i = 0; i < n; ++i)
+			order[next[parent[i]]++] = i;
+	}
+
+	// Nodes in pre-order from the roots, so subtrees sit together in
+	// memory. Rows not reached hang off a cycle.
+	vector<Node*> nodes(n, nullptr);
+	vector<uint32_t> stack(order.begin() + first[n], order.end());
+	reverse(stack.begin(), stack.end());
+	uint32_t reached = 0;
+	while (!stack.empty()) {
+		uint32_t r = stack.back();
+		stack.pop_back();
+		const Row &row = rows[r];
+		Node *node = new Node();
+		node->text.assign(row.label.text, row.label.length);
+		for (uint32_t i = 0; i < row.extraCount; ++i) {
+			const EdgeField &f = extras[row.extra + i];
+			node->attributes.emplace_back(
+					i < columns.size() ?
+							columns[i] : "column " + to_string(i + 4),
+					string(f.text, f.length));
+		}
+		nodes[r] = node;
+		reached++;
+		for (uint32_t j = first[r + 1]; j-- > first[r];)
+			stack.push_back(order[j]);
+	}
+	if (reached < n) {
+		// Walk up from an unreached row until a row repeats
+		uint32_t r = 0;
+		while (nodes[r])
+			++r;
+		vector<bool> seen(n, false);
+		while (!seen[r]) {
+			seen[r] = true;
+			r = parent[r];
+		}
+		builder.error = "cycle through id \""
+				+ string(rows[r].id.text, rows[r].id.length) + "\" at line "
+				+ lineOf(rows[r].id.text);
+		for (Node *node : nodes)
+			delete node;
+		return false;
+	}
+
+	// Child lists sized once, last-to-first
+	for (uint32_t k = 0; k < n; ++k) {
+		uint32_t count = first[k + 1] - first[k];
+		if (count == 0)
+			continue;
+		auto &children = nodes[k]->children;
+		children.reserve(count);
+		for (uint32_t j = first[k + 1]; j-- > first[k];)
+			children.push_back(nodes[order[j]]);
+	}
+	for (uint32_t j = first[n]; j < first[n + 1]; ++j)
+		builder.add(nodes[order[j]]);
+	return true;
+}
+
+FreeMindReader::FreeMindReader(TreeBuilder &builder) :
+		builder(builder), depth(0), rootRead(false), failed(false), offset(0) {
+}
+
+bool FreeMindReader::fail(const string &what) {
+
+	if (!failed)
+		builder.error = what + " at byte " + to_string(offset);
+	failed = true;
+	return false;
+}
+
+bool FreeMindReader::feed(const char *data, size_t size) {
+
+	if (failed)
+		return false;
+	const char *end = data + size;
+	// The token carried over ends at one of the next '>'s.
+	while (!carry.empty() && data < end) {
+		const char *gt = (const char*) memchr(data, '>', end - data);
+		const char *upto = gt ? gt + 1 : end;
+		carry.append(data, upto);
+		data = upto;
+		const char *rest = tokens(carry.data(), carry.data() + carry.size());
+		if (!rest)
+			return false;
+		carry.erase(0, rest - carry.data());
+	}
+	const char *rest = tokens(data, end);
+	if (!rest)
+		return false;
+	carry.append(rest, end);
+	return true;
+}
+
+bool FreeMindReader::finish() {
+
+	if (failed)
+		return false;
+	if (!carry.empty())
+		return fail("the map ends inside a tag");
+	if (depth > 0)
+		return fail("the map ends inside <" + open[depth - 1].name + ">");
+	return true;
+}
+
+// Where 'pattern' ends, from 'p' on; null if not before 'end'
+static const char* pastPattern(const char *p, const char *end,
+		const char *pattern) {
+
+	size_t n = strlen(pattern);
+	const char *at = search(p, end, pattern, pattern + n);
+	return at == end ? nullptr : at + n;
+}
+
+// Reads the complete tokens in [p, end) and returns where an incomplete
+// one starts (end if there is none); null on an error.
+const char* FreeMindReader::tokens(const char *p, const char *end) {
+
+	while (p < end) {
+		if (*p != '<') {
+			const char *lt = (const char*) memchr(p, '<', end - p);
+			const char *text = lt ? lt : end;
+			offset += text - p;
+			p = text;
+			continue;
+		}
+		if (end - p < 4)
+			break;
+		const char *past = nullptr;
+		if (p[1] == '?') {
+			past = pastPattern(p + 2, end, "?>");
+		} else if (p[1] == '!' && p[2] == '-' && p[3] == '-') {
+			past = pastPattern(p + 4, end, "-->");
+		} else if (p[1] == '!') {
+			if (end - p < 9)
+				break;
+			if (memcmp(p, "<![CDATA[", 9) == 0) {
+				past = pastPattern(p + 9, end, "]]>");
+			} else {
+				// <!DOCTYPE ...>, with any internal subset in brackets
+				int brackets = 0;
+				for (const char *q = p + 2; q < end && !past; ++q) {
+					if (*q == '[')
+						brackets++;
+					else if (*q == ']')
+						brackets--;
+					else if (*q == '>' && brackets <= 0)
+						past = q + 1;
+				}
+			}
+		} else {
+			// A tag ends at the first '>' outside quotes.
+			char quote = 0;
+			for (const char *q = p + 1; q < end && !past; ++q) {
+				if (quote) {
+					if (*q == quote)
+						quote = 0;
+				} else if (*q == '"' || *q == '\'') {
+					quote = *q;
+				} else if (*q == '>') {
+					past = q + 1;
+				}
+			}
+			if (past && !tag(p, past))
+				return nullptr;
+		}
+		if (!past)
+			break;
+		offset += past - p;
+		p = past;
+	}
+	return p;
+}
+
+static bool isNameEnd(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '/'
+			|| c == '>';
+}
+
+static const char* skipBlanks(const char *p, const char *end) {
+
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		++p;
+	return p;
+}
+
+// One start or end tag, from its '<' to past its '>'
+bool FreeMindReader::tag(const char *p, const char *end) {
+
+	const char *q = p + 1;
+	bool closing = *q == '/';
+	if (closing)
+		++q;
+	const char *tagName = q;
+	while (q < end && !isNameEnd(*q))
+		++q;
+	size_t nameLength = q - tagName;
+	if (nameLength == 0)
+		return fail("a tag without a name");
+	if (closing) {
+		if (depth == 0
+				|| open[depth - 1].name.compare(0, string::npos, tagName,
+						nameLength) != 0)
+			return fail("</" + string(tagName, nameLength)
+					+ "> closes no open element");
+		if (open[--depth].built)
+			builder.close();
+		return true;
+	}
+
+	// Nodes are built from the first one in <map> down; attributes are
+	// read only for those.
+	bool isNode = nameLength == 4 && memcmp(tagName, "node", 4) == 0;
+	bool built = isNode
+			&& ((depth > 0 && open[depth - 1].built)
+					|| (!rootRead && depth == 1 && open[0].name == "map"));
+	bool isAttribute = nameLength == 9 && memcmp(tagName, "attribute", 9) == 0
+			&& depth > 0 && open[depth - 1].built;
+	if (built) {
+		builder.open();
+		rootRead = true;
+	}
+	if (built || isAttribute) {
+		bool hasName = false, hasValue = false;
+		for (;;) {
+			q = skipBlanks(q, end);
+			if (q >= end || *q == '/' || *q == '>')
+				break;
+			const char *key = q;
+			while (q < end && *q != '=' && !isNameEnd(*q))
+				++q;
+			size_t keyLength = q - key;
+			q = skipBlanks(q, end);
+			if (q >= end || *q != '=')
+				return fail("an attribute without a value");
+			q = skipBlanks(q + 1, end);
+			char quote = q < end ? *q : 0;
+			if (quote != '"' && quote != '\'')
+				return fail("an attribute value without quotes");
+			const char *v = ++q;
+			q = (const char*) memchr(q, quote, end - q);
+			if (!q)
+				return fail("an attribute value without its closing quote");
+			size_t length = q - v;
+			++q;
+			if (built) {
+				if (keyLength == 4 && memcmp(key, "TEXT", 4) == 0)
+					builder.rawLabel(v, length);
+				continue;
+			}
+			string *target = nullptr;
+			if (keyLength == 4 && memcmp(key, "NAME", 4) == 0) {
+				target = &name;
+				hasName = true;
+			} else if (keyLength == 5 && memcmp(key, "VALUE", 5) == 0) {
+				target = &value;
+				hasValue = true;
+			}
+			if (target) {
+				target->assign(v, length);
+				char *b = &(*target)[0];
+				char *e = XMLUtil::TranslateText(b, b + length,
+						StrPair::ATTRIBUTE_VALUE);
+				target->resize(e - b);
+			}
+		}
+		if (hasName && hasValue)
+			builder.attribute(name, value);
+	}
+
+	if (end[-2] == '/') {
+		if (built)
+			builder.close();
+	} else {
+		if (open.size() == depth)
+			open.emplace_back();
+		open[depth].name.assign(tagName, nameLength);
+		open[depth].built = built;
+		depth++;
+	}
+	return true;
+}
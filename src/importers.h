@@ -0,0 +1,138 @@
+
+#ifndef IMPORTERS_H
+#define IMPORTERS_H
+
+#include "conetree.h"
+#include "tinyxml2.h"
+#include <vector>
+#include <string>
+
+// Hierarchies in other formats than FreeMind's. Each importer streams its
+// input into one TreeBuilder, which makes the Nodes as they are read; edge
+// lists, whose rows come in any order, hand it whole trees instead.
+enum MapFormat {
+	FORMAT_FREEMIND,	// .mm, read by parseMM()
+	FORMAT_OPML,		// <opml><body><outline text=...>
+	FORMAT_JSON,		// {"text": ..., "children": [...]}, see importJSON()
+	FORMAT_TEXT,		// one node per line, nested by indentation
+	FORMAT_EDGES		// id,parent_id,label rows (.csv, .tsv)
+};
+
+// By extension (.mm, .opml, .json, .txt, .csv, .tsv), otherwise by the
+// first bytes of 'data' (which may be null).
+MapFormat detectFormat(const std::string &filename, const char *data,
+		size_t size);
+
+const char* formatName(MapFormat format);
+
+// Builds the tree in document order: open() starts a child of the node
+// being built (or a top-level node), close() ends it. Children are stored
+// last-to-first like parseMM() does, by reversing each list once it is
+// complete. Several top-level nodes get a common root from finish().
+class TreeBuilder {
+public:
+	TreeBuilder();
+	~TreeBuilder();
+
+	void open();
+	void label(const char *text, size_t length) {
+		stack.back()->text.assign(text, length);
+	}
+	// Still with its entities, as in XML (see Node::label())
+	void rawLabel(const char *text, size_t length) {
+		stack.back()->text.assign(text, length);
+		stack.back()->rawText = needsTranslation(text, length);
+		stack.back()->textAsRead = true;
+	}
+	void attribute(std::string name, std::string value) {
+		stack.back()->attributes.emplace_back(std::move(name), std::move(value));
+	}
+	void close();
+
+	// A finished top-level tree, between open()/close() pairs
+	void add(Node *top) {
+		tops.push_back(top);
+	}
+
+	int depth() const {
+		return stack.size();
+	}
+	size_t topLevel() const {
+		return tops.size();
+	}
+
+	// The root, owned by the caller from then on; null if nothing was
+	// read. 'rootLabel' names the root made for several top-level nodes.
+	Node* finish(const std::string &rootLabel);
+
+	// Importers report where the input went wrong here.
+	std::string error;
+
+private:
+	std::vector<Node*> stack;
+	std::vector<Node*> tops;
+};
+
+// <outline> elements under <body>; 'text' is the label and every other
+// attribute a Node attribute. The head's <title> names a common root.
+bool importOPML(const tinyxml2::XMLDocument &doc, TreeBuilder &builder,
+		std::string &title);
+
+// A single pass over the bytes, without a DOM. A node is an object whose
+// label is its "text", "name", "label" or "title" member and whose
+// children are the objects in its "children" array; other members with
+// scalar values become attributes, and the rest is skipped. The top level
+// is one node or an array of them.
+bool importJSON(const char *data, size_t size, TreeBuilder &builder);
+
+// One node per non-blank line. A line indented deeper than the one before
+// is its child (a tab counts as 4 columns); a leading "- ", "* " or "+ "
+// bullet is dropped.
+bool importText(const char *data, size_t size, TreeBuilder &builder);
+
+// Rows of id, parent id and label, in any order, separated by commas or
+// (if the first line has a tab) tabs, with CSV quoting; parsed in place,
+// so quoted fields are unescaped within 'data'. An empty parent id makes a
+// root. A first line starting with an "id" column is a header, whose
+// names label any further columns, which become attributes. Duplicate or
+// unknown ids and cycles are errors.
+bool importEdgeList(char *data, size_t size, TreeBuilder &builder);
+
+// A FreeMind map handed over a chunk at a time, as a Decompressor produces
+// it, and read without a DOM: a tokenizer for the XML in .mm files
+// (elements, attributes, text, comments, CDATA, declarations) that builds
+// the nodes as their tags go by. Like parseMM(), it takes the first <node>
+// of <map>, with the NAME and VALUE of its <attribute> children, and keeps
+// labels raw. A tag split between chunks is carried over to the next one,
+// so chunks may end anywhere; text outside tags is skipped as it comes.
+class FreeMindReader {
+public:
+	explicit FreeMindReader(TreeBuilder &builder);
+
+	// False, with the builder's error set, once the input is malformed
+	bool feed(const char *data, size_t size);
+
+	// The input ended; false if it ended inside the map.
+	bool finish();
+
+private:
+	struct Element {
+		std::string name;
+		bool built;			// a <node> being built
+	};
+
+	const char* tokens(const char *p, const char *end);
+	bool tag(const char *p, const char *end);
+	bool fail(const std::string &what);
+
+	TreeBuilder &builder;
+	std::string carry;		// an incomplete token from the chunk before
+	std::vector<Element> open;
+	size_t depth;			// elements in 'open' still open
+	bool rootRead;
+	bool failed;
+	size_t offset;			// of the chunk being read, in the whole input
+	std::string name, value;
+};
+
+#endif // IMPORTERS_H
@@ -0,0 +1,158 @@
+#include "inputlog.h"
+#include <cstring>
+
+using namespace std;
+
+static const char magic[] = "CTINPUT1";
+
+// Fields are small and mostly positive; zigzag keeps negative ones short.
+static unsigned long long zigzag(int v) {
+	return ((unsigned long long) (unsigned) v << 1) ^ (v < 0 ? ~0ULL : 0ULL);
+}
+
+static int unzigzag(unsigned long long v) {
+	return (int) ((v >> 1) ^ (~(v & 1) + 1));
+}
+
+InputLog::InputLog() :
+		mapNodes(0), out(nullptr), lastMs(0) {
+}
+
+InputLog::~InputLog() {
+	close();
+}
+
+bool InputLog::record(const string &filename, int nodes) {
+
+	close();
+	out = fopen(filename.c_str(), "wb");
+	if (!out)
+		return false;
+	fwrite(magic, 1, 8, out);
+	put(zigzag(nodes));
+	lastMs = 0;
+	return true;
+}
+
+void InputLog::put(unsigned long long value) {
+
+	unsigned char bytes[10];
+	int n = 0;
+	do {
+		unsigned char b = value & 0x7F;
+		value >>= 7;
+		bytes[n++] = value ? (b | 0x80) : b;
+	} while (value);
+	fwrite(bytes, 1, n, out);
+}
+
+void InputLog::add(InputEvent::Type type, unsigned ms, int a, int b, int c,
+		int d) {
+
+	if (!out)
+		return;
+	fputc(type, out);
+	put(ms >= lastMs ? ms - lastMs : 0);
+	lastMs = ms;
+	switch (type) {
+	case InputEvent::MOUSE:
+	case InputEvent::FRAME:
+		put(zigzag(a));
+		put(zigzag(b));
+		put(zigzag(c));
+		put(zigzag(d));
+		break;
+	case InputEvent::KEY:
+	case InputEvent::SPECIAL:
+		put(zigzag(a));
+		put(zigzag(c));
+		put(zigzag(d));
+		break;
+	case InputEvent::MOTION:
+	case InputEvent::RESHAPE:
+		put(zigzag(c));
+		put(zigzag(d));
+		break;
+	default:
+		break;
+	}
+}
+
+void InputLog::close() {
+
+	if (out)
+		fclose(out);
+	out = nullptr;
+}
+
+bool InputLog::read(const string &filename) {
+
+	FILE *in = fopen(filename.c_str(), "rb");
+	if (!in)
+		return false;
+	vector<unsigned char> data;
+	unsigned char buffer[1 << 16];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		data.insert(data.end(), buffer, buffer + n);
+	fclose(in);
+
+	const unsigned char *p = data.data(), *end = p + data.size();
+	bool ok = true;
+	auto get = [&]() -> unsigned long long {
+		unsigned long long v = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (p == end) {
+				ok = false;
+				return 0;
+			}
+			unsigned char b = *p++;
+			v |= (unsigned long long) (b & 0x7F) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+		ok = false;
+		return v;
+	};
+	if (data.size() < 8 || memcmp(p, magic, 8) != 0)
+		return false;
+	p += 8;
+	mapNodes = unzigzag(get());
+
+	events.clear();
+	unsigned ms = 0;
+	while (ok && p < end) {
+		InputEvent e = { InputEvent::TYPES, 0, 0, 0, 0, 0 };
+		if (*p >= InputEvent::TYPES)
+			return false;
+		e.type = (InputEvent::Type) *p++;
+		ms += get();
+		e.ms = ms;
+		switch (e.type) {
+		case InputEvent::MOUSE:
+		case InputEvent::FRAME:
+			e.a = unzigzag(get());
+			e.b = unzigzag(get());
+			e.c = unzigzag(get());
+			e.d = unzigzag(get());
+			break;
+		case InputEvent::KEY:
+		case InputEvent::SPECIAL:
+			e.a = unzigzag(get());
+			e.c = unzigzag(get());
+			e.d = unzigzag(get());
+			break;
+		case InputEvent::MOTION:
+		case InputEvent::RESHAPE:
+			e.c = unzigzag(get());
+			e.d = unzigzag(get());
+			break;
+		default:
+			break;
+		}
+		if (ok)
+			events.push_back(e);
+	}
+	// A log cut short by a crash still replays up to its last whole event.
+	return true;
+}
@@ -0,0 +1,63 @@
+
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+
+// One GLUT callback as the viewer got it, 'ms' after GLUT started.
+//   MOUSE    button, state, x, y
+//   MOTION   x, y (in c, d)
+//   KEY      key, x, y (in a, c, d)
+//   TICK     the 20 ms timer
+//   RESHAPE  width, height (in c, d)
+//   FRAME    quality level, cones drawn, nodes drawn, microseconds taken
+//   SPECIAL  GLUT_KEY_*, x, y (in a, c, d)
+// Frames are logged with what they showed so that a replay can draw the
+// same frames and tell where it no longer does.
+struct InputEvent {
+	enum Type {
+		MOUSE, MOTION, KEY, TICK, RESHAPE, FRAME, SPECIAL, TYPES
+	};
+	Type type;
+	unsigned ms;
+	int a, b, c, d;
+};
+
+// --record and --replay files: a header with the number of nodes in the
+// map, then each event as its type byte, the milliseconds since the one
+// before and its fields, as variable-length integers (a few bytes per
+// event). Recording writes through a buffer as events come.
+class InputLog {
+public:
+	InputLog();
+	~InputLog();
+
+	// Starts writing to 'filename'; false if it cannot be created.
+	bool record(const std::string &filename, int mapNodes);
+
+	bool recording() const {
+		return out != nullptr;
+	}
+
+	void add(InputEvent::Type type, unsigned ms, int a = 0, int b = 0,
+			int c = 0, int d = 0);
+
+	// Flushes and closes the file being written.
+	void close();
+
+	// Reads a whole log into 'events'; false if it is not one.
+	bool read(const std::string &filename);
+
+	std::vector<InputEvent> events;
+	int mapNodes;
+
+private:
+	void put(unsigned long long value);
+
+	FILE *out;
+	unsigned lastMs;
+};
+
+#endif // INPUTLOG_H
@@ -0,0 +1,146 @@
+
+#include "journal.h"
+#include "memreport.h"
+#include <algorithm>
+
+using namespace std;
+
+static void unlink(Node *parent, unsigned slot) {
+
+	parent->children.erase(parent->children.begin() + slot);
+}
+
+static void link(Node *parent, unsigned slot, Node *node) {
+
+	parent->children.insert(parent->children.begin() + slot, node);
+}
+
+static unsigned slotOf(const Node *parent, const Node *child) {
+
+	const auto &c = parent->children;
+	return find(c.begin(), c.end(), child) - c.begin();
+}
+
+// Applies 'edit' forward, or backward when undoing it. A rename swaps the
+// labels, so the edit then holds the one to go back to.
+static void apply(Edit &edit, bool forward) {
+
+	if (edit.kind == Edit::RENAME) {
+		swap(edit.node->text, edit.text);
+		swap(edit.node->rawText, edit.rawText);
+		swap(edit.node->textAsRead, edit.textAsRead);
+		return;
+	}
+	const vector<Node*> &from = forward ? edit.from : edit.to;
+	const vector<Node*> &to = forward ? edit.to : edit.from;
+	if (!from.empty())
+		unlink(from.back(), forward ? edit.fromSlot : edit.toSlot);
+	if (!to.empty())
+		link(to.back(), forward ? edit.toSlot : edit.fromSlot, edit.node);
+}
+
+EditJournal::EditJournal(size_t limit) :
+		limit(limit) {
+}
+
+EditJournal::~EditJournal() {
+	clear();
+}
+
+void EditJournal::rename(Node *node, const string &text) {
+
+	Edit e = { Edit::RENAME, node, { }, { }, 0, 0, text, false, false };
+	apply(e, true);
+	record(e);
+}
+
+void EditJournal::insert(const vector<Node*> &parent, Node *child,
+		unsigned slot) {
+
+	Edit e = { Edit::RELINK, child, { }, parent, 0, slot, string(), false,
+			false };
+	apply(e, true);
+	record(e);
+}
+
+void EditJournal::remove(const vector<Node*> &parent, Node *child) {
+
+	Edit e = { Edit::RELINK, child, parent, { }, slotOf(parent.back(), child),
+			0, string(), false, false };
+	apply(e, true);
+	record(e);
+}
+
+void EditJournal::move(const vector<Node*> &from, Node *child,
+		const vector<Node*> &to, unsigned slot) {
+
+	Edit e = { Edit::RELINK, child, from, to, slotOf(from.back(), child), slot,
+			string(), false, false };
+	apply(e, true);
+	record(e);
+}
+
+const Edit* EditJournal::undo() {
+
+	if (done.empty())
+		return nullptr;
+	undone.push_back(done.back());
+	done.pop_back();
+	apply(undone.back(), false);
+	return &undone.back();
+}
+
+const Edit* EditJournal::redo() {
+
+	if (undone.empty())
+		return nullptr;
+	done.push_back(undone.back());
+	undone.pop_back();
+	apply(done.back(), true);
+	return &done.back();
+}
+
+void EditJournal::record(const Edit &edit) {
+
+	for (const Edit &e : undone)
+		drop(e, false);
+	undone.clear();
+	done.push_back(edit);
+	if (done.size() > limit) {
+		drop(done.front(), true);
+		done.pop_front();
+	}
+}
+
+// A node is left detached by an applied deletion or an undone insertion;
+// once that edit is gone nothing can link it back.
+void EditJournal::drop(const Edit &edit, bool applied) {
+
+	if (edit.kind == Edit::RELINK && (applied ? edit.to : edit.from).empty())
+		deleteTree(edit.node);
+}
+
+void EditJournal::clear() {
+
+	for (const Edit &e : done)
+		drop(e, true);
+	for (const Edit &e : undone)
+		drop(e, false);
+	done.clear();
+	undone.clear();
+}
+
+static size_t editBytes(const Edit &e) {
+
+	return vectorBytes(e.from) + vectorBytes(e.to) + stringHeapBytes(e.text);
+}
+
+size_t EditJournal::memoryBytes() const {
+
+	size_t bytes = vectorBytes(undone) + done.size() * sizeof(Edit);
+	for (const Edit &e : done)
+		bytes += editBytes(e);
+	for (const Edit &e : undone)
+		bytes += editBytes(e);
+	return bytes;
+}
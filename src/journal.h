@@ -0,0 +1,71 @@
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "conetree.h"
+#include <deque>
+#include <vector>
+#include <string>
+
+// One recorded edit, applicable in either direction. Inserting, deleting
+// and moving a subtree all relink one node: from the child slot 'fromSlot'
+// of from.back() to the slot 'toSlot' of to.back(). Parents are kept as
+// their paths from the root, which stay valid while the history is
+// replayed in order and tell the caller what to lay out again; an empty
+// path means detached. A rename keeps the label on the other side.
+struct Edit {
+	enum Kind {
+		RENAME, RELINK
+	};
+	Kind kind;
+	Node *node;
+	std::vector<Node*> from, to;	// RELINK
+	unsigned fromSlot, toSlot;		// indices into Node::children
+	std::string text;				// RENAME
+	bool rawText, textAsRead;
+};
+
+// Undo/redo for edits of the Node tree. Edits are recorded as their small
+// Edit, never as copies of the tree: a deleted subtree stays allocated,
+// detached, and undoing the deletion links the same nodes back. The journal
+// owns the detached subtrees and frees them when the edit holding them is
+// dropped (past 'limit' edits, or by a new edit clearing the redo side).
+class EditJournal {
+public:
+	explicit EditJournal(size_t limit = 1000);
+	~EditJournal();
+
+	// Apply an edit and record it. Parents are given by their paths from
+	// the root; slots are indices into Node::children.
+	void rename(Node *node, const std::string &text);
+	void insert(const std::vector<Node*> &parent, Node *child, unsigned slot);
+	void remove(const std::vector<Node*> &parent, Node *child);
+	void move(const std::vector<Node*> &from, Node *child,
+			const std::vector<Node*> &to, unsigned slot);
+
+	// Reverts or reapplies one edit and returns it, so the caller can lay
+	// out again under its parents; null when there is nothing to do.
+	// Undoing a relink moves the node back from 'to' to 'from'.
+	const Edit* undo();
+	const Edit* redo();
+
+	// Forgets every edit, as when the tree is replaced.
+	void clear();
+
+	size_t edits() const {
+		return done.size();
+	}
+
+	// Heap bytes of the recorded edits, not counting detached subtrees.
+	size_t memoryBytes() const;
+
+private:
+	void record(const Edit &edit);
+	void drop(const Edit &edit, bool applied);
+
+	size_t limit;
+	std::deque<Edit> done;
+	std::vector<Edit> undone;
+};
+
+#endif // JOURNAL_H
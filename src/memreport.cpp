@@ -0,0 +1,91 @@
+
+#include "memreport.h"
+#include <iomanip>
+
+using namespace std;
+
+size_t stringHeapBytes(const string &s) {
+
+	// The small-string buffer is as large as the capacity of an empty string.
+	static const size_t inlineCapacity = string().capacity();
+	return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+}
+
+void MemoryReport::add(const string &name, size_t current, size_t peak) {
+
+	entries.push_back( { name, current, peak, current, -1 });
+}
+
+void MemoryReport::addPool(const string &name,
+		const tinyxml2::MemPoolStats &pool) {
+
+	entries.push_back( { name + " (" + to_string(pool.itemSize) + " B items)",
+			pool.currentAllocs * pool.itemSize, pool.maxAllocs * pool.itemSize,
+			pool.blockBytes, (long) pool.untracked });
+}
+
+void MemoryReport::addDocument(const tinyxml2::XMLDocument &doc) {
+
+	addPool("XML element pool", doc.ElementPoolStats());
+	addPool("XML attribute pool", doc.AttributePoolStats());
+	addPool("XML text pool", doc.TextPoolStats());
+	addPool("XML comment pool", doc.CommentPoolStats());
+	add("XML character buffer", doc.CharBufferSize());
+}
+
+void MemoryReport::addTree(const Node *root) {
+
+	size_t nodes = 0, labels = 0, children = 0, attributes = 0, source = 0;
+	vector<const Node*> stack;
+	if (root)
+		stack.push_back(root);
+	while (!stack.empty()) {
+		const Node *n = stack.back();
+		stack.pop_back();
+
+		nodes += sizeof(Node);
+		labels += stringHeapBytes(n->text);
+		source += stringHeapBytes(n->source);
+		children += vectorBytes(n->children);
+		attributes += vectorBytes(n->attributes);
+		for (const auto &attr : n->attributes)
+			attributes += stringHeapBytes(attr.first)
+					+ stringHeapBytes(attr.second);
+		stack.insert(stack.end(), n->children.begin(), n->children.end());
+	}
+	add("Node structs", nodes);
+	add("label strings", labels);
+	add("child vectors", children);
+	add("attributes", attributes);
+	add("source passthrough", source);
+}
+
+void MemoryReport::print(ostream &out, size_t nodes) const {
+
+	auto row = [&](const MemoryUsage &e) {
+		out << left << setw(44) << e.name << right << setw(14) << e.current
+				<< setw(14) << e.peak << setw(14) << e.reserved << fixed
+				<< setprecision(1) << setw(10)
+				<< (nodes ? (double) e.current / nodes : 0.0) << setw(10)
+				<< (nodes ? (double) e.peak / nodes : 0.0) << setw(11);
+		if (e.untracked >= 0)
+			out << e.untracked;
+		else
+			out << "";
+		out << endl;
+	};
+
+	out << left << setw(44) << "subsystem" << right << setw(14) << "current B"
+			<< setw(14) << "peak B" << setw(14) << "reserved B" << setw(10)
+			<< "cur/node" << setw(10) << "peak/node" << setw(11) << "untracked"
+			<< endl;
+	MemoryUsage total = { "total", 0, 0, 0, -1 };
+	for (const MemoryUsage &e : entries) {
+		row(e);
+		total.current += e.current;
+		total.peak += e.peak;
+		total.reserved += e.reserved;
+	}
+	row(total);
+	out << nodes << " nodes" << endl;
+}
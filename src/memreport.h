@@ -0,0 +1,55 @@
+
+#ifndef MEMREPORT_H
+#define MEMREPORT_H
+
+#include "conetree.h"
+#include "tinyxml2.h"
+#include <vector>
+#include <string>
+#include <iostream>
+
+// --mem-report: current and peak bytes per subsystem, and what it holds
+// from the heap to serve them. Heap figures count what the containers and
+// strings have allocated (capacity, not size), without allocator overhead.
+struct MemoryUsage {
+	std::string name;
+	size_t current;
+	size_t peak;
+	size_t reserved;
+	long untracked;		// a pool's untracked items; -1 for the rest
+};
+
+class MemoryReport {
+public:
+	void add(const std::string &name, size_t current, size_t peak);
+	void add(const std::string &name, size_t bytes) {
+		add(name, bytes, bytes);
+	}
+
+	// A tinyxml2 pool: the items allocated now and at most, and the blocks
+	// holding them, which are kept across XMLDocument::Clear().
+	void addPool(const std::string &name, const tinyxml2::MemPoolStats &pool);
+
+	// The pools and text buffer of a loaded document.
+	void addDocument(const tinyxml2::XMLDocument &doc);
+
+	// Node structs, label strings, child vectors and attributes.
+	void addTree(const Node *root);
+
+	// Table with a bytes-per-node column for 'nodes' nodes.
+	void print(std::ostream &out, size_t nodes) const;
+
+private:
+	std::vector<MemoryUsage> entries;
+};
+
+// Heap bytes of a std::string beyond the object itself (0 while it fits
+// the small-string buffer).
+size_t stringHeapBytes(const std::string &s);
+
+template<class T>
+size_t vectorBytes(const std::vector<T> &v) {
+	return v.capacity() * sizeof(T);
+}
+
+#endif // MEMREPORT_H
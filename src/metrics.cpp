@@ -0,0 +1,285 @@
+
+#include "metrics.h"
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+static bool parseNumber(const string &s, float &out) {
+
+	const char *begin = s.c_str();
+	char *end = nullptr;
+	out = strtof(begin, &end);
+	if (end == begin)
+		return false;
+	while (*end == ' ' || *end == '\t')
+		++end;
+	return *end == '\0';
+}
+
+void colormap(float t, float rgb[3]) {
+
+	// Piecewise linear through five stops of a viridis-like ramp
+	static const float stops[5][3] = { { 0.27f, 0.00f, 0.33f }, { 0.23f, 0.32f,
+			0.55f }, { 0.13f, 0.57f, 0.55f }, { 0.37f, 0.79f, 0.38f }, { 0.99f,
+			0.91f, 0.15f } };
+	t = min(max(t, 0.0f), 1.0f) * 4.0f;
+	int i = min((int) t, 3);
+	float f = t - i;
+	for (int c = 0; c < 3; ++c)
+		rgb[c] = stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f;
+}
+
+TreeMetrics::TreeMetrics() :
+		nodes(0) {
+}
+
+void TreeMetrics::compute(Node *root) {
+
+	// Pre-order: every parent comes before its children, so top-down values
+	// fill forward and bottom-up ones accumulate backward.
+	vector<const Node*> order;
+	vector<int> parent;
+	attributeNames.clear();
+	if (root) {
+		vector<pair<Node*, int>> stack = { { root, -1 } };
+		while (!stack.empty()) {
+			Node *n = stack.back().first;
+			int p = stack.back().second;
+			stack.pop_back();
+
+			n->index = order.size();
+			order.push_back(n);
+			parent.push_back(p);
+			for (const auto &attr : n->attributes) {
+				float v;
+				if (parseNumber(attr.second, v)
+						&& find(attributeNames.begin(), attributeNames.end(),
+								attr.first) == attributeNames.end())
+					attributeNames.push_back(attr.first);
+			}
+			for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+				stack.push_back( { *it, n->index });
+		}
+	}
+	nodes = order.size();
+
+	values.assign(count(), vector<float>());
+	minValue.assign(count(), 0.0f);
+	maxValue.assign(count(), 0.0f);
+
+	auto fill = [&](int metric) {
+		vector<float> &v = values[metric];
+		v.assign(nodes, 0.0f);
+		switch (metric) {
+		case METRIC_DEPTH:
+			for (int i = 1; i < nodes; ++i)
+				v[i] = v[parent[i]] + 1.0f;
+			break;
+		case METRIC_SIZE:
+			for (int i = 0; i < nodes; ++i)
+				v[i] = order[i]->size;
+			break;
+		case METRIC_FANOUT:
+			for (int i = 0; i < nodes; ++i)
+				v[i] = order[i]->children.size();
+			break;
+		case METRIC_LEAVES:
+			for (int i = nodes - 1; i >= 0; --i) {
+				if (order[i]->children.empty())
+					v[i] = 1.0f;
+				if (i > 0)
+					v[parent[i]] += v[i];
+			}
+			break;
+		default: {
+			const string &attrName = attributeNames[metric - METRIC_BUILTIN];
+			for (int i = 0; i < nodes; ++i) {
+				v[i] = NAN;
+				for (const auto &attr : order[i]->attributes) {
+					float x;
+					if (attr.first == attrName && parseNumber(attr.second, x)) {
+						v[i] = x;
+						break;
+					}
+				}
+			}
+			break;
+		}
+		}
+
+		float lo = INFINITY, hi = -INFINITY;
+		for (float x : v) {
+			if (!std::isnan(x)) {
+				lo = min(lo, x);
+				hi = max(hi, x);
+			}
+		}
+		minValue[metric] = lo;
+		maxValue[metric] = hi;
+	};
+
+	// One thread per metric; each writes only its own arrays.
+	vector<thread> workers;
+	for (int m = METRIC_NONE + 1; m < count(); ++m)
+		workers.emplace_back(fill, m);
+	computeSubtreeStats(order, parent);
+	for (auto &w : workers)
+		w.join();
+}
+
+static int fanoutBucket(size_t fanout) {
+
+	int b = 0;
+	while (fanout > 0 && b < FANOUT_BUCKETS - 1) {
+		fanout >>= 1;
+		++b;
+	}
+	return b;
+}
+
+void TreeMetrics::computeSubtreeStats(const vector<const Node*> &order,
+		const vector<int> &parent) {
+
+	stats.assign(nodes, SubtreeStats());
+	auto own = [&](int i) {
+		const Node *n = order[i];
+		SubtreeStats &s = stats[i];
+		s.nodes = 1;
+		s.leaves = n->children.empty() ? 1 : 0;
+		s.labelBytes = n->text.size();
+		s.fanout[fanoutBucket(n->children.size())] = 1;
+	};
+	auto add = [&](int into, int from) {
+		SubtreeStats &s = stats[into];
+		const SubtreeStats &c = stats[from];
+		s.nodes += c.nodes;
+		s.height = max(s.height, c.height + 1);
+		s.leaves += c.leaves;
+		s.labelBytes += c.labelBytes;
+		for (int b = 0; b < FANOUT_BUCKETS; ++b)
+			s.fanout[b] += c.fanout[b];
+	};
+
+	// A subtree is a contiguous pre-order range [i, i + size). Cut the tree
+	// into ranges of at most 'grain' nodes, reduce each range on a worker,
+	// then fold the ranges into the few nodes above them.
+	unsigned threads = max(1u, thread::hardware_concurrency());
+	int grain = max(4096, nodes / (int) (threads * 8));
+	vector<int> boundary;	// ranges and the nodes above them, pre-order
+	vector<int> ranges;
+	vector<int> stack;
+	if (nodes > 0)
+		stack.push_back(0);
+	while (!stack.empty()) {
+		int i = stack.back();
+		stack.pop_back();
+		boundary.push_back(i);
+		if (order[i]->size <= grain) {
+			ranges.push_back(i);
+			continue;
+		}
+		own(i);
+		int child = i + 1, end = i + order[i]->size;
+		size_t first = stack.size();
+		for (; child < end; child += order[child]->size)
+			stack.push_back(child);
+		reverse(stack.begin() + first, stack.end());
+	}
+
+	atomic<size_t> next(0);
+	auto work = [&]() {
+		for (size_t r; (r = next++) < ranges.size();) {
+			int begin = ranges[r], end = begin + order[begin]->size;
+			for (int i = begin; i < end; ++i)
+				own(i);
+			for (int i = end - 1; i > begin; --i)
+				add(parent[i], i);
+		}
+	};
+	vector<thread> workers;
+	for (unsigned t = 1; t < threads && t < ranges.size(); ++t)
+		workers.emplace_back(work);
+	work();
+	for (auto &w : workers)
+		w.join();
+
+	for (auto it = boundary.rbegin(); it != boundary.rend(); ++it) {
+		if (*it > 0)
+			add(parent[*it], *it);
+	}
+}
+
+void TreeMetrics::report(const Node *node, vector<string> &lines) const {
+
+	const SubtreeStats &s = stats[node->index];
+	lines.clear();
+	lines.push_back("Subtree of \"" + node->label() + "\"");
+
+	ostringstream out;
+	out << s.nodes << " nodes, max depth " << s.height << ", " << s.leaves
+			<< " leaves, " << s.labelBytes << " label bytes";
+	lines.push_back(out.str());
+
+	lines.push_back("Fan-out histogram:");
+	for (int b = 0; b < FANOUT_BUCKETS; ++b) {
+		ostringstream row;
+		int lo = b == 0 ? 0 : 1 << (b - 1), hi = b == 0 ? 0 : (1 << b) - 1;
+		if (b == FANOUT_BUCKETS - 1)
+			row << "  " << lo << "+";
+		else if (lo == hi)
+			row << "  " << lo;
+		else
+			row << "  " << lo << "-" << hi;
+		row << ": " << s.fanout[b];
+		lines.push_back(row.str());
+	}
+}
+
+string TreeMetrics::name(int metric) const {
+
+	static const char *builtin[METRIC_BUILTIN] = { "none", "depth",
+			"subtree size", "fan-out", "leaf count" };
+	if (metric < METRIC_BUILTIN)
+		return builtin[metric];
+	return "attribute " + attributeNames[metric - METRIC_BUILTIN];
+}
+
+size_t TreeMetrics::memoryBytes() const {
+
+	size_t bytes = stats.capacity() * sizeof(SubtreeStats)
+			+ attributeNames.capacity() * sizeof(string)
+			+ values.capacity() * sizeof(vector<float>)
+			+ (minValue.capacity() + maxValue.capacity()) * sizeof(float);
+	for (const auto &v : values)
+		bytes += v.capacity() * sizeof(float);
+	return bytes;
+}
+
+void TreeMetrics::colorize(int metric, vector<float> &out) const {
+
+	out.resize(nodes * 3);
+	if (metric <= METRIC_NONE || metric >= count())
+		return;
+
+	// Sizes and leaf counts span orders of magnitude; color them by log.
+	bool logScale = (metric == METRIC_SIZE || metric == METRIC_LEAVES);
+	auto scale = [logScale](float x) {
+		return logScale ? log1pf(x) : x;
+	};
+	const vector<float> &v = values[metric];
+	float lo = scale(minValue[metric]);
+	float range = scale(maxValue[metric]) - lo;
+	for (int i = 0; i < nodes; ++i) {
+		float *rgb = &out[i * 3];
+		if (std::isnan(v[i])) {
+			rgb[0] = rgb[1] = rgb[2] = 0.5f;
+			continue;
+		}
+		colormap(range > 0.0f ? (scale(v[i]) - lo) / range : 0.5f, rgb);
+	}
+}
@@ -0,0 +1,86 @@
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "conetree.h"
+#include <vector>
+#include <string>
+
+// Per-node data for color-by-metric shading. compute() numbers the nodes
+// in pre-order (Node::index) and fills one value array per metric, each on
+// its own thread; colorize() then maps one metric through the colormap
+// without touching the values again.
+//
+// Metrics are the built-in ones below, followed by one per FreeMind
+// attribute name that has a numeric value somewhere in the tree.
+enum {
+	METRIC_NONE = 0,	// the default cone/sphere colors
+	METRIC_DEPTH,
+	METRIC_SIZE,		// Node::size
+	METRIC_FANOUT,
+	METRIC_LEAVES,
+	METRIC_BUILTIN
+};
+
+// Aggregates over a node's subtree (the node included). Fan-out is
+// histogrammed in power-of-two buckets: 0, 1, 2-3, 4-7, ... and the last
+// bucket holds everything above.
+enum {
+	FANOUT_BUCKETS = 8
+};
+
+struct SubtreeStats {
+	int nodes;
+	int height;		// deepest level below the node (0 for a leaf)
+	int leaves;
+	long long labelBytes;	// as stored: labels not yet decoded count raw
+	int fanout[FANOUT_BUCKETS];
+};
+
+class TreeMetrics {
+public:
+	TreeMetrics();
+
+	// 'root' must have its sizes computed (computeSize()). Also builds the
+	// subtree statistics, bottom-up in parallel.
+	void compute(Node *root);
+
+	// O(1) once computed; 'index' is Node::index.
+	const SubtreeStats& subtree(int index) const {
+		return stats[index];
+	}
+
+	// Human-readable summary of subtree(node->index), one line each.
+	void report(const Node *node, std::vector<std::string> &lines) const;
+
+	int count() const {
+		return METRIC_BUILTIN + attributeNames.size();
+	}
+	std::string name(int metric) const;
+
+	// RGB per node index into 'out' (3 floats each). Nodes without a value
+	// (attribute metrics only) are grey.
+	void colorize(int metric, std::vector<float> &out) const;
+
+	int nodeCount() const {
+		return nodes;
+	}
+
+	// Heap bytes held by the value arrays and subtree statistics.
+	size_t memoryBytes() const;
+
+private:
+	void computeSubtreeStats(const std::vector<const Node*> &order,
+			const std::vector<int> &parent);
+
+	int nodes;
+	std::vector<SubtreeStats> stats;
+	std::vector<std::string> attributeNames;
+	std::vector<std::vector<float>> values;	// [metric][node], NaN = none
+	std::vector<float> minValue, maxValue;
+};
+
+// Maps t in [0, 1] to RGB, dark blue through green to yellow.
+void colormap(float t, float rgb[3]);
+
+#endif // METRICS_H
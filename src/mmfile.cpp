@@ -0,0 +1,336 @@
+
+#include "mmfile.h"
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+using namespace std;
+using namespace tinyxml2;
+
+// Past the '>' of the tag starting at p ('<'), skipping quoted values.
+static const char* tagEnd(const char *p, const char *limit) {
+
+	char quote = 0;
+	for (++p; p < limit; ++p) {
+		if (quote) {
+			if (*p == quote)
+				quote = 0;
+		} else if (*p == '"' || *p == '\'') {
+			quote = *p;
+		} else if (*p == '>') {
+			return p + 1;
+		}
+	}
+	return limit;
+}
+
+static bool startsWith(const char *p, const char *limit, const char *prefix) {
+
+	size_t n = strlen(prefix);
+	return (size_t) (limit - p) >= n && memcmp(p, prefix, n) == 0;
+}
+
+static const char* skipPast(const char *p, const char *limit,
+		const char *pattern) {
+
+	size_t n = strlen(pattern);
+	const char *at = search(p, limit, pattern, pattern + n);
+	return at == limit ? limit : at + n;
+}
+
+static const char* findEndTag(const char *p, const char *limit);
+
+// Past the markup starting at p ('<'): a comment, CDATA section,
+// processing instruction or declaration, or an element with its content.
+static const char* skipMarkup(const char *p, const char *limit) {
+
+	if (startsWith(p, limit, "<!--"))
+		return skipPast(p + 4, limit, "-->");
+	if (startsWith(p, limit, "<![CDATA["))
+		return skipPast(p + 9, limit, "]]>");
+	if (startsWith(p, limit, "<?"))
+		return skipPast(p + 2, limit, "?>");
+	const char *q = tagEnd(p, limit);
+	if (p[1] == '!' || (q - p >= 2 && q[-2] == '/'))
+		return q;
+	return tagEnd(findEndTag(q, limit), limit);
+}
+
+// The '<' of the end tag closing the content that starts at p.
+static const char* findEndTag(const char *p, const char *limit) {
+
+	while (p < limit) {
+		p = (const char*) memchr(p, '<', limit - p);
+		if (!p)
+			return limit;
+		if (p + 1 < limit && p[1] == '/')
+			return p;
+		p = skipMarkup(p, limit);
+	}
+	return limit;
+}
+
+static const char* trimEnd(const char *begin, const char *end) {
+
+	while (end > begin && isspace((unsigned char) end[-1]))
+		--end;
+	return end;
+}
+
+SourceCapture::SourceCapture(const char *parsed, const char *pristine,
+		size_t size) :
+		parsed(parsed), pristine(pristine), limit(pristine + size), cursor(
+				pristine) {
+}
+
+const char* SourceCapture::source(const XMLElement *elem) const {
+
+	// An element's name points into the buffer it was parsed in.
+	return pristine + (elem->Name() - parsed);
+}
+
+void SourceCapture::begin(const XMLElement *root, MapEnvelope &envelope) {
+
+	const char *tag = source(root) - 1;
+	envelope.head.assign(pristine, tag);
+	cursor = tag;
+}
+
+void SourceCapture::open(const XMLElement *elem, Node *node) {
+
+	const char *tag = source(elem) - 1;
+	const char *q = tagEnd(tag, limit);
+	bool isOpen = !(q - tag >= 2 && q[-2] == '/');
+	const char *attrs = source(elem) + strlen(elem->Name());
+	const char *attrsEnd = trimEnd(attrs, isOpen ? q - 1 : q - 2);
+
+	// TEXT is written from Node::text; keep everything around it.
+	const char *textBegin = attrsEnd, *textEnd = attrsEnd;
+	const char *p = attrs;
+	while (p < attrsEnd) {
+		const char *space = p;
+		while (p < attrsEnd && isspace((unsigned char) *p))
+			++p;
+		const char *name = p;
+		while (p < attrsEnd && *p != '=' && !isspace((unsigned char) *p))
+			++p;
+		size_t nameLength = p - name;
+		while (p < attrsEnd && *p != '"' && *p != '\'')
+			++p;
+		if (p >= attrsEnd)
+			break;
+		p = find(p + 1, attrsEnd, *p);
+		if (p < attrsEnd)
+			++p;
+		if (nameLength == 4 && memcmp(name, "TEXT", 4) == 0) {
+			textBegin = space;
+			textEnd = p;
+			break;
+		}
+	}
+	node->source.assign(attrs, textBegin);
+	node->source.append(textEnd, attrsEnd);
+	node->textAt = textBegin - attrs;
+	node->sourceSplit = node->source.size();
+
+	cursor = q;
+	openElements.push_back(isOpen);
+}
+
+void SourceCapture::appendContent(Node *node, const char *to) {
+
+	// Content up to a child or the end tag, with its leading whitespace
+	// (the source's line breaks) but not the trailing one
+	const char *end = trimEnd(cursor, to);
+	const char *p = cursor;
+	while (p < end && isspace((unsigned char) *p))
+		++p;
+	if (p < end)
+		node->source.append(cursor, end);
+	cursor = to;
+}
+
+void SourceCapture::child(const XMLElement *elem, Node *node) {
+
+	appendContent(node, source(elem) - 1);
+}
+
+void SourceCapture::close(Node *node) {
+
+	bool isOpen = openElements.back();
+	openElements.pop_back();
+	if (!isOpen)
+		return;
+	const char *endTag = findEndTag(cursor, limit);
+	appendContent(node, endTag);
+	cursor = tagEnd(endTag, limit);
+}
+
+void SourceCapture::end(MapEnvelope &envelope) {
+
+	envelope.tail.assign(cursor, limit);
+}
+
+// XMLPrinter writing FreeMind's layout (one element per line, no
+// indentation) into its own buffer, flushed to a FILE in large writes.
+class MapWriter: public XMLPrinter {
+public:
+	explicit MapWriter(FILE *file) :
+			XMLPrinter(nullptr, false, 1, DONT_ESCAPE_APOS_CHARS_IN_ATTRIBUTES), file(
+					file), failed(false) {
+		buffer.reserve(bufferSize);
+	}
+
+	// Source bytes, inside the open tag or as content
+	void writeRaw(const char *data, size_t size) {
+		Write(data, size);
+	}
+	void pushContent(const char *data, size_t size) {
+		SealElementIfJustOpened();
+		Write(data, size);
+	}
+
+	bool flush() {
+		if (!buffer.empty()
+				&& fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+			failed = true;
+		buffer.clear();
+		return !failed;
+	}
+
+protected:
+	using XMLPrinter::Write;
+
+	void PrintSpace(int) override {
+	}
+
+	void Write(const char *data, size_t size) override {
+		if (buffer.size() + size > bufferSize)
+			flush();
+		if (size > bufferSize) {
+			if (fwrite(data, 1, size, file) != size)
+				failed = true;
+			return;
+		}
+		buffer.insert(buffer.end(), data, data + size);
+	}
+
+	void Putc(char ch) override {
+		if (buffer.size() >= bufferSize)
+			flush();
+		buffer.push_back(ch);
+	}
+
+private:
+	static const size_t bufferSize = 1 << 20;
+
+	FILE *file;
+	vector<char> buffer;
+	bool failed;
+};
+
+// TEXT as it was in the source, entities and all; only quotes need care if
+// the source used single quotes.
+static void writeRawText(MapWriter &out, const char *raw, size_t length) {
+
+	out.writeRaw(" TEXT=\"", 7);
+	const char *end = raw + length, *quote;
+	while ((quote = find(raw, end, '"')) != end) {
+		out.writeRaw(raw, quote - raw);
+		out.writeRaw("&quot;", 6);
+		raw = quote + 1;
+	}
+	out.writeRaw(raw, end - raw);
+	out.writeRaw("\"", 1);
+}
+
+// An edited label. Line breaks, tabs and runs of spaces go out as character
+// references, which every XML reader keeps as they are; attribute value
+// normalization would turn the characters themselves into single spaces.
+static void writeText(MapWriter &out, const string &text) {
+
+	string escaped;
+	escaped.reserve(text.size() + 16);
+	for (size_t i = 0; i < text.size(); ++i) {
+		char c = text[i];
+		switch (c) {
+		case '&':
+			escaped += "&amp;";
+			break;
+		case '<':
+			escaped += "&lt;";
+			break;
+		case '>':
+			escaped += "&gt;";
+			break;
+		case '"':
+			escaped += "&quot;";
+			break;
+		case '\n':
+			escaped += "&#xa;";
+			break;
+		case '\r':
+			escaped += "&#xd;";
+			break;
+		case '\t':
+			escaped += "&#x9;";
+			break;
+		case ' ':
+			escaped += i > 0 && text[i - 1] == ' ' ? "&#x20;" : " ";
+			break;
+		default:
+			escaped += c;
+		}
+	}
+	out.writeRaw(" TEXT=\"", 7);
+	out.writeRaw(escaped.data(), escaped.size());
+	out.writeRaw("\"", 1);
+}
+
+static void writeNode(MapWriter &out, const Node *node) {
+
+	out.OpenElement("node");
+	const string &s = node->source;
+	size_t textEnd = node->textAt;
+	out.writeRaw(s.data(), node->textAt);
+	if (node->rawTextLength > 0)
+		textEnd += node->rawTextLength;
+	if (node->textAsRead && node->rawTextLength > 0)
+		writeRawText(out, s.data() + node->textAt, node->rawTextLength);
+	else if (node->textAsRead)
+		writeRawText(out, node->text.data(), node->text.size());
+	else if (!node->text.empty() || s.empty())
+		writeText(out, node->label());
+	out.writeRaw(s.data() + textEnd, node->sourceSplit - textEnd);
+	if (s.size() > node->sourceSplit)
+		out.pushContent(s.data() + node->sourceSplit,
+				s.size() - node->sourceSplit);
+
+	// Children are kept last-to-first
+	for (auto it = node->children.rbegin(); it != node->children.rend(); ++it)
+		writeNode(out, *it);
+	out.CloseElement();
+}
+
+bool saveMM(const Node *root, const MapEnvelope &envelope,
+		const string &filename) {
+
+	string temp = filename + ".tmp";
+	FILE *file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+	bool ok;
+	{
+		MapWriter out(file);
+		out.writeRaw(envelope.head.data(), envelope.head.size());
+		writeNode(out, root);
+		out.writeRaw(envelope.tail.data(), envelope.tail.size());
+		ok = out.flush();
+	}
+	ok = fclose(file) == 0 && ok;
+	if (ok)
+		ok = rename(temp.c_str(), filename.c_str()) == 0;
+	if (!ok)
+		remove(temp.c_str());
+	return ok;
+}
@@ -0,0 +1,50 @@
+
+#ifndef MMFILE_H
+#define MMFILE_H
+
+#include "conetree.h"
+#include "tinyxml2.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+
+// FreeMind round trip. parseMM() only interprets <node TEXT> and
+// <attribute>; everything else a map holds (IDs, dates, icons, fonts,
+// rich content, ...) is copied from the source bytes into Node::source and
+// MapEnvelope while loading, and written back verbatim by saveMM().
+
+// Follows parseMM() through a document tinyxml2 parsed in place, copying
+// byte ranges from an untouched copy of the same input ('pristine', such
+// as a second mapping of the file): parsing writes terminators into the
+// parsed buffer. Calls must follow document order:
+//   begin(root), then for each <node>: open(), child() before each child
+//   <node> is opened, close(); then end().
+class SourceCapture {
+public:
+	SourceCapture(const char *parsed, const char *pristine, size_t size);
+
+	void begin(const tinyxml2::XMLElement *root, MapEnvelope &envelope);
+	void open(const tinyxml2::XMLElement *elem, Node *node);
+	void child(const tinyxml2::XMLElement *elem, Node *node);
+	void close(Node *node);
+	void end(MapEnvelope &envelope);
+
+private:
+	const char* source(const tinyxml2::XMLElement *elem) const;
+	void appendContent(Node *node, const char *to);
+
+	const char *parsed;
+	const char *pristine;
+	const char *limit;
+	const char *cursor;				// in pristine
+	std::vector<bool> openElements;	// of the <node>s being captured
+};
+
+// Writes the tree through an XMLPrinter that streams into a 1 MB buffer
+// flushed to 'filename' (via a temporary file renamed over it), without
+// building an XMLDocument. Children are written in file order, unknown
+// content before child nodes. Returns false on I/O errors.
+bool saveMM(const Node *root, const MapEnvelope &envelope,
+		const std::string &filename);
+
+#endif // MMFILE_H
@@ -0,0 +1,209 @@
+
+#include "oit.h"
+
+const char *oitFragmentShader = R"(#version 330 core
+in vec4 vColor;
+in float vViewZ;
+
+layout(location = 0) out vec4 oAccum;
+layout(location = 1) out vec4 oWeight;
+
+void main() {
+	float a = vColor.a;
+	float z = abs(vViewZ);
+
+	// McGuire & Bavoil, eq. (7): favors surfaces close to the camera.
+	float w = a * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)),
+			1e-2, 3e3);
+
+	oAccum = vec4(vColor.rgb * a * w, a);
+	oWeight = vec4(a * w);
+}
+)";
+
+static const char *compositeVertexShader = R"(#version 330 core
+void main() {
+	// Full-screen triangle, no vertex buffer needed.
+	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char *compositeFragmentShader = R"(#version 330 core
+uniform sampler2D uAccum;
+uniform sampler2D uWeight;
+
+out vec4 oColor;
+
+void main() {
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	vec4 accum = texelFetch(uAccum, p, 0);
+	float revealage = accum.a;
+	if (revealage >= 1.0)
+		discard;	// nothing translucent covers this pixel
+
+	float weight = texelFetch(uWeight, p, 0).r;
+	oColor = vec4(accum.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
+)";
+
+OitCompositor::OitCompositor() :
+		compositeProgram(0), emptyVao(0), sceneFbo(0), accumFbo(0), sceneColorTex(
+				0), depthTex(0), accumTex(0), weightTex(0), width(0), height(0) {
+}
+
+bool OitCompositor::init() {
+
+	compositeProgram = compileProgram(compositeVertexShader,
+			compositeFragmentShader, "OIT composite");
+	if (!compositeProgram)
+		return false;
+
+	glUseProgram(compositeProgram);
+	glUniform1i(glGetUniformLocation(compositeProgram, "uAccum"), 0);
+	glUniform1i(glGetUniformLocation(compositeProgram, "uWeight"), 1);
+	glUseProgram(0);
+
+	// Core profile refuses draws without a bound VAO, even attribute-less ones.
+	glGenVertexArrays(1, &emptyVao);
+	return true;
+}
+
+void OitCompositor::release() {
+
+	releaseTargets();
+	glDeleteVertexArrays(1, &emptyVao);
+	glDeleteProgram(compositeProgram);
+	emptyVao = 0;
+	compositeProgram = 0;
+}
+
+void OitCompositor::releaseTargets() {
+
+	glDeleteFramebuffers(1, &sceneFbo);
+	glDeleteFramebuffers(1, &accumFbo);
+	GLuint textures[] = { sceneColorTex, depthTex, accumTex, weightTex };
+	glDeleteTextures(4, textures);
+	sceneFbo = accumFbo = 0;
+	sceneColorTex = depthTex = accumTex = weightTex = 0;
+	width = height = 0;
+}
+
+size_t OitCompositor::bytes() const {
+
+	// RGBA8 + depth + RGBA16F + R16F
+	return (size_t) width * height * (4 + 4 + 8 + 2);
+}
+
+static GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type,
+		int width, int height) {
+
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
+			type, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return tex;
+}
+
+void OitCompositor::resize(int w, int h) {
+
+	if (w == width && h == height)
+		return;
+	releaseTargets();
+	if (w <= 0 || h <= 0)
+		return;
+
+	sceneColorTex = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+	depthTex = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT,
+			w, h);
+	accumTex = createTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, w, h);
+	weightTex = createTarget(GL_R16F, GL_RED, GL_HALF_FLOAT, w, h);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &sceneFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+			sceneColorTex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+			depthTex, 0);
+
+	// The translucent pass depth-tests against the opaque depth buffer.
+	glGenFramebuffers(1, &accumFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, accumFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+			accumTex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+			weightTex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+			depthTex, 0);
+	const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	width = w;
+	height = h;
+}
+
+void OitCompositor::beginOpaque() {
+
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void OitCompositor::beginTranslucent() {
+
+	glBindFramebuffer(GL_FRAMEBUFFER, accumFbo);
+	const GLfloat accumClear[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const GLfloat weightClear[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, accumClear);
+	glClearBufferfv(GL_COLOR, 1, weightClear);
+
+	// Depth-test against the opaque geometry but never write depth, so
+	// translucent surfaces cannot occlude each other.
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void OitCompositor::composite() {
+
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+	glDisable(GL_DEPTH_TEST);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, accumTex);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, weightTex);
+
+	glUseProgram(compositeProgram);
+	glBindVertexArray(emptyVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void OitCompositor::present() {
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+			GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,62 @@
+
+#ifndef OIT_H
+#define OIT_H
+
+#include "glcore.h"
+
+// Weighted blended order-independent transparency (McGuire & Bavoil 2013).
+//
+// Translucent geometry is drawn once, in any order, into two float targets
+// that share the opaque pass's depth buffer:
+//   accum.rgb  = sum(color * alpha * w)    accum.a = product(1 - alpha)
+//   weight.r   = sum(alpha * w)
+// w is a depth-based weight, so nearer surfaces dominate. Both targets use
+// the same glBlendFuncSeparate(ONE, ONE, ZERO, ONE_MINUS_SRC_ALPHA), which
+// only needs GL 3.0 (no per-target blend state). A full-screen pass then
+// composites accum.rgb / weight.r with coverage 1 - accum.a over the
+// opaque image. No sorting is needed.
+//
+// Frame flow:
+//   beginOpaque()      opaque geometry, depth writes on
+//   beginTranslucent() translucent geometry using oitFragmentShader
+//   composite()        resolve onto the opaque image
+//   present()          copy the result to the default framebuffer
+class OitCompositor {
+public:
+	OitCompositor();
+
+	bool init();
+	void release();
+
+	// (Re)allocates the render targets when the window size changed.
+	void resize(int width, int height);
+
+	void beginOpaque();
+	void beginTranslucent();
+	void composite();
+	void present();
+
+	// Render target bytes at the current size (depth counted as 4 bytes
+	// per pixel, as drivers store DEPTH_COMPONENT24).
+	size_t bytes() const;
+
+private:
+	void releaseTargets();
+
+	GLuint compositeProgram;
+	GLuint emptyVao;
+	GLuint sceneFbo;
+	GLuint accumFbo;
+	GLuint sceneColorTex;
+	GLuint depthTex;
+	GLuint accumTex;
+	GLuint weightTex;
+	int width;
+	int height;
+};
+
+// Fragment shader for translucent geometry: consumes 'vColor' and 'vViewZ'
+// (as exported by coneVertexShader) and writes both OIT targets.
+extern const char *oitFragmentShader;
+
+#endif // OIT_H
@@ -0,0 +1,147 @@
+
+#include "renderer.h"
+#include "glcore.h"
+#include <algorithm>
+
+using namespace std;
+
+const int coneSegments[DETAIL_LEVELS] = { 32, 12, 6 };
+static_assert((int) ConeBatch::LODS == (int) DETAIL_LEVELS,
+		"one cone mesh per detail level");
+
+Mat4 frameViewMatrix(const FrameData &frame) {
+
+	return frame.view;
+}
+
+Mat4 frameProjectionMatrix(const FrameData &frame) {
+
+	float aspect = frame.height > 0 ? (float) frame.width / frame.height : 1.0f;
+	return mat4Perspective(45.0f, aspect, 0.1f, 1000.0f);
+}
+
+// Distance at which a sphere of 'radius' fills the square 45 degree view
+static float overviewDistance(const FrameData &frame) {
+
+	return max(frame.overview.radius, 0.2f)
+			/ sinf(22.5f * (float) M_PI / 180.0f);
+}
+
+Mat4 overviewViewMatrix(const FrameData &frame) {
+
+	const Pos &c = frame.overview.center;
+	return mat4Translate(0.0f, 0.0f, -overviewDistance(frame))
+			* mat4Rotation(frame.view) * mat4Translate(-c.x, -c.y, -c.z);
+}
+
+Mat4 overviewProjectionMatrix(const FrameData &frame) {
+
+	float dist = overviewDistance(frame);
+	float r = max(frame.overview.bound, frame.overview.radius) * 1.01f;
+	return mat4Perspective(45.0f, 1.0f, max(dist - r, 0.1f), dist + r);
+}
+
+void frustumOutline(const FrameData &frame, Pos out[OVERVIEW_OUTLINE_POINTS]) {
+
+	Mat4 view = frameViewMatrix(frame);
+	Mat4 proj = frameProjectionMatrix(frame);
+	Mat4 inv = mat4RigidInverse(view);
+	const float *m = inv.m;
+
+	// Depth of the overview center in the main view
+	const Pos &c = frame.overview.center;
+	float d = max(-(view.m[2] * c.x + view.m[6] * c.y + view.m[10] * c.z
+			+ view.m[14]), 0.1f);
+
+	float hx = d / proj.m[0], hy = d / proj.m[5];
+	const float corners[4][2] = { { -hx, -hy }, { hx, -hy }, { hx, hy }, { -hx,
+			hy } };
+	Pos world[4];
+	for (int i = 0; i < 4; ++i) {
+		float x = corners[i][0], y = corners[i][1], z = -d;
+		world[i].x = m[0] * x + m[4] * y + m[8] * z + m[12];
+		world[i].y = m[1] * x + m[5] * y + m[9] * z + m[13];
+		world[i].z = m[2] * x + m[6] * y + m[10] * z + m[14];
+	}
+	for (int i = 0; i < 4; ++i) {
+		out[i * 2] = world[i];
+		out[i * 2 + 1] = world[(i + 1) % 4];
+	}
+}
+
+void metricConeColors(const float *rgb, float fill[4], float wire[4]) {
+
+	// Alphas stay those of the default colors (selected cones are more opaque).
+	for (int i = 0; i < 3; ++i) {
+		fill[i] = rgb[i];
+		wire[i] = rgb[i] + (1.0f - rgb[i]) * 0.35f;
+	}
+}
+
+static void packConeInstance(const FrameData &frame, const ConeInstance &c,
+		ConeGpuInstance &g) {
+
+	g.apex[0] = c.apex.x;
+	g.apex[1] = c.apex.y;
+	g.apex[2] = c.apex.z;
+	g.radius = c.radius;
+	g.height = c.height;
+	g.spinRad = c.spinDeg * (float) M_PI / 180.0f;
+	g.vertical = frame.vertical ? 1.0f : 0.0f;
+	g.pad = 0.0f;
+	copy(coneFillColor[c.selected], coneFillColor[c.selected] + 4, g.fill);
+	copy(coneWireColor[c.selected], coneWireColor[c.selected] + 4, g.wire);
+	if (frame.nodeColors)
+		metricConeColors(frame.nodeColors + c.node->index * 3, g.fill, g.wire);
+}
+
+void packConeInstances(const FrameData &frame,
+		vector<ConeGpuInstance> &out) {
+
+	packConeInstances(frame, frame.cones, out);
+}
+
+void packConeInstances(const FrameData &frame,
+		const vector<ConeInstance> &cones, vector<ConeGpuInstance> &out) {
+
+	out.resize(cones.size());
+	for (size_t i = 0; i < cones.size(); ++i)
+		packConeInstance(frame, cones[i], out[i]);
+}
+
+void packConeInstances(const FrameData &frame, size_t first, size_t count,
+		vector<ConeGpuInstance> &out) {
+
+	for (size_t i = first; i < first + count; ++i)
+		packConeInstance(frame, frame.cones[i], out[i]);
+}
+
+// Draws nothing, without a GL context: headless replays time everything
+// a frame takes but the GL calls.
+class NullRenderer: public Renderer {
+public:
+	const char* name() const {
+		return "none";
+	}
+	bool init() {
+		return true;
+	}
+	void release() {
+	}
+	void resize(int width, int height) {
+	}
+	void draw(const FrameData &frame, RenderStats &stats) {
+	}
+	bool oitAvailable() const {
+		return false;
+	}
+	bool gpuCulling() const {
+		return false;
+	}
+	void memoryUsage(MemoryReport &report) const {
+	}
+};
+
+Renderer* createNullRenderer() {
+	return new NullRenderer();
+}
@@ -0,0 +1,84 @@
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "conetree.h"
+#include "vecmath.h"
+
+struct ConeGpuInstance;
+class MemoryReport;
+
+// A rendering backend. The scene walk and the display() flow are shared;
+// a backend only turns a FrameData into GL calls.
+//   legacy: fixed-function GL/GLU/GLUT (display lists, bitmap fonts)
+//   core:   GL 3.3 core profile (VAOs/VBOs, shaders, uniform buffers)
+class Renderer {
+public:
+	virtual ~Renderer() {
+	}
+
+	virtual const char* name() const = 0;
+
+	// Called once the GL context is current.
+	virtual bool init() = 0;
+	virtual void release() = 0;
+
+	virtual void resize(int width, int height) = 0;
+	virtual void draw(const FrameData &frame, RenderStats &stats) = 0;
+
+	// Whether order-independent transparency can be used with this context.
+	virtual bool oitAvailable() const = 0;
+
+	// Whether cones are frustum-culled on the GPU. The scene walk then
+	// records every cone, and only when the instances change.
+	virtual bool gpuCulling() const = 0;
+
+	// Adds the GL buffers and textures this backend allocated (as sized by
+	// the driver calls, which the driver may round up) and its CPU-side
+	// staging copies.
+	virtual void memoryUsage(MemoryReport &report) const = 0;
+};
+
+Renderer* createLegacyRenderer();
+Renderer* createCoreRenderer(bool gpuCulling = false);
+Renderer* createNullRenderer();
+
+// Cone rim segments for each DETAIL_* level
+extern const int coneSegments[DETAIL_LEVELS];
+
+// The frame's camera as matrices (what the legacy path builds with
+// glTranslatef/glRotatef and gluPerspective).
+Mat4 frameViewMatrix(const FrameData &frame);
+Mat4 frameProjectionMatrix(const FrameData &frame);
+
+// Camera of the overview viewport: framing frame.overview's bounding
+// sphere, rotated like the main view.
+Mat4 overviewViewMatrix(const FrameData &frame);
+Mat4 overviewProjectionMatrix(const FrameData &frame);
+
+// Outline of the main view in the overview: the rectangle where the main
+// view frustum crosses the plane through the overview center, facing the
+// viewer. OVERVIEW_OUTLINE_POINTS world-space points, one pair per edge.
+enum {
+	OVERVIEW_OUTLINE_POINTS = 8
+};
+void frustumOutline(const FrameData &frame, Pos out[OVERVIEW_OUTLINE_POINTS]);
+
+// Replaces the rgb of a cone's fill/wire colors with a node metric color.
+void metricConeColors(const float *rgb, float fill[4], float wire[4]);
+
+// Converts the frame's cones to the instance layout of ConeBatch.
+void packConeInstances(const FrameData &frame,
+		std::vector<ConeGpuInstance> &out);
+
+// The same for other cones drawn with the frame (its overview's).
+void packConeInstances(const FrameData &frame,
+		const std::vector<ConeInstance> &cones,
+		std::vector<ConeGpuInstance> &out);
+
+// The same for 'count' cones from 'first' on, into an 'out' already packed
+// for the whole frame.
+void packConeInstances(const FrameData &frame, size_t first, size_t count,
+		std::vector<ConeGpuInstance> &out);
+
+#endif // RENDERER_H
@@ -0,0 +1,876 @@
+
+#include "renderer.h"
+#include "oit.h"
+#include "memreport.h"
+#include "font8x13.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+// GL 3.3 core-profile backend: no fixed-function state, no GLU/GLUT
+// drawing. Spheres are point-sprite impostors and cones an instanced mesh,
+// both fed from per-frame buffers; labels are instanced glyph quads
+// sampling a font atlas; the camera lives in a uniform buffer shared by
+// every program.
+
+static const char *coneFragmentShader = R"(#version 330 core
+in vec4 vColor;
+in float vViewZ;
+out vec4 oColor;
+
+void main() {
+	oColor = vColor;
+}
+)";
+
+// Node markers are sphere impostors: one point sprite per node, sized to
+// cover the sphere's projection, and a fragment shader that intersects the
+// view ray with the sphere and writes the true depth. That is one vertex
+// per node instead of the ~200 triangles of glutSolidSphere(r, 10, 10).
+static const char *sphereVertexShader = R"(#version 330 core
+layout(location = 0) in vec4 aNodePos;
+layout(location = 1) in vec4 aColor;
+
+layout(std140) uniform Camera {
+	mat4 uView;
+	mat4 uProj;
+	vec4 uViewport;
+};
+uniform float uRadius;
+uniform float uMaxPointSize;
+
+flat out vec3 vCenter;	// sphere center in view space
+flat out vec4 vColor;
+
+void main() {
+	vec4 center = uView * vec4(aNodePos.xyz, 1.0);
+	vCenter = center.xyz;
+	vColor = aColor;
+	gl_Position = uProj * center;
+
+	// Projected diameter in pixels, with slack for the stretching of
+	// off-axis spheres.
+	float dist = max(-center.z, 1e-4);
+	float size = uRadius * uProj[1][1] / dist * uViewport.y;
+	gl_PointSize = clamp(size * 1.25 + 2.0, 1.0, uMaxPointSize);
+}
+)";
+
+static const char *sphereFragmentShader = R"(#version 330 core
+layout(std140) uniform Camera {
+	mat4 uView;
+	mat4 uProj;
+	vec4 uViewport;
+};
+uniform float uRadius;
+
+flat in vec3 vCenter;
+flat in vec4 vColor;
+out vec4 oColor;
+
+void main() {
+	// View ray through this pixel (symmetric perspective projection).
+	vec2 ndc = (gl_FragCoord.xy - uViewport.zw) / uViewport.xy * 2.0 - 1.0;
+	vec3 dir = vec3(ndc.x / uProj[0][0], ndc.y / uProj[1][1], -1.0);
+
+	// Nearest intersection of t * dir with the sphere.
+	float a = dot(dir, dir);
+	float b = dot(dir, vCenter);
+	float c = dot(vCenter, vCenter) - uRadius * uRadius;
+	float disc = b * b - a * c;
+	if (disc < 0.0)
+		discard;
+	vec3 hit = dir * ((b - sqrt(disc)) / a);
+
+	vec4 clip = uProj * vec4(hit, 1.0);
+	gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+	oColor = vColor;
+}
+)";
+
+// Glyph metrics match font8x13.h: 8x14 cells, baseline 3 rows up.
+static const char *labelVertexShader = R"(#version 330 core
+layout(location = 0) in vec2 aCorner;	// unit quad
+layout(location = 1) in uint aNode;		// index into uNodePos
+layout(location = 2) in uvec2 aGlyph;	// glyph index, x offset in pixels
+
+layout(std140) uniform Camera {
+	mat4 uView;
+	mat4 uProj;
+	vec4 uViewport;
+};
+uniform samplerBuffer uNodePos;
+
+out vec2 vTexel;
+
+const vec2 GLYPH = vec2(8.0, 14.0);
+const float BASELINE = 3.0;
+
+void main() {
+	vec3 p = texelFetch(uNodePos, int(aNode)).xyz;
+
+	// Billboard: offset the label to the right of the node in eye space.
+	vec4 viewPos = uView * vec4(p, 1.0);
+	viewPos.x += 0.35;
+	vec4 clip = uProj * viewPos;
+	vTexel = vec2(float(aGlyph.x) * GLYPH.x, 0.0) + aCorner * GLYPH;
+	if (clip.w <= 0.0) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);	// behind the camera
+		return;
+	}
+
+	// Snap the label origin to a pixel so the glyphs stay crisp.
+	vec2 origin = floor((clip.xy / clip.w * 0.5 + 0.5) * uViewport.xy + 0.5);
+	vec2 pixel = origin + vec2(float(aGlyph.y), -BASELINE) + aCorner * GLYPH;
+	gl_Position = vec4(pixel / uViewport.xy * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char *labelFragmentShader = R"(#version 330 core
+uniform sampler2D uFont;
+in vec2 vTexel;
+out vec4 oColor;
+
+void main() {
+	if (texelFetch(uFont, ivec2(vTexel), 0).r < 0.5)
+		discard;
+	oColor = vec4(1.0);
+}
+)";
+
+// Screen-space text (the statistics panel): glyph quads at pixel origins,
+// drawn with labelFragmentShader.
+static const char *panelVertexShader = R"(#version 330 core
+layout(location = 0) in vec2 aCorner;	// unit quad
+layout(location = 1) in vec2 aOrigin;	// glyph cell, pixels from bottom left
+layout(location = 2) in uint aGlyph;
+
+uniform vec2 uScreen;
+
+out vec2 vTexel;
+
+const vec2 GLYPH = vec2(8.0, 14.0);
+
+void main() {
+	vTexel = vec2(float(aGlyph) * GLYPH.x, 0.0) + aCorner * GLYPH;
+	vec2 pixel = aOrigin + aCorner * GLYPH;
+	gl_Position = vec4(pixel / uScreen * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Overview frustum outline: plain world-space lines.
+static const char *lineVertexShader = R"(#version 330 core
+layout(location = 0) in vec3 aPos;
+
+layout(std140) uniform Camera {
+	mat4 uView;
+	mat4 uProj;
+	vec4 uViewport;
+};
+
+void main() {
+	gl_Position = uProj * uView * vec4(aPos, 1.0);
+}
+)";
+
+static const char *lineFragmentShader = R"(#version 330 core
+uniform vec4 uColor;
+out vec4 oColor;
+
+void main() {
+	oColor = uColor;
+}
+)";
+
+struct GlyphInstance {
+	GLuint node;
+	GLushort glyph;
+	GLushort x;
+};
+
+struct PanelGlyph {
+	float x, y;
+	GLuint glyph;
+};
+
+class CoreRenderer: public Renderer {
+public:
+	CoreRenderer(bool gpuCulling) :
+			wantCulling(gpuCulling), culling(false), instanceVersion(0), coneProgram(0), oitConeProgram(0), sphereProgram(0), labelProgram(0), lineProgram(
+					0), panelProgram(0), sphereVao(0), maxPointSize(1.0f), nodeBuffer(0), nodeTexture(
+					0), nodeColorBuffer(0), nodeCapacity(0), labelVao(0), quadBuffer(0), glyphBuffer(
+					0), glyphCount(0), fontTexture(0), labelVersion(0), outlineVao(
+					0), outlineBuffer(0), panelVao(0), panelBuffer(0), panelGlyphs(
+					0), panelHeight(0), overviewVao(0), overviewNodeBuffer(0), overviewColorBuffer(
+					0), overviewNodes(0), overviewVersion(0), width(0), height(0) {
+	}
+
+	const char* name() const {
+		return "core";
+	}
+
+	bool init();
+	void release();
+	void resize(int w, int h);
+	void draw(const FrameData &frame, RenderStats &stats);
+
+	bool oitAvailable() const {
+		return true;
+	}
+
+	bool gpuCulling() const {
+		return culling;
+	}
+
+	void memoryUsage(MemoryReport &report) const;
+
+private:
+	bool initSpheres();
+	bool initLabels();
+	bool initOutline();
+	bool initPanel();
+	void uploadNodes(const FrameData &frame);
+	void uploadOverview(const FrameData &frame);
+	void moveInstances(const FrameData &frame);
+	bool sameLabelNodes(const FrameData &frame) const;
+	void rebuildGlyphs(const FrameData &frame);
+	void drawSpheres(GLuint vao, size_t count, RenderStats &stats);
+	void drawLabels(RenderStats &stats);
+	void drawCones(GLuint program, int detail);
+	void drawPanel(const FrameData &frame, RenderStats &stats);
+	void drawOverview(const FrameData &frame, RenderStats &stats);
+
+	bool wantCulling;
+	bool culling;
+	unsigned instanceVersion;	// of the uploaded nodes and cones
+
+	CameraBlock camera;
+	ConeBatch cones;
+	OitCompositor oit;
+	GLuint coneProgram;
+	GLuint oitConeProgram;
+	GLuint sphereProgram;
+	GLuint labelProgram;
+	GLuint lineProgram;
+	GLuint panelProgram;
+
+	GLuint sphereVao;
+	float maxPointSize;
+
+	// Node world positions, one vec4 per node: the sphere impostor vertices
+	// and, through a buffer texture, the label anchors. Sphere colors are a
+	// second buffer, RGBA8 per node.
+	GLuint nodeBuffer;
+	GLuint nodeTexture;
+	GLuint nodeColorBuffer;
+	size_t nodeCapacity;
+	vector<float> nodeData;
+	vector<GLubyte> nodeColors;
+
+	GLuint labelVao;
+	GLuint quadBuffer;
+	GLuint glyphBuffer;
+	size_t glyphCount;
+	GLuint fontTexture;
+	unsigned labelVersion;
+	vector<const Node*> labelNodes;	// node order the glyphs were built for
+
+	GLuint outlineVao;
+	GLuint outlineBuffer;
+
+	GLuint panelVao;
+	GLuint panelBuffer;
+	size_t panelGlyphs;
+	vector<string> panelText;	// what panelBuffer holds
+	int panelHeight;			// window height it was laid out for
+
+	// The overview's own nodes and cones (see OverviewData)
+	ConeBatch overviewCones;
+	GLuint overviewVao;
+	GLuint overviewNodeBuffer;
+	GLuint overviewColorBuffer;
+	size_t overviewNodes;
+	unsigned overviewVersion;	// of what they hold
+
+	vector<ConeGpuInstance> coneData;
+	int width, height;
+};
+
+bool CoreRenderer::init() {
+
+	if (!glVersionAtLeast(3, 3)) {
+		cerr << "The core renderer needs OpenGL 3.3, got "
+				<< glGetString(GL_VERSION) << endl;
+		return false;
+	}
+
+	coneProgram = compileProgram(coneVertexShader, coneFragmentShader, "cone");
+	oitConeProgram = compileProgram(coneVertexShader, oitFragmentShader,
+			"OIT cone");
+	sphereProgram = compileProgram(sphereVertexShader, sphereFragmentShader,
+			"sphere");
+	labelProgram = compileProgram(labelVertexShader, labelFragmentShader,
+			"label");
+	lineProgram = compileProgram(lineVertexShader, lineFragmentShader, "line");
+	panelProgram = compileProgram(panelVertexShader, labelFragmentShader,
+			"panel");
+	if (!coneProgram || !oitConeProgram || !sphereProgram || !labelProgram
+			|| !lineProgram || !panelProgram)
+		return false;
+
+	if (!camera.init() || !cones.init(coneSegments)
+			|| !overviewCones.init(coneSegments) || !oit.init() || !initSpheres()
+			|| !initLabels() || !initOutline() || !initPanel())
+		return false;
+
+	if (wantCulling) {
+		culling = cones.enableCulling();
+		if (culling) {
+			cerr << "GPU culling: "
+					<< (cones.cullMode() == ConeBatch::CULL_COMPUTE ?
+							"compute shader" : "transform feedback") << endl;
+		} else {
+			cerr << "GPU culling not available, drawing every cone" << endl;
+		}
+	}
+
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glEnable(GL_DEPTH_TEST);
+	return glGetError() == GL_NO_ERROR;
+}
+
+// Sphere impostor vertices: a vec4 position and RGBA8 color per node.
+static void initSphereVao(GLuint &vao, GLuint &positions, GLuint &colors) {
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &positions);
+	glBindBuffer(GL_ARRAY_BUFFER, positions);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glGenBuffers(1, &colors);
+	glBindBuffer(GL_ARRAY_BUFFER, colors);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, nullptr);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool CoreRenderer::initSpheres() {
+
+	initSphereVao(sphereVao, nodeBuffer, nodeColorBuffer);
+	initSphereVao(overviewVao, overviewNodeBuffer, overviewColorBuffer);
+
+	// Impostors larger than the point size limit get clipped to a square;
+	// that only happens with the camera almost touching a node.
+	GLfloat range[2] = { 1.0f, 1.0f };
+	glGetFloatv(GL_POINT_SIZE_RANGE, range);
+	maxPointSize = range[1];
+	glEnable(GL_PROGRAM_POINT_SIZE);
+
+	glGenTextures(1, &nodeTexture);
+	return glGetError() == GL_NO_ERROR;
+}
+
+bool CoreRenderer::initLabels() {
+
+	// Font atlas: all glyphs side by side, bottom row first as GL expects.
+	const int glyphs = FONT_LAST_CHAR - FONT_FIRST_CHAR + 1;
+	const int atlasWidth = glyphs * FONT_GLYPH_WIDTH;
+	vector<unsigned char> atlas(atlasWidth * FONT_GLYPH_HEIGHT);
+	for (int g = 0; g < glyphs; ++g) {
+		for (int row = 0; row < FONT_GLYPH_HEIGHT; ++row) {
+			unsigned char bits = font8x13[g][FONT_GLYPH_HEIGHT - 1 - row];
+			for (int x = 0; x < FONT_GLYPH_WIDTH; ++x) {
+				atlas[row * atlasWidth + g * FONT_GLYPH_WIDTH + x] =
+						(bits & (0x80 >> x)) ? 255 : 0;
+			}
+		}
+	}
+	glGenTextures(1, &fontTexture);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, FONT_GLYPH_HEIGHT, 0,
+			GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glUseProgram(labelProgram);
+	glUniform1i(glGetUniformLocation(labelProgram, "uFont"), 0);
+	glUniform1i(glGetUniformLocation(labelProgram, "uNodePos"), 1);
+	glUseProgram(0);
+
+	const float quad[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+	glGenVertexArrays(1, &labelVao);
+	glBindVertexArray(labelVao);
+
+	glGenBuffers(1, &quadBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glGenBuffers(1, &glyphBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, glyphBuffer);
+	glEnableVertexAttribArray(1);
+	glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(GlyphInstance),
+			(const void*) offsetof(GlyphInstance, node));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 2, GL_UNSIGNED_SHORT, sizeof(GlyphInstance),
+			(const void*) offsetof(GlyphInstance, glyph));
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+bool CoreRenderer::initOutline() {
+
+	glGenVertexArrays(1, &outlineVao);
+	glBindVertexArray(outlineVao);
+
+	glGenBuffers(1, &outlineBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, outlineBuffer);
+	glBufferData(GL_ARRAY_BUFFER, OVERVIEW_OUTLINE_POINTS * sizeof(Pos), nullptr,
+			GL_STREAM_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Pos), nullptr);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+bool CoreRenderer::initPanel() {
+
+	glUseProgram(panelProgram);
+	glUniform1i(glGetUniformLocation(panelProgram, "uFont"), 0);
+	glUseProgram(0);
+
+	glGenVertexArrays(1, &panelVao);
+	glBindVertexArray(panelVao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glGenBuffers(1, &panelBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, panelBuffer);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(PanelGlyph),
+			(const void*) offsetof(PanelGlyph, x));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(PanelGlyph),
+			(const void*) offsetof(PanelGlyph, glyph));
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void CoreRenderer::release() {
+
+	oit.release();
+	cones.release();
+	overviewCones.release();
+	camera.release();
+
+	GLuint buffers[] = { nodeBuffer, nodeColorBuffer, quadBuffer, glyphBuffer,
+			outlineBuffer, panelBuffer, overviewNodeBuffer, overviewColorBuffer };
+	glDeleteBuffers(8, buffers);
+	GLuint vaos[] = { sphereVao, labelVao, outlineVao, panelVao, overviewVao };
+	glDeleteVertexArrays(5, vaos);
+	GLuint textures[] = { nodeTexture, fontTexture };
+	glDeleteTextures(2, textures);
+
+	glDeleteProgram(coneProgram);
+	glDeleteProgram(oitConeProgram);
+	glDeleteProgram(sphereProgram);
+	glDeleteProgram(labelProgram);
+	glDeleteProgram(lineProgram);
+	glDeleteProgram(panelProgram);
+}
+
+void CoreRenderer::resize(int w, int h) {
+
+	width = w;
+	height = h;
+	glViewport(0, 0, w, h);
+}
+
+void CoreRenderer::memoryUsage(MemoryReport &report) const {
+
+	const int atlasWidth = (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+			* FONT_GLYPH_WIDTH;
+	report.add("GL node positions and colors",
+			nodeCapacity * 4 * sizeof(float) + nodeColors.size());
+	report.add("GL cone batch", cones.bytes());
+	report.add("GL overview nodes and cones",
+			overviewNodes * (4 * sizeof(float) + 4) + overviewCones.bytes());
+	report.add("GL label glyphs and font",
+			glyphCount * sizeof(GlyphInstance) + 8 * sizeof(float)
+					+ atlasWidth * FONT_GLYPH_HEIGHT);
+	report.add("GL panel and outline",
+			panelGlyphs * sizeof(PanelGlyph)
+					+ OVERVIEW_OUTLINE_POINTS * sizeof(Pos));
+	report.add("GL OIT targets", oit.bytes());
+	report.add("core renderer staging",
+			vectorBytes(nodeData) + vectorBytes(nodeColors)
+					+ vectorBytes(labelNodes) + vectorBytes(coneData)
+					+ panelText.capacity() * sizeof(string));
+}
+
+// Sphere vertices for 'nodes': positions and colors.
+static void packNodes(const FrameData &frame,
+		const vector<NodeInstance> &nodes, vector<float> &data,
+		vector<GLubyte> &colors) {
+
+	size_t n = nodes.size();
+	data.resize(n * 4);
+	colors.resize(n * 4);
+	for (size_t i = 0; i < n; ++i) {
+		const Pos &p = nodes[i].pos;
+		data[i * 4 + 0] = p.x;
+		data[i * 4 + 1] = p.y;
+		data[i * 4 + 2] = p.z;
+		data[i * 4 + 3] = 1.0f;
+
+		GLubyte *color = &colors[i * 4];
+		if (frame.nodeColors) {
+			const float *rgb = frame.nodeColors + nodes[i].node->index * 3;
+			for (int c = 0; c < 3; ++c)
+				color[c] = (GLubyte) (rgb[c] * 255.0f + 0.5f);
+		} else {
+			color[0] = color[1] = 0;
+			color[2] = 255;
+		}
+		color[3] = 255;
+	}
+}
+
+void CoreRenderer::uploadNodes(const FrameData &frame) {
+
+	size_t n = frame.nodes.size();
+	packNodes(frame, frame.nodes, nodeData, nodeColors);
+
+	glBindBuffer(GL_ARRAY_BUFFER, nodeBuffer);
+	if (n > nodeCapacity || nodeCapacity == 0) {
+		nodeCapacity = max(n + n / 2, (size_t) 1);
+		glBufferData(GL_ARRAY_BUFFER, nodeCapacity * 4 * sizeof(float), nullptr,
+				GL_STREAM_DRAW);
+
+		// The buffer texture has to be re-attached after reallocation.
+		glBindTexture(GL_TEXTURE_BUFFER, nodeTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, nodeBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	if (n > 0)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, nodeData.size() * sizeof(float),
+				nodeData.data());
+
+	glBindBuffer(GL_ARRAY_BUFFER, nodeColorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, nodeColors.size(), nodeColors.data(),
+			GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// The overview's instances change only with the tree or its layout, so
+// nothing of them is kept on the CPU side.
+void CoreRenderer::uploadOverview(const FrameData &frame) {
+
+	const OverviewData &o = frame.overview;
+	vector<float> data;
+	vector<GLubyte> colors;
+	packNodes(frame, o.nodes, data, colors);
+	glBindBuffer(GL_ARRAY_BUFFER, overviewNodeBuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(),
+			GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, overviewColorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, colors.size(), colors.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	overviewNodes = o.nodes.size();
+
+	vector<ConeGpuInstance> instances;
+	packConeInstances(frame, o.cones, instances);
+	overviewCones.upload(instances.data(), instances.size());
+	overviewVersion = o.version;
+}
+
+void CoreRenderer::moveInstances(const FrameData &frame) {
+
+	glBindBuffer(GL_ARRAY_BUFFER, nodeBuffer);
+	for (const InstanceRange &r : frame.movedNodes) {
+		for (size_t i = r.first; i < r.first + r.count; ++i) {
+			const Pos &p = frame.nodes[i].pos;
+			nodeData[i * 4 + 0] = p.x;
+			nodeData[i * 4 + 1] = p.y;
+			nodeData[i * 4 + 2] = p.z;
+		}
+		if (r.count > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, r.first * 4 * sizeof(float),
+					r.count * 4 * sizeof(float), &nodeData[r.first * 4]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for (const InstanceRange &r : frame.movedCones) {
+		packConeInstances(frame, r.first, r.count, coneData);
+		cones.update(coneData.data(), r.first, r.count);
+	}
+}
+
+bool CoreRenderer::sameLabelNodes(const FrameData &frame) const {
+
+	if (frame.treeVersion != labelVersion
+			|| frame.nodes.size() != labelNodes.size())
+		return false;
+	for (size_t i = 0; i < labelNodes.size(); ++i) {
+		if (frame.nodes[i].node != labelNodes[i])
+			return false;
+	}
+	return true;
+}
+
+void CoreRenderer::rebuildGlyphs(const FrameData &frame) {
+
+	// Glyph instances only reference node indices, so they stay valid while
+	// the same nodes are drawn in the same order, whatever the camera or
+	// cone spin. Culling or proxies changing the node set forces a rebuild.
+	vector<GlyphInstance> glyphs;
+	for (size_t i = 0; i < frame.nodes.size(); ++i) {
+		const string &text = frame.nodes[i].node->label();
+		for (size_t k = 0; k < text.size(); ++k) {
+			int c = (unsigned char) text[k];
+			if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR)
+				c = '?';
+			glyphs.push_back( { (GLuint) i, (GLushort) (c - FONT_FIRST_CHAR),
+					(GLushort) (k * FONT_GLYPH_WIDTH) });
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, glyphBuffer);
+	glBufferData(GL_ARRAY_BUFFER, glyphs.size() * sizeof(GlyphInstance),
+			glyphs.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glyphCount = glyphs.size();
+	labelVersion = frame.treeVersion;
+	labelNodes.resize(frame.nodes.size());
+	for (size_t i = 0; i < frame.nodes.size(); ++i)
+		labelNodes[i] = frame.nodes[i].node;
+}
+
+void CoreRenderer::drawSpheres(GLuint vao, size_t count, RenderStats &stats) {
+
+	glUseProgram(sphereProgram);
+	glUniform1f(glGetUniformLocation(sphereProgram, "uRadius"), 0.2f);
+	glUniform1f(glGetUniformLocation(sphereProgram, "uMaxPointSize"),
+			maxPointSize);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_POINTS, 0, count);
+	glBindVertexArray(0);
+	glUseProgram(0);
+	stats.drawCalls++;
+	stats.stateChanges += 4;
+}
+
+void CoreRenderer::drawLabels(RenderStats &stats) {
+
+	if (glyphCount == 0)
+		return;
+
+	// Labels are always visible: no depth test.
+	glDisable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, nodeTexture);
+
+	glUseProgram(labelProgram);
+	glBindVertexArray(labelVao);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, glyphCount);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+	stats.drawCalls++;
+	stats.stateChanges += 6;
+}
+
+// Fills, then wireframes
+void CoreRenderer::drawCones(GLuint program, int detail) {
+
+	if (culling) {
+		cones.drawVisible(program, false);
+		cones.drawVisible(program, true);
+	} else {
+		cones.draw(program, false, detail);
+		cones.draw(program, true, detail);
+	}
+}
+
+void CoreRenderer::drawPanel(const FrameData &frame, RenderStats &stats) {
+
+	// Lines from the top left, 16 pixels apart, rebuilt when the text changes
+	if (frame.panel != panelText || panelHeight != height) {
+		vector<PanelGlyph> glyphs;
+		for (size_t line = 0; line < frame.panel.size(); ++line) {
+			const string &text = frame.panel[line];
+			float y = height - 10.0f - 16.0f * (line + 1);
+			for (size_t k = 0; k < text.size(); ++k) {
+				int c = (unsigned char) text[k];
+				if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR)
+					c = '?';
+				glyphs.push_back( { 10.0f + k * FONT_GLYPH_WIDTH, y,
+						(GLuint) (c - FONT_FIRST_CHAR) });
+			}
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, panelBuffer);
+		glBufferData(GL_ARRAY_BUFFER, glyphs.size() * sizeof(PanelGlyph),
+				glyphs.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		panelGlyphs = glyphs.size();
+		panelText = frame.panel;
+		panelHeight = height;
+	}
+	if (panelGlyphs == 0)
+		return;
+
+	glDisable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glUseProgram(panelProgram);
+	glUniform2f(glGetUniformLocation(panelProgram, "uScreen"), (float) width,
+			(float) height);
+	glBindVertexArray(panelVao);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, panelGlyphs);
+	glBindVertexArray(0);
+	glUseProgram(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+	stats.drawCalls++;
+	stats.stateChanges += 5;
+}
+
+void CoreRenderer::drawOverview(const FrameData &frame, RenderStats &stats) {
+
+	const OverviewData &o = frame.overview;
+	if (o.version != overviewVersion)
+		uploadOverview(frame);
+	Mat4 view = overviewViewMatrix(frame);
+	Mat4 proj = overviewProjectionMatrix(frame);
+	camera.update(view.m, proj.m, o.size, o.size, o.x, o.y);
+
+	// Border and background, then the viewport inside the border
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(o.x - 1, o.y - 1, o.size + 2, o.size + 2);
+	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(o.x, o.y, o.size, o.size);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glViewport(o.x, o.y, o.size, o.size);
+
+	drawSpheres(overviewVao, overviewNodes, stats);
+
+	// ----- Coarse filled cones, no wireframes -----
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	overviewCones.draw(coneProgram, false, DETAIL_COARSE);
+	glDisable(GL_BLEND);
+
+	// ----- Main view frustum -----
+	Pos outline[OVERVIEW_OUTLINE_POINTS];
+	frustumOutline(frame, outline);
+	glBindBuffer(GL_ARRAY_BUFFER, outlineBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(outline), outline);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(lineProgram);
+	glUniform4f(glGetUniformLocation(lineProgram, "uColor"), 1.0f, 1.0f, 0.0f,
+			1.0f);
+	glBindVertexArray(outlineVao);
+	glDrawArrays(GL_LINES, 0, OVERVIEW_OUTLINE_POINTS);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glViewport(0, 0, width, height);
+	glDisable(GL_SCISSOR_TEST);
+	stats.drawCalls += 2;
+	stats.stateChanges += 16;
+}
+
+void CoreRenderer::draw(const FrameData &frame, RenderStats &stats) {
+
+	Mat4 view = frameViewMatrix(frame);
+	Mat4 proj = frameProjectionMatrix(frame);
+	camera.update(view.m, proj.m, width, height);
+
+	// Instances stay on the GPU while only the camera moves, and only the
+	// subtrees of spinning cones go again while only they turn.
+	if (frame.instanceVersion != instanceVersion) {
+		if (instanceVersion != 0 && frame.movedFrom == instanceVersion) {
+			moveInstances(frame);
+		} else {
+			uploadNodes(frame);
+			packConeInstances(frame, coneData);
+			cones.upload(coneData.data(), coneData.size());
+		}
+		instanceVersion = frame.instanceVersion;
+	}
+	if (frame.labels && !sameLabelNodes(frame))
+		rebuildGlyphs(frame);
+	if (culling) {
+		cones.cull(frame.detail);
+		stats.drawCalls++;
+		stats.stateChanges += 6;
+	}
+
+	if (frame.oit) {
+		oit.resize(width, height);
+		oit.beginOpaque();
+		drawSpheres(sphereVao, nodeData.size() / 4, stats);
+
+		// ----- Filled cones and wireframes, in one unsorted translucent pass -----
+		oit.beginTranslucent();
+		drawCones(oitConeProgram, frame.detail);
+		oit.composite();
+		oit.present();
+		stats.drawCalls += 3;
+		stats.stateChanges += 8;
+	} else {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		drawSpheres(sphereVao, nodeData.size() / 4, stats);
+
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		drawCones(coneProgram, frame.detail);
+		glDisable(GL_BLEND);
+		stats.drawCalls += 2;
+		stats.stateChanges += 5;
+	}
+
+	if (frame.labels)
+		drawLabels(stats);
+	if (!frame.panel.empty())
+		drawPanel(frame, stats);
+	if (frame.overview.enabled)
+		drawOverview(frame, stats);
+}
+
+Renderer* createCoreRenderer(bool gpuCulling) {
+
+	return new CoreRenderer(gpuCulling);
+}
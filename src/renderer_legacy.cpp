@@ -0,0 +1,427 @@
+
+#include "renderer.h"
+#include "oit.h" // before GL/glut.h: enables the GL 3.3 prototypes
+#include <GL/glut.h>
+#include "memreport.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Fixed-function backend. The unit cone (apex at origin, axis +Z, radius 1
+// and height 1) and the node sphere, one of each per detail level, and the
+// label font (one list per character) are display lists built once. With
+// a GL 3.3 capable compatibility context, the translucent cones go through
+// weighted blended OIT instead.
+class LegacyRenderer: public Renderer {
+public:
+	LegacyRenderer() :
+			quad(nullptr), coneLists(0), sphereLists(0), fontListBase(0), oitReady(
+					false), oitConeProgram(0), width(0), height(0) {
+	}
+
+	const char* name() const {
+		return "legacy";
+	}
+
+	bool init();
+	void release();
+	void resize(int w, int h);
+	void draw(const FrameData &frame, RenderStats &stats);
+
+	bool oitAvailable() const {
+		return oitReady;
+	}
+
+	bool gpuCulling() const {
+		return false;
+	}
+
+	void memoryUsage(MemoryReport &report) const;
+
+private:
+	void initOit();
+	void drawSpherePass(const FrameData &frame, RenderStats &stats);
+	void drawConeInstances(const FrameData &frame,
+			const vector<ConeInstance> &cones, bool wire, int detail,
+			RenderStats &stats, float minRadius = 0.0f);
+	void drawConePasses(const FrameData &frame, RenderStats &stats);
+	void drawOitConePass(const FrameData &frame, RenderStats &stats);
+	void drawLabelPass(const FrameData &frame, RenderStats &stats);
+	void drawOverview(const FrameData &frame, RenderStats &stats);
+	void drawPanelPass(const FrameData &frame, RenderStats &stats);
+
+	GLUquadric *quad;
+	GLuint coneLists;	// DETAIL_LEVELS consecutive lists
+	GLuint sphereLists;
+	GLuint fontListBase;
+
+	bool oitReady;
+	OitCompositor oit;
+	CameraBlock camera;
+	ConeBatch coneBatch;
+	GLuint oitConeProgram;
+	vector<ConeGpuInstance> coneGpuInstances;
+
+	int width, height;
+};
+
+bool LegacyRenderer::init() {
+
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	quad = gluNewQuadric();
+	gluQuadricDrawStyle(quad, GLU_FILL);
+	gluQuadricNormals(quad, GLU_SMOOTH);
+
+	const int sphereSlices[DETAIL_LEVELS] = { 10, 6, 4 };
+	const int sphereStacks[DETAIL_LEVELS] = { 10, 5, 3 };
+	coneLists = glGenLists(DETAIL_LEVELS);
+	sphereLists = glGenLists(DETAIL_LEVELS);
+	for (int d = 0; d < DETAIL_LEVELS; ++d) {
+		glNewList(coneLists + d, GL_COMPILE);
+		gluCylinder(quad, 0.0, 1.0, 1.0, coneSegments[d], 1);
+		glEndList();
+
+		glNewList(sphereLists + d, GL_COMPILE);
+		glutSolidSphere(0.2f, sphereSlices[d], sphereStacks[d]);
+		glEndList();
+	}
+
+	// glBitmap data is unpacked at compile time, so the glyphs can be baked
+	// once and each label becomes a single glCallLists().
+	fontListBase = glGenLists(256);
+	for (int c = 0; c < 256; ++c) {
+		glNewList(fontListBase + c, GL_COMPILE);
+		glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
+		glEndList();
+	}
+
+	initOit();
+	return true;
+}
+
+void LegacyRenderer::initOit() {
+
+	if (!glVersionAtLeast(3, 3)) {
+		cerr << "OpenGL 3.3 not available, order-independent transparency disabled"
+				<< endl;
+		return;
+	}
+	oitConeProgram = compileProgram(coneVertexShader, oitFragmentShader,
+			"OIT cone");
+	oitReady = oitConeProgram && camera.init() && coneBatch.init(coneSegments)
+			&& oit.init();
+}
+
+void LegacyRenderer::release() {
+
+	if (oitReady) {
+		oit.release();
+		coneBatch.release();
+		camera.release();
+		glDeleteProgram(oitConeProgram);
+		oitReady = false;
+	}
+	glDeleteLists(coneLists, DETAIL_LEVELS);
+	glDeleteLists(sphereLists, DETAIL_LEVELS);
+	glDeleteLists(fontListBase, 256);
+	gluDeleteQuadric(quad);
+	quad = nullptr;
+}
+
+void LegacyRenderer::memoryUsage(MemoryReport &report) const {
+
+	// Display lists live in driver memory and cannot be queried; only the
+	// OIT path allocates buffers of known size.
+	if (!oitReady)
+		return;
+	report.add("GL cone batch", coneBatch.bytes());
+	report.add("GL OIT targets", oit.bytes());
+	report.add("legacy renderer staging", vectorBytes(coneGpuInstances));
+}
+
+void LegacyRenderer::resize(int w, int h) {
+
+	width = w;
+	height = h;
+	glViewport(0, 0, w, h);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(45.0, (float) w / h, 0.1, 1000.0); // Near and far clipping planes
+	glMatrixMode(GL_MODELVIEW);
+}
+
+void LegacyRenderer::drawConeInstances(const FrameData &frame,
+		const vector<ConeInstance> &cones, bool wire, int detail,
+		RenderStats &stats, float minRadius) {
+
+	// Unselected cones first, then selected ones, so the color only has to
+	// change once between the two groups.
+	for (int group = 0; group < 2; ++group) {
+		bool selected = (group == 1);
+		bool colorSet = false;
+		for (const ConeInstance &c : cones) {
+			if (c.selected != selected || c.radius < minRadius)
+				continue;
+			if (frame.nodeColors) {
+				float fill[4], wireColor[4];
+				copy(coneFillColor[selected], coneFillColor[selected] + 4, fill);
+				copy(coneWireColor[selected], coneWireColor[selected] + 4,
+						wireColor);
+				metricConeColors(frame.nodeColors + c.node->index * 3, fill,
+						wireColor);
+				glColor4fv(wire ? wireColor : fill);
+				stats.stateChanges++;
+			} else if (!colorSet) {
+				glColor4fv(wire ? coneWireColor[selected] : coneFillColor[selected]);
+				stats.stateChanges++;
+				colorSet = true;
+			}
+
+			glPushMatrix();
+
+			// Move to the PARENT (apex/narrow end), orient so the cone axis
+			// matches the tree axis, then spin about that axis.
+			glTranslatef(c.apex.x, c.apex.y, c.apex.z);
+			if (frame.vertical) {
+				glRotatef(90.0f, 1.0f, 0.0f, 0.0f);
+				glRotatef(180.0f, 0.0f, 0.0f, 1.0f);
+			} else {
+				glRotatef(90.0f, 0.0f, 1.0f, 0.0f);
+			}
+			if (c.spinDeg != 0.0f)
+				glRotatef(c.spinDeg, 0.0f, 0.0f, 1.0f);
+			glScalef(c.radius, c.radius, c.height);
+
+			glCallList(coneLists + detail);
+			stats.drawCalls++;
+
+			glPopMatrix();
+		}
+	}
+}
+
+void LegacyRenderer::drawSpherePass(const FrameData &frame,
+		RenderStats &stats) {
+
+	// ----- Spheres are opaque, draw them before any blending -----
+	glColor3f(0.0f, 0.0f, 1.0f);
+	stats.stateChanges++;
+
+	for (const NodeInstance &n : frame.nodes) {
+		if (frame.nodeColors) {
+			glColor3fv(frame.nodeColors + n.node->index * 3);
+			stats.stateChanges++;
+		}
+		glPushMatrix();
+		glTranslatef(n.pos.x, n.pos.y, n.pos.z);
+		glCallList(sphereLists + frame.detail);
+		stats.drawCalls++;
+		glPopMatrix();
+	}
+}
+
+void LegacyRenderer::drawConePasses(const FrameData &frame,
+		RenderStats &stats) {
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	stats.stateChanges += 2;
+
+	// ----- Filled translucent cones -----
+	drawConeInstances(frame, frame.cones, false, frame.detail, stats);
+
+	// ----- Wireframes -----
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	glLineWidth(1.2f);
+	stats.stateChanges += 2;
+
+	drawConeInstances(frame, frame.cones, true, frame.detail, stats);
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glDisable(GL_BLEND);
+	stats.stateChanges += 2;
+}
+
+void LegacyRenderer::drawOitConePass(const FrameData &frame,
+		RenderStats &stats) {
+
+	packConeInstances(frame, coneGpuInstances);
+	coneBatch.upload(coneGpuInstances.data(), coneGpuInstances.size());
+
+	float view[16], proj[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	glGetFloatv(GL_PROJECTION_MATRIX, proj);
+	camera.update(view, proj, width, height);
+
+	// ----- Filled cones and wireframes, in one unsorted translucent pass -----
+	oit.beginTranslucent();
+	coneBatch.draw(oitConeProgram, false, frame.detail);
+	coneBatch.draw(oitConeProgram, true, frame.detail);
+	oit.composite();
+	stats.drawCalls += 3;
+	stats.stateChanges += 8;
+}
+
+void LegacyRenderer::drawLabelPass(const FrameData &frame,
+		RenderStats &stats) {
+
+	// ----- Draw billboarded text ALWAYS visible -----
+	// Disable depth so text is never hidden
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glListBase(fontListBase);
+	stats.stateChanges += 4;
+
+	// The camera's rotation undone: its transpose
+	Mat4 unturn = mat4Rotation(frame.view);
+	for (int c = 0; c < 3; ++c) {
+		for (int row = c + 1; row < 3; ++row)
+			std::swap(unturn.m[c * 4 + row], unturn.m[row * 4 + c]);
+	}
+
+	for (const NodeInstance &n : frame.nodes) {
+		const string &label = n.node->label();
+		if (label.empty())
+			continue;
+
+		glPushMatrix();
+		glTranslatef(n.pos.x, n.pos.y, n.pos.z);
+
+		// Cancel scene rotations (billboard)
+		glMultMatrixf(unturn.m);
+
+		glRasterPos3f(0.35f, 0.0f, 0.0f);
+		glCallLists(label.size(), GL_UNSIGNED_BYTE, label.data());
+		stats.drawCalls++;
+
+		glPopMatrix();
+	}
+
+	// Restore depth settings
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+	stats.stateChanges += 2;
+}
+
+void LegacyRenderer::drawPanelPass(const FrameData &frame,
+		RenderStats &stats) {
+
+	// ----- Panel text in window coordinates, top left -----
+	glDisable(GL_DEPTH_TEST);
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glListBase(fontListBase);
+	stats.stateChanges += 3;
+
+	for (size_t line = 0; line < frame.panel.size(); ++line) {
+		const string &text = frame.panel[line];
+		glWindowPos2i(10, height - 10 - 15 * (line + 1));
+		glCallLists(text.size(), GL_UNSIGNED_BYTE, text.data());
+		stats.drawCalls++;
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	stats.stateChanges++;
+}
+
+void LegacyRenderer::drawOverview(const FrameData &frame,
+		RenderStats &stats) {
+
+	const OverviewData &o = frame.overview;
+
+	// Border and background, then the viewport inside the border
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(o.x - 1, o.y - 1, o.size + 2, o.size + 2);
+	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(o.x, o.y, o.size, o.size);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glViewport(o.x, o.y, o.size, o.size);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadMatrixf(overviewProjectionMatrix(frame).m);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(overviewViewMatrix(frame).m);
+	stats.stateChanges += 12;
+
+	// ----- Nodes as points straight from the overview's node array -----
+	glPointSize(2.0f);
+	if (frame.nodeColors) {
+		glBegin(GL_POINTS);
+		for (const NodeInstance &n : o.nodes) {
+			glColor3fv(frame.nodeColors + n.node->index * 3);
+			glVertex3f(n.pos.x, n.pos.y, n.pos.z);
+		}
+		glEnd();
+		stats.drawCalls++;
+		stats.stateChanges++;
+	} else if (!o.nodes.empty()) {
+		glColor3f(0.0f, 0.0f, 1.0f);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, sizeof(NodeInstance), &o.nodes[0].pos);
+		glDrawArrays(GL_POINTS, 0, o.nodes.size());
+		glDisableClientState(GL_VERTEX_ARRAY);
+		stats.drawCalls++;
+		stats.stateChanges += 4;
+	}
+
+	// ----- Coarse filled cones, no wireframes, none under about a pixel -----
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	drawConeInstances(frame, o.cones, false, DETAIL_COARSE, stats,
+			2.0f * o.radius / o.size);
+	glDisable(GL_BLEND);
+
+	// ----- Main view frustum -----
+	Pos outline[OVERVIEW_OUTLINE_POINTS];
+	frustumOutline(frame, outline);
+	glColor3f(1.0f, 1.0f, 0.0f);
+	glBegin(GL_LINES);
+	for (const Pos &p : outline)
+		glVertex3f(p.x, p.y, p.z);
+	glEnd();
+	stats.drawCalls++;
+	stats.stateChanges += 3;
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glViewport(0, 0, width, height);
+	glDisable(GL_SCISSOR_TEST);
+	stats.stateChanges += 2;
+}
+
+void LegacyRenderer::draw(const FrameData &frame, RenderStats &stats) {
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glLoadMatrixf(frame.view.m);
+
+	if (oitReady && frame.oit) {
+		oit.resize(width, height);
+		oit.beginOpaque();
+		drawSpherePass(frame, stats);
+		drawOitConePass(frame, stats);
+		oit.present();
+	} else {
+		drawSpherePass(frame, stats);
+		drawConePasses(frame, stats);
+	}
+	if (frame.labels)
+		drawLabelPass(frame, stats);
+	if (!frame.panel.empty())
+		drawPanelPass(frame, stats);
+	if (frame.overview.enabled)
+		drawOverview(frame, stats);
+}
+
+Renderer* createLegacyRenderer() {
+
+	return new LegacyRenderer();
+}
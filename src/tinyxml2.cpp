@@ -31,6 +31,9 @@ distribution.
 #   include <cstddef>
 #   include <cstdarg>
 #endif
+#if defined(__linux__)
+#   include <sys/mman.h>
+#endif
 
 // Handle fallthrough attribute for different compilers
 #ifndef __has_attribute
@@ -170,6 +173,41 @@ static const Entity entities[NUM_ENTITIES] = {
 };
 
 
+void* AllocPoolBlock( size_t bytes, bool* mapped )
+{
+#if defined(__linux__)
+    if ( bytes >= TINYXML2_LARGE_BLOCK_SIZE ) {
+        void* mem = mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( mem != MAP_FAILED ) {
+#   if defined(MADV_HUGEPAGE)
+            // Transparent huge pages: a hint, ignored where disabled.
+            madvise( mem, bytes, MADV_HUGEPAGE );
+#   endif
+            *mapped = true;
+            return mem;
+        }
+    }
+#endif
+    *mapped = false;
+    return ::operator new( bytes );
+}
+
+
+void FreePoolBlock( void* mem, size_t bytes, bool mapped )
+{
+#if defined(__linux__)
+    if ( mapped ) {
+        munmap( mem, bytes );
+        return;
+    }
+#else
+    (void)bytes;
+    (void)mapped;
+#endif
+    ::operator delete( mem );
+}
+
+
 StrPair::~StrPair()
 {
     Reset();
@@ -307,96 +345,127 @@ const char* StrPair::GetStr()
         *_end = 0;
         _flags ^= NEEDS_FLUSH;
 
-        if ( _flags ) {
-            const char* p = _start;	// the read pointer
-            char* q = _start;	// the write pointer
-
-            while( p < _end ) {
-                if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == CR ) {
-                    // CR-LF pair becomes LF
-                    // CR alone becomes LF
-                    // LF-CR becomes LF
-                    if ( *(p+1) == LF ) {
-                        p += 2;
-                    }
-                    else {
-                        ++p;
-                    }
-                    *q = LF;
+        if ( _flags & ( NEEDS_ENTITY_PROCESSING | NEEDS_NEWLINE_NORMALIZATION ) ) {
+            XMLUtil::TranslateText( _start, _end, _flags & ( NEEDS_ENTITY_PROCESSING | NEEDS_NEWLINE_NORMALIZATION ) );
+        }
+        // Translation has plenty going on, and this
+        // is a less useful mode. Break it out.
+        if ( _flags & NEEDS_WHITESPACE_COLLAPSING ) {
+            CollapseWhitespace();
+        }
+        _flags = (_flags & NEEDS_DELETE);
+    }
+    TIXMLASSERT( _start );
+    return _start;
+}
+
+
+char* XMLUtil::TranslateText( char* start, char* end, int flags )
+{
+    TIXMLASSERT( start );
+    TIXMLASSERT( end );
+    *end = 0;
+    const char* p = start;	// the read pointer
+    char* q = start;	// the write pointer
+
+    while( p < end ) {
+        if ( (flags & StrPair::NEEDS_NEWLINE_NORMALIZATION) && *p == CR ) {
+            // CR-LF pair becomes LF
+            // CR alone becomes LF
+            // LF-CR becomes LF
+            if ( *(p+1) == LF ) {
+                p += 2;
+            }
+            else {
+                ++p;
+            }
+            *q = LF;
+            ++q;
+        }
+        else if ( (flags & StrPair::NEEDS_NEWLINE_NORMALIZATION) && *p == LF ) {
+            if ( *(p+1) == CR ) {
+                p += 2;
+            }
+            else {
+                ++p;
+            }
+            *q = LF;
+            ++q;
+        }
+        else if ( (flags & StrPair::NEEDS_ENTITY_PROCESSING) && *p == '&' ) {
+            // Entities handled by tinyXML2:
+            // - special entities in the entity table [in/out]
+            // - numeric character reference [in]
+            //   &#20013; or &#x4e2d;
+
+            if ( *(p+1) == '#' ) {
+                const int buflen = 10;
+                char buf[buflen] = { 0 };
+                int len = 0;
+                const char* adjusted = const_cast<char*>( GetCharacterRef( p, buf, &len ) );
+                if ( adjusted == 0 ) {
+                    *q = *p;
+                    ++p;
                     ++q;
                 }
-                else if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == LF ) {
-                    if ( *(p+1) == CR ) {
-                        p += 2;
-                    }
-                    else {
-                        ++p;
-                    }
-                    *q = LF;
-                    ++q;
+                else {
+                    TIXMLASSERT( 0 <= len && len <= buflen );
+                    TIXMLASSERT( q + len <= adjusted );
+                    p = adjusted;
+                    memcpy( q, buf, len );
+                    q += len;
                 }
-                else if ( (_flags & NEEDS_ENTITY_PROCESSING) && *p == '&' ) {
-                    // Entities handled by tinyXML2:
-                    // - special entities in the entity table [in/out]
-                    // - numeric character reference [in]
-                    //   &#20013; or &#x4e2d;
-
-                    if ( *(p+1) == '#' ) {
-                        const int buflen = 10;
-                        char buf[buflen] = { 0 };
-                        int len = 0;
-                        const char* adjusted = const_cast<char*>( XMLUtil::GetCharacterRef( p, buf, &len ) );
-                        if ( adjusted == 0 ) {
-                            *q = *p;
-                            ++p;
-                            ++q;
-                        }
-                        else {
-                            TIXMLASSERT( 0 <= len && len <= buflen );
-                            TIXMLASSERT( q + len <= adjusted );
-                            p = adjusted;
-                            memcpy( q, buf, len );
-                            q += len;
-                        }
-                    }
-                    else {
-                        bool entityFound = false;
-                        for( int i = 0; i < NUM_ENTITIES; ++i ) {
-                            const Entity& entity = entities[i];
-                            if ( strncmp( p + 1, entity.pattern, entity.length ) == 0
-                                    && *( p + entity.length + 1 ) == ';' ) {
-                                // Found an entity - convert.
-                                *q = entity.value;
-                                ++q;
-                                p += entity.length + 2;
-                                entityFound = true;
-                                break;
-                            }
-                        }
-                        if ( !entityFound ) {
-                            // fixme: treat as error?
-                            ++p;
-                            ++q;
-                        }
+            }
+            else {
+                bool entityFound = false;
+                for( int i = 0; i < NUM_ENTITIES; ++i ) {
+                    const Entity& entity = entities[i];
+                    if ( strncmp( p + 1, entity.pattern, entity.length ) == 0
+                            && *( p + entity.length + 1 ) == ';' ) {
+                        // Found an entity - convert.
+                        *q = entity.value;
+                        ++q;
+                        p += entity.length + 2;
+                        entityFound = true;
+                        break;
                     }
                 }
-                else {
-                    *q = *p;
+                if ( !entityFound ) {
+                    // fixme: treat as error?
                     ++p;
                     ++q;
                 }
             }
-            *q = 0;
         }
-        // The loop below has plenty going on, and this
-        // is a less useful mode. Break it out.
-        if ( _flags & NEEDS_WHITESPACE_COLLAPSING ) {
-            CollapseWhitespace();
+        else {
+            *q = *p;
+            ++p;
+            ++q;
         }
-        _flags = (_flags & NEEDS_DELETE);
     }
-    TIXMLASSERT( _start );
-    return _start;
+    *q = 0;
+
+    if ( flags & StrPair::NEEDS_WHITESPACE_COLLAPSING ) {
+        // As StrPair::CollapseWhitespace(), but moving the text down
+        // instead of advancing the start.
+        p = SkipWhiteSpace( start, 0 );
+        q = start;
+        while( *p ) {
+            if ( IsWhiteSpace( *p )) {
+                p = SkipWhiteSpace( p, 0 );
+                if ( *p == 0 ) {
+                    break;    // trims the trailing space
+                }
+                *q = ' ';
+                ++q;
+            }
+            *q = *p;
+            ++q;
+            ++p;
+        }
+        *q = 0;
+    }
+    return q;
 }
 
 
@@ -1460,6 +1529,12 @@ const char* XMLAttribute::Value() const
     return _value.GetStr();
 }
 
+
+const char* XMLAttribute::RawValue( size_t* length ) const
+{
+    return _value.GetRaw( length );
+}
+
 char* XMLAttribute::ParseDeep( char* p, bool processEntities, int* curLineNumPtr )
 {
     // Parse using the name rules: bug fix, was using ParseText before
@@ -2210,6 +2285,8 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
     _errorStr(),
     _errorLineNum( 0 ),
     _charBuffer( 0 ),
+    _charBufferCapacity( 0 ),
+    _charBufferSize( 0 ),
     _parseCurLineNum( 0 ),
 	_parsingDepth(0),
     _unlinked(),
@@ -2226,6 +2303,7 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
 XMLDocument::~XMLDocument()
 {
     Clear();
+    delete [] _charBuffer;
 }
 
 
@@ -2254,8 +2332,7 @@ void XMLDocument::Clear()
 #endif
     ClearError();
 
-    delete [] _charBuffer;
-    _charBuffer = 0;
+    _charBufferSize = 0;
 	_parsingDepth = 0;
 
 #if 0
@@ -2273,6 +2350,48 @@ void XMLDocument::Clear()
         TIXMLASSERT( _commentPool.CurrentAllocs()   == _commentPool.Untracked() );
     }
 #endif
+
+    // Every node is gone: hand the blocks out again from the start.
+    _elementPool.Recycle();
+    _attributePool.Recycle();
+    _textPool.Recycle();
+    _commentPool.Recycle();
+}
+
+
+void XMLDocument::ReleaseMemory()
+{
+    Clear();
+    _elementPool.Clear();
+    _attributePool.Clear();
+    _textPool.Clear();
+    _commentPool.Clear();
+    delete [] _charBuffer;
+    _charBuffer = 0;
+    _charBufferCapacity = 0;
+}
+
+
+void XMLDocument::SetPoolBlockSize( size_t bytes )
+{
+    _elementPool.SetBlockSize( bytes );
+    _attributePool.SetBlockSize( bytes );
+    _textPool.SetBlockSize( bytes );
+    _commentPool.SetBlockSize( bytes );
+}
+
+
+char* XMLDocument::ReserveCharBuffer( size_t size )
+{
+    if ( size > _charBufferCapacity ) {
+        delete [] _charBuffer;
+        _charBuffer = 0;
+        _charBufferCapacity = 0;
+        _charBuffer = new char[size];
+        _charBufferCapacity = size;
+    }
+    _charBufferSize = size;
+    return _charBuffer;
 }
 
 
@@ -2420,8 +2539,7 @@ XMLError XMLDocument::LoadFile( FILE* fp )
     }
 
     const size_t size = static_cast<size_t>(filelength);
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[size+1];
+    ReserveCharBuffer( size+1 );
     const size_t read = fread( _charBuffer, 1, size, fp );
     if ( read != size ) {
         SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
@@ -2430,7 +2548,7 @@ XMLError XMLDocument::LoadFile( FILE* fp )
 
     _charBuffer[size] = 0;
 
-    Parse();
+    Parse( _charBuffer );
     return _errorID;
 }
 
@@ -2476,12 +2594,11 @@ XMLError XMLDocument::Parse( const char* xml, size_t nBytes )
     if ( nBytes == static_cast<size_t>(-1) ) {
         nBytes = strlen( xml );
     }
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[ nBytes+1 ];
+    ReserveCharBuffer( nBytes+1 );
     memcpy( _charBuffer, xml, nBytes );
     _charBuffer[nBytes] = 0;
 
-    Parse();
+    Parse( _charBuffer );
     if ( Error() ) {
         // clean up now essentially dangling memory.
         // and the parse fail can put objects in the
@@ -2496,6 +2613,30 @@ XMLError XMLDocument::Parse( const char* xml, size_t nBytes )
 }
 
 
+XMLError XMLDocument::ParseInPlace( char* buf, size_t len )
+{
+    Clear();
+
+    if ( len == 0 || !buf ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return _errorID;
+    }
+    buf[len] = 0;
+
+    Parse( buf );
+    if ( Error() ) {
+        // As in Parse(): drop the dead objects a failed parse leaves in
+        // the pools.
+        DeleteChildren();
+        _elementPool.Clear();
+        _attributePool.Clear();
+        _textPool.Clear();
+        _commentPool.Clear();
+    }
+    return _errorID;
+}
+
+
 void XMLDocument::Print( XMLPrinter* streamer ) const
 {
     if ( streamer ) {
@@ -2568,13 +2709,12 @@ const char* XMLDocument::ErrorName() const
     return ErrorIDToName(_errorID);
 }
 
-void XMLDocument::Parse()
+void XMLDocument::Parse( char* p )
 {
     TIXMLASSERT( NoChildren() ); // Clear() must have been called previously
-    TIXMLASSERT( _charBuffer );
+    TIXMLASSERT( p );
     _parseCurLineNum = 1;
     _parseLineNum = 1;
-    char* p = _charBuffer;
     p = XMLUtil::SkipWhiteSpace( p, &_parseCurLineNum );
     p = const_cast<char*>( XMLUtil::ReadBOM( p, &_writeBOM ) );
     if ( !*p ) {
@@ -111,6 +111,19 @@ static const int TIXML2_PATCH_VERSION = 0;
 // so there needs to be a limit in place.
 static const int TINYXML2_MAX_ELEMENT_DEPTH = 500;
 
+// Default bytes per memory pool block. Larger blocks mean fewer, larger
+// allocations when parsing big documents; XMLDocument::SetPoolBlockSize()
+// overrides it at runtime.
+#ifndef TINYXML2_POOL_BLOCK_SIZE
+#   define TINYXML2_POOL_BLOCK_SIZE (4 * 1024)
+#endif
+
+// Pool blocks of at least this many bytes are mapped directly and backed
+// by huge pages where the system supports it.
+#ifndef TINYXML2_LARGE_BLOCK_SIZE
+#   define TINYXML2_LARGE_BLOCK_SIZE (2 * 1024 * 1024)
+#endif
+
 namespace tinyxml2
 {
 class XMLDocument;
@@ -160,6 +173,16 @@ public:
 
     const char* GetStr();
 
+    // The span as parsed, before any translation, or null once GetStr()
+    // has translated it in place. Not null terminated.
+    const char* GetRaw( size_t* length ) const {
+        if ( !( _flags & NEEDS_FLUSH ) ) {
+            return 0;
+        }
+        *length = static_cast<size_t>( _end - _start );
+        return _start;
+    }
+
     bool Empty() const {
         return _start == _end;
     }
@@ -318,6 +341,22 @@ private:
 };
 
 
+/**
+	Allocation counters of a memory pool. Counts are in items of
+	itemSize bytes; blockBytes is what the pool has reserved.
+*/
+struct MemPoolStats
+{
+    size_t itemSize;
+    size_t blocks;
+    size_t blockBytes;
+    size_t currentAllocs;
+    size_t maxAllocs;
+    size_t totalAllocs;
+    size_t untracked;
+};
+
+
 /*
 	Parent virtual class of a pool for fast allocation
 	and deallocation of objects.
@@ -335,23 +374,36 @@ public:
 };
 
 
+/*
+	Storage for pool blocks. Blocks of TINYXML2_LARGE_BLOCK_SIZE bytes or
+	more are mapped directly and, where the system supports it, advised to
+	use huge pages; 'mapped' tells FreePoolBlock() how to release them.
+*/
+TINYXML2_LIB void* AllocPoolBlock( size_t bytes, bool* mapped );
+TINYXML2_LIB void FreePoolBlock( void* mem, size_t bytes, bool mapped );
+
+
 /*
 	Template child class to create pools of the correct type.
+
+	Blocks are kept until Clear(): freed items go back on the free list, and
+	Recycle() re-threads the blocks of an emptied pool so a reloaded document
+	reuses them in address order instead of allocating again.
 */
 template< size_t ITEM_SIZE >
 class MemPoolT : public MemPool
 {
 public:
-    MemPoolT() : _blockPtrs(), _root(0), _currentAllocs(0), _nAllocs(0), _maxAllocs(0), _nUntracked(0)	{}
+    MemPoolT() : _blocks(), _root(0), _itemsPerBlock( DefaultItemsPerBlock() ), _currentAllocs(0), _nAllocs(0), _maxAllocs(0), _nUntracked(0)	{}
     ~MemPoolT() {
         MemPoolT< ITEM_SIZE >::Clear();
     }
 
     void Clear() {
         // Delete the blocks.
-        while( !_blockPtrs.Empty()) {
-            Block* lastBlock = _blockPtrs.Pop();
-            delete lastBlock;
+        while( !_blocks.Empty()) {
+            Block lastBlock = _blocks.Pop();
+            FreePoolBlock( lastBlock.items, lastBlock.count * sizeof( Item ), lastBlock.mapped );
         }
         _root = 0;
         _currentAllocs = 0;
@@ -360,6 +412,32 @@ public:
         _nUntracked = 0;
     }
 
+    // Makes every item of the retained blocks free again, in address
+    // order. Like Clear(), this reclaims items still allocated, so nothing
+    // may reference them any more.
+    void Recycle() {
+        _root = 0;
+        for( size_t b = _blocks.Size(); b > 0; --b ) {
+            const Block& block = _blocks[b - 1];
+            for( size_t i = block.count; i > 0; --i ) {
+                block.items[i - 1].next = _root;
+                _root = &block.items[i - 1];
+            }
+        }
+        _currentAllocs = 0;
+        _nAllocs = 0;
+        _maxAllocs = 0;
+        _nUntracked = 0;
+    }
+
+    // Bytes per block allocated from now on; at least one item.
+    void SetBlockSize( size_t bytes ) {
+        _itemsPerBlock = bytes < sizeof( Item ) ? 1 : bytes / sizeof( Item );
+    }
+    size_t BlockSize() const {
+        return _itemsPerBlock * sizeof( Item );
+    }
+
     virtual size_t ItemSize() const override {
         return ITEM_SIZE;
     }
@@ -370,14 +448,16 @@ public:
     virtual void* Alloc() override{
         if ( !_root ) {
             // Need a new block.
-            Block* block = new Block;
-            _blockPtrs.Push( block );
+            Block block;
+            block.count = _itemsPerBlock;
+            block.items = static_cast<Item*>( AllocPoolBlock( block.count * sizeof( Item ), &block.mapped ) );
+            _blocks.Push( block );
 
-            Item* blockItems = block->items;
-            for( size_t i = 0; i < ITEMS_PER_BLOCK - 1; ++i ) {
+            Item* blockItems = block.items;
+            for( size_t i = 0; i < block.count - 1; ++i ) {
                 blockItems[i].next = &(blockItems[i + 1]);
             }
-            blockItems[ITEMS_PER_BLOCK - 1].next = 0;
+            blockItems[block.count - 1].next = 0;
             _root = blockItems;
         }
         Item* const result = _root;
@@ -408,7 +488,7 @@ public:
     void Trace( const char* name ) {
         printf( "Mempool %s watermark=%d [%dk] current=%d size=%d nAlloc=%d blocks=%d\n",
                 name, _maxAllocs, _maxAllocs * ITEM_SIZE / 1024, _currentAllocs,
-                ITEM_SIZE, _nAllocs, _blockPtrs.Size() );
+                ITEM_SIZE, _nAllocs, _blocks.Size() );
     }
 
     void SetTracked() override {
@@ -419,8 +499,23 @@ public:
         return _nUntracked;
     }
 
-	// This number is perf sensitive. 4k seems like a good tradeoff on my machine.
-	// The test file is large, 170k.
+    MemPoolStats Stats() const {
+        MemPoolStats stats;
+        stats.itemSize = ITEM_SIZE;
+        stats.blocks = _blocks.Size();
+        stats.blockBytes = 0;
+        for( size_t b = 0; b < _blocks.Size(); ++b ) {
+            stats.blockBytes += _blocks[b].count * sizeof( Item );
+        }
+        stats.currentAllocs = _currentAllocs;
+        stats.maxAllocs = _maxAllocs;
+        stats.totalAllocs = _nAllocs;
+        stats.untracked = _nUntracked;
+        return stats;
+    }
+
+	// The default block size is perf sensitive. 4k seems like a good
+	// tradeoff on my machine. The test file is large, 170k.
 	// Release:		VS2010 gcc(no opt)
 	//		1k:		4000
 	//		2k:		4000
@@ -428,9 +523,11 @@ public:
 	//		16k:	5200
 	//		32k:	4300
 	//		64k:	4000	21000
-    // Declared public because some compilers do not accept to use ITEMS_PER_BLOCK
-    // in private part if ITEMS_PER_BLOCK is private
-    enum { ITEMS_PER_BLOCK = (4 * 1024) / ITEM_SIZE };
+	// Documents of hundreds of megabytes want far larger blocks; see
+	// TINYXML2_POOL_BLOCK_SIZE and XMLDocument::SetPoolBlockSize().
+    static size_t DefaultItemsPerBlock() {
+        return TINYXML2_POOL_BLOCK_SIZE < ITEM_SIZE ? 1 : TINYXML2_POOL_BLOCK_SIZE / ITEM_SIZE;
+    }
 
 private:
     MemPoolT( const MemPoolT& ); // not supported
@@ -441,10 +538,13 @@ private:
         char    itemData[static_cast<size_t>(ITEM_SIZE)];
     };
     struct Block {
-        Item items[ITEMS_PER_BLOCK];
+        Item*   items;
+        size_t  count;
+        bool    mapped;
     };
-    DynArray< Block*, 10 > _blockPtrs;
+    DynArray< Block, 10 > _blocks;
     Item* _root;
+    size_t _itemsPerBlock;
 
     size_t _currentAllocs;
     size_t _nAllocs;
@@ -609,6 +709,14 @@ public:
     // p is the starting location,
     // the UTF-8 value of the entity will be placed in value, and length filled in.
     static const char* GetCharacterRef( const char* p, char* value, int* length );
+
+    /**
+        Applies the StrPair::Mode 'flags' (entities, newlines, whitespace
+        collapsing) to [start, end) in place and null terminates the
+        result, whose end is returned. *end must be writable; it is
+        overwritten with the terminator first.
+    */
+    static char* TranslateText( char* start, char* end, int flags );
     static void ConvertUTF32ToUTF8( unsigned long input, char* output, int* length );
 
     // converts primitive types to strings
@@ -1148,6 +1256,14 @@ public:
     /// The value of the attribute.
     const char* Value() const;
 
+    /**
+        The value exactly as in the source, 'length' bytes with entities
+        and newlines untranslated and no terminator. Returns null once
+        Value() has been read. Lets a caller copy values now and translate
+        them later, with XMLUtil::TranslateText(), only if ever needed.
+    */
+    const char* RawValue( size_t* length ) const;
+
     /// Gets the line number the attribute is in, if the document was parsed from a file.
     int GetLineNum() const { return _parseLineNum; }
 
@@ -1751,6 +1867,17 @@ public:
     */
     XMLError Parse( const char* xml, size_t nBytes=static_cast<size_t>(-1) );
 
+    /**
+        Parse 'len' bytes of XML directly in the caller's buffer, without
+        copying it. The buffer must be writable and hold len + 1 bytes:
+        parsing writes string terminators into it, the first at buf[len].
+        Elements, attributes and text point into the buffer, so it must
+        outlive the document or its next Clear().
+
+        Returns XML_SUCCESS (0) on success, or an errorID.
+    */
+    XMLError ParseInPlace( char* buf, size_t len );
+
     /**
     	Load an XML file from disk.
     	Returns XML_SUCCESS (0) on success, or
@@ -1904,9 +2031,25 @@ public:
         return _errorLineNum;
     }
 
-    /// Clear the document, resetting it to the initial state.
+    /**
+        Clear the document, resetting it to the initial state. The memory
+        pool blocks and the character buffer are kept for the next Parse()
+        or LoadFile(), so reloading a document does not go back to the
+        allocator; ReleaseMemory() returns them.
+    */
     void Clear();
 
+    /// Clear() the document and free the memory it kept for reuse.
+    void ReleaseMemory();
+
+    /**
+        Bytes per block for the element, attribute, text and comment pools,
+        applied to blocks allocated from now on. The default is
+        TINYXML2_POOL_BLOCK_SIZE; blocks of TINYXML2_LARGE_BLOCK_SIZE or
+        more are backed by huge pages where available.
+    */
+    void SetPoolBlockSize( size_t bytes );
+
 	/**
 		Copies this document to a target document.
 		The target will be completely cleared before the copy.
@@ -1916,6 +2059,25 @@ public:
 	*/
 	void DeepCopy(XMLDocument* target) const;
 
+    /// Statistics of the pools holding elements, attributes, text and comments.
+    MemPoolStats ElementPoolStats() const {
+        return _elementPool.Stats();
+    }
+    MemPoolStats AttributePoolStats() const {
+        return _attributePool.Stats();
+    }
+    MemPoolStats TextPoolStats() const {
+        return _textPool.Stats();
+    }
+    MemPoolStats CommentPoolStats() const {
+        return _commentPool.Stats();
+    }
+
+    /// Bytes of the document's own copy of the parsed input, 0 if none.
+    size_t CharBufferSize() const {
+        return _charBufferSize;
+    }
+
 	// internal
     char* Identify( char* p, XMLNode** node, bool first );
 
@@ -1940,6 +2102,8 @@ private:
     mutable StrPair	_errorStr;
     int             _errorLineNum;
     char*			_charBuffer;
+    size_t			_charBufferCapacity;
+    size_t			_charBufferSize;
     int				_parseCurLineNum;
 	int				_parsingDepth;
 	// Memory tracking does add some overhead.
@@ -1957,7 +2121,11 @@ private:
 
 	static const char* _errorNames[XML_ERROR_COUNT];
 
-    void Parse();
+    void Parse( char* p );
+
+    // Points _charBuffer at 'size' bytes, reusing the kept buffer if it is
+    // large enough.
+    char* ReserveCharBuffer( size_t size );
 
     void SetError( XMLError error, int lineNum, const char* format, ... );
 
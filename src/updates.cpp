@@ -0,0 +1,478 @@
+
+#include "updates.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// Updates read ahead of the main thread before the reader waits for it,
+// a few frames' worth
+static const size_t queueCapacity = 1 << 15;
+static const size_t readBufferSize = 1 << 16;
+
+UpdateStream::UpdateStream() :
+		input(-1), listening(false), stopping(false), finished(false) {
+}
+
+UpdateStream::~UpdateStream() {
+	close();
+}
+
+bool UpdateStream::open(const string &source) {
+
+	close();
+	if (source == "-") {
+		input = STDIN_FILENO;
+	} else {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (source.size() >= sizeof(addr.sun_path))
+			return false;
+		strcpy(addr.sun_path, source.c_str());
+
+		// Only ever replace a socket, never a file someone left there
+		struct stat st;
+		if (lstat(source.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+			unlink(source.c_str());
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+			return false;
+		if (bind(fd, (const sockaddr*) &addr, sizeof(addr)) != 0
+				|| listen(fd, 16) != 0) {
+			::close(fd);
+			return false;
+		}
+		input = fd;
+		listening = true;
+		socketPath = source;
+	}
+	stopping = false;
+	finished = false;
+	reader = thread(&UpdateStream::read, this);
+	return true;
+}
+
+void UpdateStream::close() {
+
+	{
+		lock_guard<mutex> hold(lock);
+		stopping = true;
+	}
+	space.notify_all();
+	if (reader.joinable())
+		reader.join();
+	if (listening) {
+		::close(input);
+		unlink(socketPath.c_str());
+	}
+	input = -1;
+	listening = false;
+	socketPath.clear();
+	queue.clear();
+}
+
+bool UpdateStream::take(vector<Update> &batch, size_t limit) {
+
+	batch.clear();
+	{
+		lock_guard<mutex> hold(lock);
+		if (queue.empty())
+			return false;
+		auto last = queue.begin() + min(limit, queue.size());
+		move(queue.begin(), last, back_inserter(batch));
+		queue.erase(queue.begin(), last);
+	}
+	space.notify_all();
+	return true;
+}
+
+bool UpdateStream::ended() {
+
+	if (!finished || listening)
+		return false;
+	lock_guard<mutex> hold(lock);
+	return queue.empty();
+}
+
+// Hands what a read parsed to the main thread, first waiting for room.
+// False once the stream is closing.
+bool UpdateStream::push(vector<Update> &parsed) {
+
+	unique_lock<mutex> hold(lock);
+	space.wait(hold, [this] {
+		return stopping || queue.size() < queueCapacity;
+	});
+	if (stopping)
+		return false;
+	move(parsed.begin(), parsed.end(), back_inserter(queue));
+	parsed.clear();
+	return true;
+}
+
+// The reader thread: stdin alone, or the listening socket and every sender
+// connected to it. Each sender has its own unfinished line.
+void UpdateStream::read() {
+
+	struct Sender {
+		int fd;
+		string partial;
+	};
+	vector<Sender> senders;
+	if (!listening)
+		senders.push_back( { input, { } });
+
+	vector<char> buffer(readBufferSize);
+	vector<Update> parsed;
+	vector<pollfd> fds;
+	while (!stopping) {
+		size_t first = listening ? 1 : 0;
+		fds.clear();
+		if (listening)
+			fds.push_back( { input, POLLIN, 0 });
+		for (const Sender &s : senders)
+			fds.push_back( { s.fd, POLLIN, 0 });
+		if (fds.empty())
+			break;
+		// Wake up now and then to notice close()
+		if (poll(fds.data(), fds.size(), 100) <= 0)
+			continue;
+
+		for (size_t i = first; i < fds.size(); ++i) {
+			if (!fds[i].revents)
+				continue;
+			Sender &s = senders[i - first];
+			ssize_t got = ::read(s.fd, buffer.data(), buffer.size());
+			if (got < 0 && (errno == EINTR || errno == EAGAIN))
+				continue;
+			if (got <= 0) {
+				if (!s.partial.empty())
+					parse(s.partial.data(), s.partial.size(), parsed);
+				if (s.fd != STDIN_FILENO)
+					::close(s.fd);
+				s.fd = -1;
+				continue;
+			}
+			const char *at = buffer.data(), *end = at + got;
+			while (const char *newline = (const char*) memchr(at, '\n',
+					end - at)) {
+				if (s.partial.empty()) {
+					parse(at, newline - at, parsed);
+				} else {
+					s.partial.append(at, newline);
+					parse(s.partial.data(), s.partial.size(), parsed);
+					s.partial.clear();
+				}
+				at = newline + 1;
+			}
+			s.partial.append(at, end);
+		}
+		senders.erase(remove_if(senders.begin(), senders.end(),
+				[](const Sender &s) {
+					return s.fd < 0;
+				}), senders.end());
+
+		if (listening && (fds[0].revents & POLLIN)) {
+			int fd = accept4(input, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd >= 0)
+				senders.push_back( { fd, { } });
+		}
+		if (!parsed.empty() && !push(parsed))
+			break;
+	}
+	for (const Sender &s : senders)
+		if (s.fd != STDIN_FILENO)
+			::close(s.fd);
+	finished = true;
+}
+
+void UpdateStream::parse(const char *line, size_t length, vector<Update> &out) {
+
+	const char *at = line, *end = line + length;
+	if (at < end && end[-1] == '\r')
+		end--;
+	auto blank = [](char c) {
+		return c == ' ' || c == '\t';
+	};
+	auto skipBlanks = [&] {
+		while (at < end && blank(*at))
+			at++;
+	};
+	auto word = [&] {
+		skipBlanks();
+		const char *start = at;
+		while (at < end && !blank(*at))
+			at++;
+		return string(start, at);
+	};
+	auto number = [&](float &value) {
+		string w = word();
+		char *stop;
+		value = strtof(w.c_str(), &stop);
+		return !w.empty() && *stop == '\0' && isfinite(value);
+	};
+
+	skipBlanks();
+	if (at == end || *at == '#')
+		return;
+
+	Update u;
+	u.op = Update::INVALID;
+	u.valueCount = 0;
+	string command = word();
+	bool valid;
+	if (command == "add") {
+		u.op = Update::ADD;
+		u.id = word();
+		u.parent = word();
+		skipBlanks();
+		u.text.assign(at, end);
+		valid = !u.id.empty() && !u.parent.empty();
+	} else if (command == "remove") {
+		u.op = Update::REMOVE;
+		u.id = word();
+		valid = !u.id.empty();
+	} else if (command == "label") {
+		u.op = Update::LABEL;
+		u.id = word();
+		skipBlanks();
+		u.text.assign(at, end);
+		valid = !u.id.empty();
+	} else if (command == "weight") {
+		u.op = Update::WEIGHT;
+		u.id = word();
+		u.valueCount = 1;
+		valid = !u.id.empty() && number(u.values[0]) && u.values[0] > 0.0f;
+	} else if (command == "select") {
+		u.op = Update::SELECT;
+		u.id = word();
+		valid = true;
+	} else if (command == "camera") {
+		u.op = Update::CAMERA;
+		valid = true;
+		for (skipBlanks(); valid && at < end && u.valueCount < 5; skipBlanks())
+			valid = number(u.values[u.valueCount++]);
+		valid = valid && at == end
+				&& (u.valueCount == 3 || u.valueCount == 5);
+	} else {
+		valid = false;
+	}
+	skipBlanks();
+	if (u.op != Update::ADD && u.op != Update::LABEL && at != end)
+		valid = false;
+
+	if (!valid) {
+		u.op = Update::INVALID;
+		u.text.assign(line, end);
+	}
+	out.push_back(std::move(u));
+}
+
+StreamedTree::StreamedTree() :
+		root(nullptr), batch(1) {
+}
+
+StreamedTree::~StreamedTree() {
+	collect();
+}
+
+void StreamedTree::reset(Node *r) {
+
+	collect();
+	dirty.clear();
+	entries.clear();
+	ids.clear();
+	root = r;
+	if (root) {
+		auto named = ids.emplace("root", Entry()).first;
+		Entry &e = named->second;
+		e.node = root;
+		e.id = &named->first;
+		entries[root] = &e;
+	}
+}
+
+StreamedTree::Entry* StreamedTree::lookup(const string &id) {
+
+	auto found = ids.find(id);
+	return found != ids.end() ? &found->second : nullptr;
+}
+
+void StreamedTree::mark(Entry *entry) {
+
+	if (entry->dirtyIn != batch) {
+		entry->dirtyIn = batch;
+		dirty.push_back(entry);
+	}
+}
+
+bool StreamedTree::apply(const Update &u, string &error) {
+
+	Entry *entry = nullptr;
+	if (u.op != Update::ADD) {
+		entry = lookup(u.id);
+		if (!entry) {
+			error = "No node " + u.id;
+			return false;
+		}
+	}
+
+	switch (u.op) {
+	case Update::ADD: {
+		Entry *parent = lookup(u.parent);
+		if (!parent) {
+			error = "No node " + u.parent;
+			return false;
+		}
+		auto named = ids.emplace(u.id, Entry());
+		if (!named.second) {
+			error = "There is a node " + u.id + " already";
+			return false;
+		}
+		Node *child = new Node();
+		child->text = u.text;
+		Entry &e = named.first->second;
+		e.node = child;
+		e.parent = parent;
+		e.id = &named.first->first;
+		entries[child] = &e;
+		// Appended for now, see takeDirty()
+		parent->node->children.push_back(child);
+		parent->appended++;
+		mark(parent);
+		return true;
+	}
+	case Update::REMOVE: {
+		Entry *parent = entry->parent;
+		if (!parent) {
+			error = "The root cannot be removed";
+			return false;
+		}
+		auto &children = parent->node->children;
+		// New children are at the back
+		size_t slot = children.rend()
+				- std::find(children.rbegin(), children.rend(), entry->node) - 1;
+		if (slot >= children.size() - parent->appended)
+			parent->appended--;
+		children.erase(children.begin() + slot);
+		mark(parent);
+		removedRoots.push_back(entry->node);
+		forget(entry);
+		return true;
+	}
+	case Update::LABEL:
+		entry->node->text = u.text;
+		entry->node->rawText = false;
+		entry->node->textAsRead = false;
+		return true;
+	case Update::WEIGHT:
+		entry->node->weight = u.values[0];
+		mark(entry->parent ? entry->parent : entry);
+		return true;
+	default:
+		error = "Not a tree update";
+		return false;
+	}
+}
+
+// Drops the IDs of a node and its subtree, which is being removed.
+void StreamedTree::forget(Entry *entry) {
+
+	vector<Node*> stack(1, entry->node);
+	while (!stack.empty()) {
+		Node *n = stack.back();
+		stack.pop_back();
+		auto e = entries.find(n);
+		e->second->removed = true;
+		removedIds.push_back(ids.extract(ids.find(*e->second->id)));
+		entries.erase(e);
+		doomed.insert(n);
+		stack.insert(stack.end(), n->children.begin(), n->children.end());
+	}
+}
+
+void StreamedTree::path(const Entry *entry, vector<Node*> &path) {
+
+	path.clear();
+	for (; entry; entry = entry->parent)
+		path.push_back(entry->node);
+	reverse(path.begin(), path.end());
+}
+
+bool StreamedTree::path(const string &id, vector<Node*> &p) const {
+
+	auto found = ids.find(id);
+	if (found == ids.end())
+		return false;
+	path(&found->second, p);
+	return true;
+}
+
+bool StreamedTree::takeDirty(vector<vector<Node*>> &paths, size_t limit) {
+
+	paths.clear();
+	for (Entry *e : dirty) {
+		if (e->removed || !e->appended)
+			continue;
+		// Newest first, ahead of the children there were
+		auto &children = e->node->children;
+		auto added = children.end() - e->appended;
+		reverse(added, children.end());
+		rotate(children.begin(), added, children.end());
+		e->appended = 0;
+	}
+
+	// Whether a node or one above it is marked, found once per node however
+	// many marked nodes share it as an ancestor
+	vector<Entry*> chain;
+	size_t length = 0;
+	bool fits = true;
+	for (Entry *e : dirty) {
+		if (e->removed)
+			continue;
+		chain.clear();
+		bool above = false;
+		for (Entry *a = e->parent; a; a = a->parent) {
+			if (a->seenIn == batch) {
+				above = a->under;
+				break;
+			}
+			chain.push_back(a);
+		}
+		for (auto a = chain.rbegin(); a != chain.rend(); ++a) {
+			above = above || (*a)->dirtyIn == batch;
+			(*a)->under = above;
+			(*a)->seenIn = batch;
+		}
+		// The layout visits each of these nodes once, however many paths
+		// they are on
+		length += chain.size() + 1;
+		fits = fits && length <= limit;
+		if (above || !fits)
+			continue;
+		paths.emplace_back();
+		path(e, paths.back());
+	}
+	dirty.clear();
+	batch++;
+	if (!fits)
+		paths.clear();
+	return fits;
+}
+
+void StreamedTree::collect() {
+
+	for (Node *n : removedRoots)
+		deleteTree(n);
+	removedRoots.clear();
+	removedIds.clear();
+	doomed.clear();
+}
@@ -0,0 +1,151 @@
+
+#ifndef UPDATES_H
+#define UPDATES_H
+
+#include "conetree.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// --updates: other local processes grow and edit the tree while it is
+// shown, one command per line, on stdin or a Unix socket:
+//
+//   add ID PARENT LABEL       a new leaf under PARENT
+//   remove ID                 the node and its subtree
+//   label ID LABEL
+//   weight ID VALUE           its own weight in proportional layout
+//   select [ID]               its cone (its parent's for a leaf); all cones
+//                             without an ID
+//   camera ROTX ROTY ZOOM [PANX PANY]
+//
+// IDs are chosen by the sender and have no blanks; the map's root is
+// "root". A LABEL is the rest of the line. Blank lines and lines starting
+// with '#' are skipped.
+struct Update {
+	enum Op {
+		ADD, REMOVE, LABEL, WEIGHT, SELECT, CAMERA, INVALID
+	};
+	Op op;
+	std::string id;
+	std::string parent;		// ADD
+	std::string text;		// ADD, LABEL; the whole line for INVALID
+	float values[5];		// WEIGHT, CAMERA
+	int valueCount;
+};
+
+// Reads and parses the lines on a thread of its own. Updates queue up until
+// the main thread takes them, a frame's worth at a time; when the queue is
+// full the reader stops reading, so a sender faster than the viewer is held
+// back by its pipe or socket rather than by the viewer's memory.
+class UpdateStream {
+public:
+	UpdateStream();
+	~UpdateStream();
+
+	// "-" reads stdin; anything else is the path of a Unix socket to
+	// listen on, any number of senders at a time (a socket left at that
+	// path is replaced). False if it cannot be opened.
+	bool open(const std::string &source);
+
+	// Moves up to 'limit' of the updates read since the last call to
+	// 'batch', in the order they were read. Returns false if there were none.
+	bool take(std::vector<Update> &batch, size_t limit);
+
+	// stdin reached its end and everything read was taken
+	bool ended();
+
+	void close();
+
+private:
+	void read();
+	void parse(const char *line, size_t length, std::vector<Update> &out);
+	bool push(std::vector<Update> &parsed);
+
+	int input;			// stdin or the listening socket, -1 if closed
+	bool listening;
+	std::string socketPath;
+	std::thread reader;
+	std::atomic<bool> stopping;
+	std::atomic<bool> finished;
+
+	std::mutex lock;
+	std::condition_variable space;
+	std::deque<Update> queue;
+};
+
+// The nodes updates can name: the root and the nodes added since, each
+// with its ID and parent. Updates that change child lists or weights mark
+// the parent for layout; takeDirty() then hands over the parents to lay out
+// again, once per batch however many updates touched them. Entries link to
+// their parents' and carry the batch they were marked in, so finding which
+// marked nodes lie under others takes no lookups. Removed subtrees stay
+// allocated until collect(), so paths taken before a batch can still be
+// checked against removed().
+class StreamedTree {
+public:
+	StreamedTree();
+	~StreamedTree();
+
+	// Forgets every ID; 'root' becomes "root".
+	void reset(Node *root);
+
+	// ADD, REMOVE, LABEL and WEIGHT; false with 'error' set if the update
+	// names an unknown node or cannot be applied.
+	bool apply(const Update &update, std::string &error);
+
+	// The nodes from the root down to the one named 'id'; false if there
+	// is none.
+	bool path(const std::string &id, std::vector<Node*> &path) const;
+
+	// Removed in this batch
+	bool removed(const Node *node) const {
+		return doomed.count(node) != 0;
+	}
+
+	// The paths to the nodes whose children or weights changed, leaving out
+	// those under another one (whose layout covers them), and forgets them.
+	// False, with no paths, if they hold more than 'limit' different nodes:
+	// laying out the whole tree is cheaper then. New children, appended
+	// while the batch ran, are moved to the front here: child lists are kept
+	// last-to-first.
+	bool takeDirty(std::vector<std::vector<Node*>> &paths, size_t limit);
+
+	// Frees the subtrees removed in this batch.
+	void collect();
+
+private:
+	struct Entry {
+		Node *node;
+		Entry *parent;			// null for the root
+		const std::string *id;	// key in 'ids'
+		size_t appended;		// children added this batch, at the back
+		unsigned dirtyIn;		// batch the node was marked in
+		unsigned seenIn;		// batch takeDirty() set 'under' in
+		bool under;				// the node or one above it is marked
+		bool removed;
+	};
+	typedef std::unordered_map<std::string, Entry> IdMap;
+
+	Entry* lookup(const std::string &id);
+	void mark(Entry *entry);
+	void forget(Entry *entry);
+	static void path(const Entry *entry, std::vector<Node*> &path);
+
+	Node *root;
+	unsigned batch;
+	IdMap ids;
+	std::unordered_map<const Node*, Entry*> entries;	// to remove subtrees
+	std::vector<Entry*> dirty;
+	// Removed entries, which 'dirty' may still point to, and their nodes
+	std::vector<IdMap::node_type> removedIds;
+	std::unordered_set<const Node*> doomed;
+	std::vector<Node*> removedRoots;
+};
+
+#endif // UPDATES_H
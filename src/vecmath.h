@@ -0,0 +1,191 @@
+
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <cmath>
+
+// Minimal column-major 4x4 matrix math for the core-profile renderer and
+// the camera, laid out like OpenGL's fixed-function matrices
+// (m[column * 4 + row]).
+struct Mat4 {
+	float m[16];
+
+	static Mat4 identity() {
+		Mat4 r = { { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+		return r;
+	}
+};
+
+inline Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+
+	Mat4 r;
+	for (int c = 0; c < 4; ++c) {
+		for (int row = 0; row < 4; ++row) {
+			float s = 0.0f;
+			for (int k = 0; k < 4; ++k)
+				s += a.m[k * 4 + row] * b.m[c * 4 + k];
+			r.m[c * 4 + row] = s;
+		}
+	}
+	return r;
+}
+
+// Same as glTranslatef
+inline Mat4 mat4Translate(float x, float y, float z) {
+
+	Mat4 r = Mat4::identity();
+	r.m[12] = x;
+	r.m[13] = y;
+	r.m[14] = z;
+	return r;
+}
+
+// Same as glRotatef (angle in degrees, axis need not be normalized)
+inline Mat4 mat4Rotate(float deg, float x, float y, float z) {
+
+	float len = sqrtf(x * x + y * y + z * z);
+	if (len == 0.0f)
+		return Mat4::identity();
+	x /= len;
+	y /= len;
+	z /= len;
+
+	float a = deg * (float) M_PI / 180.0f;
+	float c = cosf(a), s = sinf(a), t = 1.0f - c;
+
+	Mat4 r = Mat4::identity();
+	r.m[0] = x * x * t + c;
+	r.m[1] = y * x * t + z * s;
+	r.m[2] = x * z * t - y * s;
+	r.m[4] = x * y * t - z * s;
+	r.m[5] = y * y * t + c;
+	r.m[6] = y * z * t + x * s;
+	r.m[8] = x * z * t + y * s;
+	r.m[9] = y * z * t - x * s;
+	r.m[10] = z * z * t + c;
+	return r;
+}
+
+// Inverse of a rotation followed by a translation (a camera view matrix)
+inline Mat4 mat4RigidInverse(const Mat4 &a) {
+
+	Mat4 r = Mat4::identity();
+	for (int c = 0; c < 3; ++c) {
+		for (int row = 0; row < 3; ++row)
+			r.m[c * 4 + row] = a.m[row * 4 + c];
+	}
+	for (int row = 0; row < 3; ++row) {
+		r.m[12 + row] = -(r.m[row] * a.m[12] + r.m[4 + row] * a.m[13]
+				+ r.m[8 + row] * a.m[14]);
+	}
+	return r;
+}
+
+// The rotation of 'a' alone, its translation dropped
+inline Mat4 mat4Rotation(const Mat4 &a) {
+
+	Mat4 r = a;
+	r.m[12] = r.m[13] = r.m[14] = 0.0f;
+	return r;
+}
+
+// A rotation as a unit quaternion. Products compose like matrices: a * b
+// turns by b first.
+struct Quat {
+	float w, x, y, z;
+
+	static Quat identity() {
+		Quat r = { 1, 0, 0, 0 };
+		return r;
+	}
+};
+
+inline Quat operator*(const Quat &a, const Quat &b) {
+
+	Quat r;
+	r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	return r;
+}
+
+inline Quat quatNormalize(const Quat &q) {
+
+	float len = sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+	if (len == 0.0f)
+		return Quat::identity();
+	Quat r = { q.w / len, q.x / len, q.y / len, q.z / len };
+	return r;
+}
+
+inline Quat quatConjugate(const Quat &q) {
+
+	Quat r = { q.w, -q.x, -q.y, -q.z };
+	return r;
+}
+
+// Same rotation as mat4Rotate(deg, x, y, z)
+inline Quat quatRotate(float deg, float x, float y, float z) {
+
+	float len = sqrtf(x * x + y * y + z * z);
+	if (len == 0.0f)
+		return Quat::identity();
+	float half = deg * (float) M_PI / 360.0f;
+	float s = sinf(half) / len;
+	Quat r = { cosf(half), x * s, y * s, z * s };
+	return r;
+}
+
+// From a to b along the shorter arc, at constant angular speed
+inline Quat quatSlerp(const Quat &a, Quat b, float t) {
+
+	float d = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+	if (d < 0.0f) {
+		b = { -b.w, -b.x, -b.y, -b.z };
+		d = -d;
+	}
+	float wa = 1.0f - t, wb = t;
+	if (d < 0.9995f) {
+		float angle = acosf(d);
+		float s = sinf(angle);
+		wa = sinf(wa * angle) / s;
+		wb = sinf(wb * angle) / s;
+	}
+	Quat r = { wa * a.w + wb * b.w, wa * a.x + wb * b.x, wa * a.y + wb * b.y,
+			wa * a.z + wb * b.z };
+	return quatNormalize(r);
+}
+
+// The matrix of a unit quaternion
+inline Mat4 mat4Quat(const Quat &q) {
+
+	float w = q.w, x = q.x, y = q.y, z = q.z;
+	Mat4 r = Mat4::identity();
+	r.m[0] = 1.0f - 2.0f * (y * y + z * z);
+	r.m[1] = 2.0f * (x * y + w * z);
+	r.m[2] = 2.0f * (x * z - w * y);
+	r.m[4] = 2.0f * (x * y - w * z);
+	r.m[5] = 1.0f - 2.0f * (x * x + z * z);
+	r.m[6] = 2.0f * (y * z + w * x);
+	r.m[8] = 2.0f * (x * z + w * y);
+	r.m[9] = 2.0f * (y * z - w * x);
+	r.m[10] = 1.0f - 2.0f * (x * x + y * y);
+	return r;
+}
+
+// Same as gluPerspective
+inline Mat4 mat4Perspective(float fovyDeg, float aspect, float zNear,
+		float zFar) {
+
+	float f = 1.0f / tanf(fovyDeg * (float) M_PI / 360.0f);
+	Mat4 r = { { 0 } };
+	r.m[0] = f / aspect;
+	r.m[5] = f;
+	r.m[10] = (zFar + zNear) / (zNear - zFar);
+	r.m[11] = -1.0f;
+	r.m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+	return r;
+}
+
+#endif // VECMATH_H
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Edge lists load in any row order, with CSV quoting, tabs and several roots,
+# and duplicate ids, unknown parents and cycles fail naming the row.
+# Usage: test/import_edges.sh [path/to/conetree]
+set -e
+here=$(dirname "$0")
+viewer=${1:-$here/../Debug/conetree}
+. "$here/stats.sh"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Children before their parent, and a quoted label with a comma and quotes
+printf 'id,parent_id,label\n3,1,c\n1,,root\n2,1,"b, ""q"""\n4,2,d\n' \
+		> "$work/order.csv"
+expect_stats "$work/order.csv" 'Subtree of "root"' \
+		'4 nodes, max depth 2, 2 leaves, 12 label bytes'
+
+printf 'id\tparent_id\tlabel\n1\t\tr\n2\t1\tx\n3\t2\ty\n' > "$work/tabs.tsv"
+expect_stats "$work/tabs.tsv" 'Subtree of "r"' \
+		'3 nodes, max depth 2, 1 leaves, 3 label bytes'
+
+# Two roots are joined under one named for the file, with a warning
+printf '1,,r\n2,,s\n3,1,a\n' > "$work/roots.csv"
+expect_stats "$work/roots.csv" 'Subtree of "roots.csv"' \
+		'4 nodes, max depth 2, 2 leaves, 12 label bytes'
+grep -q "2 rows without a parent, joined under one root" "$work/out" || {
+	echo "FAIL: no warning for several roots"
+	exit 1
+}
+
+printf '1,,r\n2,1,a\n2,1,b\n' > "$work/duplicate.csv"
+expect_error "$work/duplicate.csv" 'duplicate id "2" at line 3'
+
+printf '1,,r\n2,9,a\n' > "$work/unknown.csv"
+expect_error "$work/unknown.csv" 'unknown parent "9" at line 2'
+
+printf '1,,r\n2,3,a\n3,2,b\n' > "$work/cycle.csv"
+expect_error "$work/cycle.csv" \
+		"Failed to load $work/cycle.csv as edge list: cycle through id \"2\" at line 2"
+echo "PASS import_edges"
@@ -0,0 +1,29 @@
+#!/bin/sh
+# JSON labels decode their escapes, \u surrogate pairs into one character
+# and a lone surrogate into U+FFFD, and the tree follows "children".
+# Usage: test/import_json.sh [path/to/conetree]
+set -e
+here=$(dirname "$0")
+viewer=${1:-$here/../Debug/conetree}
+. "$here/stats.sh"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Labels: e-acute, a grinning face from a surrogate pair, tab, quote,
+# backslash and slash (10 bytes); "lone " and U+FFFD (8); "n" (1)
+printf '{"text": "\\u00e9\\ud83d\\ude00\\t\\"\\\\\\/", "size": 3, "children": [
+	{"name": "lone \\udc00", "children": [{"title": "n"}]}]}\n' \
+		> "$work/escapes.json"
+expect_stats "$work/escapes.json" \
+		"$(printf 'Subtree of "\303\251\360\237\230\200\t"\\/"')" \
+		'3 nodes, max depth 2, 1 leaves, 19 label bytes'
+
+# A top-level array is joined under a root named for the file
+printf '[{"label": "a"}, {"text": "b", "children": [{"text": "c"}]}]\n' \
+		> "$work/forest.json"
+expect_stats "$work/forest.json" 'Subtree of "forest.json"' \
+		'4 nodes, max depth 2, 2 leaves, 14 label bytes'
+
+printf '{"text": "cut' > "$work/truncated.json"
+expect_error "$work/truncated.json" "Failed to load $work/truncated.json"
+echo "PASS import_json"
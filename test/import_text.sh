@@ -0,0 +1,25 @@
+#!/bin/sh
+# Indented text nests each line under the last one indented less, a tab
+# counting as 4 columns, and drops bullets and blank lines.
+# Usage: test/import_text.sh [path/to/conetree]
+set -e
+here=$(dirname "$0")
+viewer=${1:-$here/../Debug/conetree}
+. "$here/stats.sh"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# c, under a tab, is a child of b like a1 and a2 are of a
+printf 'root\n  a\n    a1\n    a2\n  b\n\tc\n' > "$work/indent.txt"
+expect_stats "$work/indent.txt" 'Subtree of "root"' \
+		'6 nodes, max depth 2, 3 leaves, 11 label bytes'
+
+# b, between root and a in depth, is a's sibling
+printf 'root\n    a\n  b\n' > "$work/uneven.txt"
+expect_stats "$work/uneven.txt" 'Subtree of "root"' \
+		'3 nodes, max depth 1, 2 leaves, 6 label bytes'
+
+printf -- '- root\n  * a\n  + b\n\n      b1\n' > "$work/bullets.txt"
+expect_stats "$work/bullets.txt" 'Subtree of "root"' \
+		'4 nodes, max depth 2, 2 leaves, 8 label bytes'
+echo "PASS import_text"
@@ -0,0 +1,49 @@
+# Helpers for writing --replay input logs (see src/inputlog.h) from tests.
+# Source this file, then:  log_start FILE NODES; log_key FILE KEY ...
+
+# Prints a zigzag varint as printf octal escapes
+varint() {
+	local v=$(( $1 >= 0 ? $1 * 2 : -$1 * 2 - 1 )) out=
+	while [ $v -ge 128 ]; do
+		out="$out\\$(printf %03o $(( (v & 127) | 128 )))"
+		v=$(( v >> 7 ))
+	done
+	printf '%s' "$out\\$(printf %03o $v)"
+}
+
+# An event: log_event FILE TYPE FIELD..., 10 ms after the one before
+log_event() {
+	local file=$1 type=$2 fields= f
+	shift 2
+	for f in "$@"; do
+		fields="$fields$(varint "$f")"
+	done
+	printf "\\$(printf %03o "$type")\\012$fields" >> "$file"
+}
+
+log_start() {
+	printf 'CTINPUT1' > "$1"
+	printf "$(varint "$2")" >> "$1"
+}
+
+# Key codes as in the log: a character, or 27 for ESC
+log_key() {
+	log_event "$1" 2 "$2" 0 0
+}
+
+log_special() {
+	log_event "$1" 6 "$2" 0 0
+}
+
+log_reshape() {
+	log_event "$1" 4 "$2" "$3"
+}
+
+# A frame: quality level, cones, nodes, microseconds
+log_frame() {
+	log_event "$1" 5 0 "$2" "$3" 1000
+}
+
+char() {
+	printf '%d' "'$1"
+}
@@ -0,0 +1,29 @@
+#!/bin/sh
+# A replay goes on past an ESC that cancels a rename and stops at the one
+# that quits.
+# Usage: test/replay_rename.sh [path/to/conetree]
+set -e
+here=$(dirname "$0")
+viewer=${1:-$here/../Debug/conetree}
+. "$here/inputlog.sh"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+map=$here/../sample.mm
+log=$work/rename.log
+log_start "$log" 0
+log_reshape "$log" 800 600
+log_frame "$log" 0 0
+log_key "$log" "$(char e)"
+log_key "$log" "$(char x)"
+log_key "$log" 27
+log_frame "$log" 0 0
+log_key "$log" 27
+log_frame "$log" 0 0
+
+out=$("$viewer" --replay "$log" --headless "$map" 2>/dev/null)
+echo "$out" | grep -q "^Replayed 6 events, 2 frames" || {
+	echo "FAIL: $out"
+	exit 1
+}
+echo "PASS replay_rename"
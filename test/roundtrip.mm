@@ -0,0 +1,15 @@
+<map version="1.0.1">
+<!-- To view this file, download free mind mapping software FreeMind from http://freemind.sourceforge.net -->
+<node CREATED="1" ID="ID_1" MODIFIED="2" TEXT="root &amp; &#xa;map">
+<node ID="ID_3" POSITION="left" TEXT="tab&#x9;here &lt;x&gt; &quot;q&quot; it&apos;s">
+<node TEXT="cr&#xd;&#xa;lf"/>
+</node>
+<node ID="ID_2" POSITION="right" TEXT="first&#xa;second  line">
+<icon BUILTIN="idea"/>
+<richcontent TYPE="NOTE"><html><body>note</body></html></richcontent>
+<node TEXT="real
+newline	tab  two spaces"/>
+<node TEXT="  padded  "/>
+</node>
+</node>
+</map>
@@ -0,0 +1,28 @@
+#!/bin/sh
+# A gzip compressed map is read without its source, so 'w' refuses to save
+# it rather than write an uncompressed twin with only labels and attributes.
+# Usage: test/save_compressed.sh [path/to/conetree]
+set -e
+here=$(dirname "$0")
+viewer=${1:-$here/../Debug/conetree}
+. "$here/inputlog.sh"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+gzip -c "$here/roundtrip.mm" > "$work/map.mm.gz"
+log=$work/save.log
+log_start "$log" 0
+log_reshape "$log" 800 600
+log_key "$log" "$(char w)"
+
+"$viewer" --replay "$log" --headless "$work/map.mm.gz" > "$work/out" 2>&1
+grep -q "^Not saving" "$work/out" || {
+	echo "FAIL: not refused"
+	cat "$work/out"
+	exit 1
+}
+if [ -e "$work/map.mm" ]; then
+	echo "FAIL: saved anyway"
+	exit 1
+fi
+echo "PASS save_compressed"
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Saving a map with 'w' writes its labels back as they were read, once they
+# have been decoded too: character references, tabs, line breaks, runs of
+# spaces and all.
+# Usage: test/save_roundtrip.sh [path/to/conetree]
+set -e
+here=$(dirname "$0")
+viewer=${1:-$here/../Debug/conetree}
+. "$here/inputlog.sh"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cp "$here/roundtrip.mm" "$work/map.mm"
+log=$work/save.log
+log_start "$log" 0
+log_reshape "$log" 800 600
+# Start and cancel a rename on each cone, which decodes its label
+for move in 106 103 102; do	# GLUT_KEY_HOME, _DOWN, _RIGHT
+	log_special "$log" $move
+	log_key "$log" "$(char e)"
+	log_key "$log" 27
+done
+log_key "$log" "$(char w)"
+
+"$viewer" --replay "$log" --headless "$work/map.mm" > "$work/out" 2>&1
+grep -q "^Saved" "$work/out" || {
+	echo "FAIL: not saved"
+	cat "$work/out"
+	exit 1
+}
+if ! diff "$here/roundtrip.mm" "$work/map.mm"; then
+	echo "FAIL: saved map differs"
+	exit 1
+fi
+echo "PASS save_roundtrip"
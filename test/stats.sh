@@ -0,0 +1,31 @@
+# Helpers for tests of what --stats reports on a loaded map. Source this
+# file after setting $viewer and $work.
+
+# expect_stats FILE LINE1 LINE2: the first two lines of --stats FILE, past
+# any warning about joined roots
+expect_stats() {
+	"$viewer" --stats "$1" > "$work/out" 2>&1 || {
+		echo "FAIL: $1 did not load"
+		cat "$work/out"
+		exit 1
+	}
+	printf '%s\n%s\n' "$2" "$3" > "$work/expected"
+	grep -v "joined under one root" "$work/out" | head -2 > "$work/got"
+	if ! diff "$work/expected" "$work/got"; then
+		echo "FAIL: $1"
+		exit 1
+	fi
+}
+
+# expect_error FILE MESSAGE: --stats FILE fails with MESSAGE
+expect_error() {
+	if "$viewer" --stats "$1" > "$work/out" 2>&1; then
+		echo "FAIL: $1 loaded"
+		exit 1
+	fi
+	grep -qF "$2" "$work/out" || {
+		echo "FAIL: $1 did not report: $2"
+		cat "$work/out"
+		exit 1
+	}
+}